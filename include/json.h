@@ -22,10 +22,20 @@
 #ifndef _JSON_H_
 #define _JSON_H_
 
+#include "ntoa.h"
 #include "subbuffer.h"
 
 #include <string>
+#include <vector>
 #include <stdio.h>
+#include <limits.h>
+#include <sys/uio.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /**
  * @file json.h
@@ -41,8 +51,36 @@
  * by hand, but it also keeps it very simple and flexible.
  */
 
+/// The char that follows the backslash when escaping, 'u' for \u00XX, 0 if no escape is needed
+static const char s_json_escapes[256] = {
+   'u',  'u',  'u',  'u',  'u',  'u',  'u',  'u',  'b',  't',  'n',  'u',  'f',  'r',  'u',  'u',  // 0
+   'u',  'u',  'u',  'u',  'u',  'u',  'u',  'u',  'u',  'u',  'u',  'u',  'u',  'u',  'u',  'u',  // 16
+     0,    0,  '"',    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,  // 32
+     0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,  // 48
+     0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,  // 64
+     0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0, '\\',    0,    0,    0,  // 80
+     0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,  // 96
+     0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,  // 112
+     0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,  // 128
+     0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,  // 144
+     0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,  // 160
+     0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,  // 176
+     0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,  // 192
+     0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,  // 208
+     0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,  // 224
+     0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,  // 240
+};
+
 class json_array;
 
+/**
+ * @brief An ENCODER for add_encoded that copies text that is already JSON escaped.
+ */
+struct json_verbatim
+{
+        template<typename BUFF> void operator()(BUFF& dest, subbuffer src) const { dest.append(src.begin(), src.length()); }
+};
+
 /**
  * @brief Used for building a JSON object.
  * {"name":"value","name":value}
@@ -64,46 +102,96 @@ public:
                 clear();
         }
 
+        /**
+         * @brief Escapes text for use inside a JSON string.
+         *
+         * '"', '\\' and the control chars are escaped, everything else (including UTF-8)
+         * is copied as is. Runs of clean chars are found 16/32 bytes at a time (SSE2/AVX2)
+         * and appended in one go, only the chars that need escaping are handled one by one.
+         *
+         * Can be passed as the ENCODER to add_encoded.
+         */
         class json_friendly
         {
         public:
-                json_friendly() :
-                        m_last(' ') // something other than slash
-                {}
-                bool operator()(char c)
+                template<typename BUFF> void operator()(BUFF& dest, subbuffer src) const { append(dest, src); }
+
+                static void append(std::string& dest, subbuffer src)
                 {
-                        bool ps = ('\\' == m_last);
-                        bool ret = false;
+                        // most text needs no escaping, and what does usually grows by one char
+                        dest.reserve(dest.length() + src.length() + (src.length() >> 3));
+                        append<std::string>(dest, src);
+                }
 
-                        switch (c)
+                template<typename BUFF> static void append(BUFF& dest, subbuffer src)
+                {
+                        const char* p = src.begin();
+                        const char* end = p + src.length();
+                        while (p != end)
                         {
-                        case '\"':
-                        case '\n':
-                                ret = true;
-                                break;
+                                size_t clean = scan(p, end - p);
+                                if (clean)
+                                {
+                                        dest.append(p, clean);
+                                        p += clean;
+                                        if (p == end) break;
+                                }
+                                const char esc = s_json_escapes[uint8_t(*p)];
+                                if (esc == 'u')
+                                {
+                                        static const char hex[] = "0123456789abcdef";
+                                        char buff[6] = { '\\', 'u', '0', '0', hex[uint8_t(*p) >> 4], hex[uint8_t(*p) & 0xf] };
+                                        dest.append(buff, 6);
+                                }
+                                else
+                                {
+                                        char buff[2] = { '\\', esc };
+                                        dest.append(buff, 2);
+                                }
+                                ++p;
                         }
-                        if (ps)
-                                m_last = ' ';
-                        else
-                                m_last = c;
-
-                        if (ps && !ret) return true;
-                        if (!ps && ret) return true;
-                        return false;
                 }
 
-                static void append(std::string& dest, subbuffer src)
+                /**
+                 * @brief The number of chars at the front of p that need no escaping.
+                 */
+                static size_t scan(const char* p, size_t len)
                 {
-                        dest.reserve(dest.length() + (src.length() * 2));
-                        json_friendly jf;
-                        for (size_t i = 0; i < src.length(); i++)
+                        size_t i = 0;
+#if defined(__AVX2__)
+                        const __m256i quote32 = _mm256_set1_epi8('"');
+                        const __m256i slash32 = _mm256_set1_epi8('\\');
+                        const __m256i ctrl32 = _mm256_set1_epi8(0x1f);
+                        for (; i + 32 <= len; i += 32)
                         {
-                                if (jf(src[i])) dest += '\\';
-                                dest += src[i];
+                                __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+                                __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote32),
+                                                                            _mm256_cmpeq_epi8(v, slash32)),
+                                                            // unsigned v <= 0x1f
+                                                            _mm256_cmpeq_epi8(_mm256_max_epu8(v, ctrl32), ctrl32));
+                                uint32_t mask = uint32_t(_mm256_movemask_epi8(m));
+                                if (mask) return i + __builtin_ctz(mask);
                         }
+#endif
+#if defined(__SSE2__)
+                        const __m128i quote = _mm_set1_epi8('"');
+                        const __m128i slash = _mm_set1_epi8('\\');
+                        const __m128i ctrl = _mm_set1_epi8(0x1f);
+                        for (; i + 16 <= len; i += 16)
+                        {
+                                __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+                                __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                                                                      _mm_cmpeq_epi8(v, slash)),
+                                                         // unsigned v <= 0x1f
+                                                         _mm_cmpeq_epi8(_mm_max_epu8(v, ctrl), ctrl));
+                                uint32_t mask = uint32_t(_mm_movemask_epi8(m));
+                                if (mask) return i + __builtin_ctz(mask);
+                        }
+#endif
+                        for (; i < len; i++)
+                                if (s_json_escapes[uint8_t(p[i])]) return i;
+                        return len;
                 }
-        private:
-                char m_last;
         };
 
         template<typename ENCODER>
@@ -148,10 +236,8 @@ public:
         json_object& add(subbuffer key, int64_t val)
         {
                 add_key(key);
-                char buff[50];
-                size_t len = snprintf(buff, sizeof(buff), "%ld", val);
-                buff[sizeof(buff)-1] = '\0';
-                m_buff.append(buff, len);
+                char buff[NTOA_BUFF_SIZE];
+                m_buff.append(buff, ntoa(val, buff));
                 m_buff += ',';
                 return *this;
         }
@@ -159,25 +245,22 @@ public:
         json_object& add(subbuffer key, uint64_t val)
         {
                 add_key(key);
-                char buff[50];
-                size_t len = snprintf(buff, sizeof(buff), "%lu", val);
-                buff[sizeof(buff)-1] = '\0';
-                m_buff.append(buff, len);
+                char buff[NTOA_BUFF_SIZE];
+                m_buff.append(buff, ntoa(val, buff));
                 m_buff += ',';
                 return *this;
         }
 
         /**
          * @brief Add a double value
-         * @param [in] num_desc number of places after the decimal point to keep (MAX 12)
+         * @param [in] num_desc DTOA_SHORTEST (default) for the shortest text that reads back as the same double,
+         *                      or the number of places after the decimal point to keep (MAX 12)
          */
-        json_object& add(subbuffer key, double val, int num_desc = 2)
+        json_object& add(subbuffer key, double val, int num_desc = DTOA_SHORTEST)
         {
                 add_key(key);
-                char buff[512];
-                size_t len = snprintf(buff, sizeof(buff), "%.*f", num_desc, val);
-                buff[sizeof(buff)-1] = '\0';
-                m_buff.append(buff, len);
+                char buff[NTOA_BUFF_SIZE];
+                m_buff.append(buff, dtoa(val, buff, num_desc));
                 m_buff += ',';
                 return *this;
         }
@@ -253,6 +336,21 @@ public:
                 clear();
         }
 
+        template<typename ENCODER>
+        json_array& add_encoded(subbuffer val, ENCODER encode, bool quote_it = true)
+        {
+                if (quote_it || val.empty())
+                {
+                        m_buff += '\"';
+                        encode(m_buff, val);
+                        m_buff += '\"';
+                }
+                else
+                        encode(m_buff, val);
+                m_buff += ',';
+                return *this;
+        }
+
         json_array& add(subbuffer val, bool quote_it = true)
         {
                 if (quote_it) m_buff += '\"';
@@ -275,34 +373,29 @@ public:
 
         json_array& add(int64_t val)
         {
-                char buff[50];
-                size_t len = snprintf(buff, sizeof(buff), "%ld", val);
-                buff[sizeof(buff)-1] = '\0';
-                m_buff.append(buff, len);
+                char buff[NTOA_BUFF_SIZE];
+                m_buff.append(buff, ntoa(val, buff));
                 m_buff += ',';
                 return *this;
         }
 
         json_array& add(uint64_t val)
         {
-                char buff[50];
-                size_t len = snprintf(buff, sizeof(buff), "%lu", val);
-                buff[sizeof(buff)-1] = '\0';
-                m_buff.append(buff, len);
+                char buff[NTOA_BUFF_SIZE];
+                m_buff.append(buff, ntoa(val, buff));
                 m_buff += ',';
                 return *this;
         }
 
         /**
          * @brief Add a double value
-         * @param [in] num_desc number of places after the decimal point to keep (MAX 12)
+         * @param [in] num_desc DTOA_SHORTEST (default) for the shortest text that reads back as the same double,
+         *                      or the number of places after the decimal point to keep (MAX 12)
          */
-        json_array& add(double val, int num_desc = 2)
+        json_array& add(double val, int num_desc = DTOA_SHORTEST)
         {
-                char buff[512];
-                size_t len = snprintf(buff, sizeof(buff), "%.*f", num_desc, val);
-                buff[sizeof(buff)-1] = '\0';
-                m_buff.append(buff, len);
+                char buff[NTOA_BUFF_SIZE];
+                m_buff.append(buff, dtoa(val, buff, num_desc));
                 m_buff += ',';
                 return *this;
         }
@@ -366,4 +459,465 @@ inline json_object& json_object::add(subbuffer key, json_array& arr)
         return *this;
 }
 
+/**
+ * @brief Builds a whole JSON document, however deeply nested, in one caller supplied buffer.
+ *
+ * json_object/json_array give every level its own std::string and copy it into the
+ * parent when it is added. json_builder writes straight into dest and keeps a stack
+ * of the open objects/arrays instead, so nothing is copied and nothing is allocated
+ * beyond dest itself (and the stack once it is more than 15 levels deep).
+ * Commas are written as they are needed, there is nothing to trim afterwards.
+ *
+ * BUFF needs append(const char*, size_t) and operator+=(char), e.g. std::string,
+ * json_iovec, json_stream or json_fixed_buffer.
+ *
+ * std::string out;
+ * json_builder<std::string> jb(out);
+ * jb.open_object();
+ * jb.add("name", "Hal");
+ * jb.open_array("aliases").add("Bob").add("Joe").close();
+ * jb.open_object("wife").add("name", "wifey").close();
+ * jb.close();
+ */
+template<typename BUFF>
+class json_builder
+{
+public:
+        explicit json_builder(BUFF& dest):
+                m_buff(dest),
+                m_stack(),
+                m_need_comma(false)
+        {}
+
+        json_builder& open_object()
+        {
+                separate();
+                m_buff += '{';
+                m_stack += '}';
+                m_need_comma = false;
+                return *this;
+        }
+
+        json_builder& open_object(subbuffer key) { return add_key(key).open_object(); }
+
+        json_builder& open_array()
+        {
+                separate();
+                m_buff += '[';
+                m_stack += ']';
+                m_need_comma = false;
+                return *this;
+        }
+
+        json_builder& open_array(subbuffer key) { return add_key(key).open_array(); }
+
+        /**
+         * @brief Close the innermost open object or array.
+         */
+        json_builder& close()
+        {
+                if (m_stack.empty()) return *this;
+                m_buff += m_stack[m_stack.length() - 1];
+                m_stack.resize(m_stack.length() - 1);
+                m_need_comma = true;
+                return *this;
+        }
+
+        /**
+         * @brief Close everything that is still open.
+         */
+        json_builder& close_all()
+        {
+                while (!m_stack.empty()) close();
+                return *this;
+        }
+
+        /**
+         * @brief Write the key of the next value in the current object.
+         */
+        json_builder& add_key(subbuffer key)
+        {
+                separate();
+                m_buff += '\"';
+                json_object::json_friendly::append(m_buff, key);
+                m_buff.append("\":", 2);
+                m_need_comma = false;
+                return *this;
+        }
+
+        template<typename ENCODER>
+        json_builder& add_encoded(subbuffer val, ENCODER encode, bool quote_it = true)
+        {
+                separate();
+                if (quote_it || val.empty())
+                {
+                        m_buff += '\"';
+                        encode(m_buff, val);
+                        m_buff += '\"';
+                }
+                else
+                        encode(m_buff, val);
+                m_need_comma = true;
+                return *this;
+        }
+
+        /**
+         * @brief Add a string value, use add_encoded(val, json_verbatim(), false) for text that is already JSON.
+         */
+        json_builder& add(subbuffer val)
+        {
+                separate();
+                m_buff += '\"';
+                json_object::json_friendly::append(m_buff, val);
+                m_buff += '\"';
+                m_need_comma = true;
+                return *this;
+        }
+
+        json_builder& add(const char* val) { return add(subbuffer(val)); }
+        json_builder& add(int32_t val) { return add(int64_t(val)); }
+        json_builder& add(uint32_t val) { return add(uint64_t(val)); }
+
+        json_builder& add(int64_t val)
+        {
+                separate();
+                char buff[NTOA_BUFF_SIZE];
+                m_buff.append(buff, ntoa(val, buff));
+                m_need_comma = true;
+                return *this;
+        }
+
+        json_builder& add(uint64_t val)
+        {
+                separate();
+                char buff[NTOA_BUFF_SIZE];
+                m_buff.append(buff, ntoa(val, buff));
+                m_need_comma = true;
+                return *this;
+        }
+
+        /**
+         * @brief Add a double value
+         * @param [in] num_desc DTOA_SHORTEST (default) for the shortest text that reads back as the same double,
+         *                      or the number of places after the decimal point to keep (MAX 12)
+         */
+        json_builder& add(double val, int num_desc = DTOA_SHORTEST)
+        {
+                separate();
+                char buff[NTOA_BUFF_SIZE];
+                m_buff.append(buff, dtoa(val, buff, num_desc));
+                m_need_comma = true;
+                return *this;
+        }
+
+        json_builder& add(bool val)
+        {
+                separate();
+                if (val)
+                        m_buff.append("true", 4);
+                else
+                        m_buff.append("false", 5);
+                m_need_comma = true;
+                return *this;
+        }
+
+        json_builder& add_null()
+        {
+                separate();
+                m_buff.append("null", 4);
+                m_need_comma = true;
+                return *this;
+        }
+
+        json_builder& add(json_object& obj)
+        {
+                separate();
+                obj.to_string(m_buff);
+                m_need_comma = true;
+                return *this;
+        }
+
+        json_builder& add(json_array& arr)
+        {
+                separate();
+                arr.to_string(m_buff);
+                m_need_comma = true;
+                return *this;
+        }
+
+        /**
+         * @brief Add anything that has a "write(BUFF&) const" method, e.g. a parsed json::value.
+         */
+        template<typename T> json_builder& write(const T& val)
+        {
+                separate();
+                val.write(m_buff);
+                m_need_comma = true;
+                return *this;
+        }
+
+        // key/value versions of the above, for use inside an object
+
+        json_builder& add(subbuffer key, subbuffer val, bool quote_it = true)
+        {
+                if (quote_it) return add_key(key).add(val);
+                return add_key(key).add_encoded(val, json_verbatim(), false);
+        }
+
+        json_builder& add(subbuffer key, const char* val) { return add_key(key).add(val); }
+        json_builder& add(subbuffer key, int32_t val) { return add_key(key).add(val); }
+        json_builder& add(subbuffer key, uint32_t val) { return add_key(key).add(val); }
+        json_builder& add(subbuffer key, int64_t val) { return add_key(key).add(val); }
+        json_builder& add(subbuffer key, uint64_t val) { return add_key(key).add(val); }
+        json_builder& add(subbuffer key, double val, int num_desc = DTOA_SHORTEST) { return add_key(key).add(val, num_desc); }
+        json_builder& add(subbuffer key, bool val) { return add_key(key).add(val); }
+        json_builder& add(subbuffer key, json_object& obj) { return add_key(key).add(obj); }
+        json_builder& add(subbuffer key, json_array& arr) { return add_key(key).add(arr); }
+        json_builder& add_null(subbuffer key) { return add_key(key).add_null(); }
+
+        template<typename ENCODER>
+        json_builder& add_encoded(subbuffer key, subbuffer val, ENCODER encode, bool quote_it = true)
+        {
+                return add_key(key).add_encoded(val, encode, quote_it);
+        }
+
+        /**
+         * @brief Number of objects/arrays that are open.
+         */
+        size_t depth() const { return m_stack.length(); }
+
+        BUFF& buffer() { return m_buff; }
+
+private:
+        json_builder(const json_builder&);
+        json_builder& operator=(const json_builder&);
+
+        void separate()
+        {
+                if (m_need_comma) m_buff += ',';
+        }
+
+        BUFF& m_buff;
+        std::string m_stack;     //!< The closing '}' or ']' of each open object/array
+        bool m_need_comma;
+};
+
+/**
+ * @brief A fixed capacity output buffer that lives wherever it is declared (e.g. on the stack).
+ *
+ * Never allocates. Anything appended past N bytes is dropped and overflowed() is set,
+ * so check it before using the result.
+ *
+ * json_fixed_buffer<512> buff;
+ * json_builder<json_fixed_buffer<512> > jb(buff);
+ * ...
+ * if (!buff.overflowed()) send(buff.data(), buff.length());
+ */
+template<size_t N>
+class json_fixed_buffer
+{
+public:
+        json_fixed_buffer():
+                m_data(),
+                m_len(0),
+                m_overflowed(false)
+        {
+                m_data[0] = '\0';
+        }
+
+        json_fixed_buffer& append(const char* p, size_t len)
+        {
+                if (len > N - m_len)
+                {
+                        len = N - m_len;
+                        m_overflowed = true;
+                }
+                memcpy(m_data + m_len, p, len);
+                m_len += len;
+                m_data[m_len] = '\0';
+                return *this;
+        }
+
+        json_fixed_buffer& operator+=(char c)
+        {
+                if (m_len == N)
+                {
+                        m_overflowed = true;
+                        return *this;
+                }
+                m_data[m_len++] = c;
+                m_data[m_len] = '\0';
+                return *this;
+        }
+
+        void clear()
+        {
+                m_len = 0;
+                m_overflowed = false;
+                m_data[0] = '\0';
+        }
+
+        const char* data() const { return m_data; }
+        const char* c_str() const { return m_data; }
+        size_t length() const { return m_len; }
+        size_t capacity() const { return N; }
+        bool empty() const { return m_len == 0; }
+
+        /**
+         * @brief true if anything has been dropped because the buffer was full.
+         */
+        bool overflowed() const { return m_overflowed; }
+
+private:
+        char m_data[N + 1];
+        size_t m_len;
+        bool m_overflowed;
+};
+
+/**
+ * @brief A scatter/gather output buffer.
+ *
+ * Bytes passed to append() are copied into an internal buffer, bytes passed to
+ * reference() are not copied at all, the caller guarantees they outlive the json_iovec.
+ * Used to emit large, mostly unmodified documents without copying their text.
+ *
+ * json_iovec out;
+ * root.write(out);
+ * out.write_to(fd);
+ */
+class json_iovec
+{
+public:
+        json_iovec():
+                m_pieces(),
+                m_scratch(),
+                m_iov(),
+                m_length(0)
+        {}
+
+        json_iovec& append(const char* p, size_t len)
+        {
+                if (!len) return *this;
+                if (!m_pieces.empty() && m_pieces.back().owned &&
+                    m_pieces.back().offset + m_pieces.back().len == m_scratch.length())
+                {
+                        m_pieces.back().len += len;
+                }
+                else
+                {
+                        piece pc = { NULL, m_scratch.length(), len, true };
+                        m_pieces.push_back(pc);
+                }
+                m_scratch.append(p, len);
+                m_length += len;
+                return *this;
+        }
+
+        json_iovec& operator+=(char c) { return append(&c, 1); }
+
+        /**
+         * @brief Add len bytes starting at p without copying them.
+         */
+        json_iovec& reference(const char* p, size_t len)
+        {
+                if (!len) return *this;
+                if (!m_pieces.empty() && !m_pieces.back().owned &&
+                    m_pieces.back().ptr + m_pieces.back().len == p)
+                {
+                        m_pieces.back().len += len;
+                }
+                else
+                {
+                        piece pc = { p, 0, len, false };
+                        m_pieces.push_back(pc);
+                }
+                m_length += len;
+                return *this;
+        }
+
+        /**
+         * @brief The iovecs describing the output. Invalidated by the next append/reference/clear.
+         */
+        const struct iovec* iov()
+        {
+                m_iov.resize(m_pieces.size());
+                for (size_t i = 0; i < m_pieces.size(); i++)
+                {
+                        const char* p = m_pieces[i].owned ? m_scratch.data() + m_pieces[i].offset : m_pieces[i].ptr;
+                        m_iov[i].iov_base = const_cast<char*>(p);
+                        m_iov[i].iov_len = m_pieces[i].len;
+                }
+                return m_iov.empty() ? NULL : &m_iov[0];
+        }
+
+        size_t iov_count() const { return m_pieces.size(); }
+
+        /**
+         * @brief Total number of bytes described by the iovecs.
+         */
+        size_t length() const { return m_length; }
+
+        /**
+         * @brief Flatten into dest, mostly useful for testing.
+         */
+        template<typename BUFF> void to_string(BUFF& dest)
+        {
+                const struct iovec* v = iov();
+                for (size_t i = 0; i < iov_count(); i++)
+                        dest.append((const char*)v[i].iov_base, v[i].iov_len);
+        }
+
+        /**
+         * @brief writev() everything to fd, IOV_MAX iovecs at a time.
+         * @returns false if a write failed.
+         */
+        bool write_to(int fd)
+        {
+                struct iovec* v = const_cast<struct iovec*>(iov());
+                size_t cnt = iov_count();
+                while (cnt)
+                {
+                        int batch = (int)std::min(cnt, (size_t)IOV_MAX);
+                        ssize_t wrote = ::writev(fd, v, batch);
+                        if (wrote < 0) return false;
+                        // skip over whatever was fully written and adjust a partial write
+                        while (cnt && (size_t)wrote >= v->iov_len)
+                        {
+                                wrote -= v->iov_len;
+                                ++v;
+                                --cnt;
+                        }
+                        if (cnt)
+                        {
+                                v->iov_base = (char*)v->iov_base + wrote;
+                                v->iov_len -= wrote;
+                        }
+                }
+                return true;
+        }
+
+        json_iovec& clear()
+        {
+                m_pieces.clear();
+                m_scratch.clear();
+                m_iov.clear();
+                m_length = 0;
+                return *this;
+        }
+
+        bool empty() const { return !m_length; }
+private:
+        struct piece
+        {
+                const char* ptr;
+                size_t offset;
+                size_t len;
+                bool owned;
+        };
+        std::vector<piece> m_pieces;
+        std::string m_scratch;
+        std::vector<struct iovec> m_iov;
+        size_t m_length;
+};
+
 #endif
@@ -0,0 +1,550 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    json_bind.h
+//: \details: Parse JSON text straight into C++ structs described by JSON_BIND.
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#ifndef _JSON_BIND_H_
+#define _JSON_BIND_H_
+
+#if __cplusplus < 201402L
+#error "json_bind.h needs C++14"
+#endif
+
+#include "json.h"
+#include "json_scan.h"
+#include "perfect_hash.h"
+
+#include <bitset>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#ifndef JSON_MAX_PARSE_RECURSION
+#define JSON_MAX_PARSE_RECURSION 500
+#endif
+
+/**
+  @brief Describe a struct's fields once, then parse JSON text directly into it and write it back out.
+
+  There is no json::root in between: the text is scanned once, each key is looked up in a
+  perfect hash built at compile time from the declared keys and its value is converted
+  straight into the member. Keys that weren't declared are skipped without being looked at.
+
+  @code
+        struct address { std::string city; int32_t zip; };
+        struct person  { std::string name; int64_t id; std::vector<std::string> tags; address home; };
+
+        JSON_BIND(address,
+                  JSON_FIELD(city, json::REQUIRED),
+                  JSON_FIELD(zip, json::OPTIONAL))
+        JSON_BIND(person,
+                  JSON_FIELD(name, json::REQUIRED),
+                  JSON_FIELD_KEY(id, "person_id", json::REQUIRED),
+                  JSON_FIELD(tags, json::OPTIONAL),
+                  JSON_FIELD(home, json::OPTIONAL))
+
+        person p;
+        json::bind_result res;
+        if (!json::from_json(text, p, &res))
+                // res.error says what went wrong, res.missing lists required keys that weren't there
+
+        std::string out;
+        json::to_json(p, out);
+  @endcode
+
+  to_json appends each key as a single literal (e.g. ,"person_id": ) that was quoted by the
+  preprocessor, so the only work left at run time is copying it and formatting the value.
+
+  JSON_BIND has to be used at global scope. Member types can be std::string (unescaped),
+  subbuffer (points into the text, still escaped), bool, the integer types, float, double,
+  std::vector of any of those and other JSON_BIND structs. A null leaves the member as it was.
+  Keys are matched against the text as is, so declared keys should not need escaping.
+ */
+
+namespace json
+{
+        enum bind_flags { OPTIONAL = 0, REQUIRED = 1 };
+
+        /**
+          @brief Specialized by JSON_BIND with a constexpr fields() returning a tuple of field.
+         */
+        template<typename T> struct binding;
+
+        template<typename C, typename M>
+        struct field
+        {
+                const char* key;
+                size_t len;
+                const char* quoted;     //!< ,"key":
+                size_t quoted_len;
+                M C::* member;
+                bool required;
+        };
+
+        template<typename C, typename M, size_t L, size_t Q>
+        constexpr field<C, M> make_field(const char (&key)[L], const char (&quoted)[Q], M C::* member, int flags)
+        {
+                for (size_t i = 0; i < L - 1; i++)
+                {
+                        if (key[i] == '"' || key[i] == '\\' || uint8_t(key[i]) < 0x20)
+                                throw std::logic_error("JSON_FIELD keys must not need escaping");
+                }
+                return field<C, M>{ key, L - 1, quoted, Q - 1, member, (flags & REQUIRED) != 0 };
+        }
+
+        /**
+          @brief What went wrong, filled in by from_json when it returns false.
+         */
+        struct bind_result
+        {
+                bind_result():
+                        error(),
+                        offset(0),
+                        missing()
+                {}
+
+                std::string error;                      //!< empty if the text parsed
+                size_t offset;                          //!< where in the text the error was found
+                std::vector<std::string> missing;       //!< required keys that were not present, e.g. "home.city"
+        };
+
+        namespace bind_internal
+        {
+                struct context
+                {
+                        context(subbuffer text, bind_result* res):
+                                start(text.begin()),
+                                result(res),
+                                path(),
+                                failed(false)
+                        {}
+
+                        bool fail(subbuffer at, const char* msg)
+                        {
+                                if (!failed && result)
+                                {
+                                        result->error = msg;
+                                        result->offset = at.begin() - start;
+                                }
+                                failed = true;
+                                return false;
+                        }
+
+                        void missing(const char* key, size_t len)
+                        {
+                                failed = true;
+                                if (!result) return;
+                                std::string name;
+                                for (size_t i = 0; i < path.size(); i++)
+                                {
+                                        name.append(path[i].begin(), path[i].length());
+                                        name += '.';
+                                }
+                                name.append(key, len);
+                                result->missing.push_back(name);
+                        }
+
+                        const char* start;
+                        bind_result* result;
+                        std::vector<subbuffer> path;    //!< keys leading to the current object
+                        bool failed;
+
+                private:
+                        context(const context&);
+                        context& operator=(const context&);
+                };
+
+                template<typename Tuple, size_t... I>
+                constexpr perfect_hash<sizeof...(I)> make_hash(const Tuple& fields, std::index_sequence<I...>)
+                {
+                        const char* keys[] = { std::get<I>(fields).key... };
+                        size_t lens[] = { std::get<I>(fields).len... };
+                        return perfect_hash<sizeof...(I)>(keys, lens);
+                }
+
+                template<typename T> bool read(subbuffer& val, T& out, context& ctx, int32_t level);
+
+                inline bool read_null(subbuffer& val)
+                {
+                        return scan::literal(val, "null", 4);
+                }
+
+                inline bool read(subbuffer& val, std::string& out, context& ctx, int32_t)
+                {
+                        subbuffer raw;
+                        if (!scan::string(val, raw)) return read_null(val) || ctx.fail(val, "expected a string");
+                        out.clear();
+                        scan::unescape(raw, out);
+                        return true;
+                }
+
+                inline bool read(subbuffer& val, subbuffer& out, context& ctx, int32_t)
+                {
+                        if (!scan::string(val, out)) return read_null(val) || ctx.fail(val, "expected a string");
+                        return true;
+                }
+
+                inline bool read(subbuffer& val, bool& out, context& ctx, int32_t)
+                {
+                        if (scan::literal(val, "true", 4))
+                                out = true;
+                        else if (scan::literal(val, "false", 5))
+                                out = false;
+                        else
+                                return read_null(val) || ctx.fail(val, "expected true or false");
+                        return true;
+                }
+
+                template<typename NUMB>
+                bool read_integer(subbuffer& val, NUMB& out, context& ctx)
+                {
+                        subbuffer text;
+                        if (!scan::number(val, text)) return read_null(val) || ctx.fail(val, "expected a number");
+                        subbuffer rem;
+                        NUMB n = aton<NUMB>(text, &rem);
+                        if (!rem.empty()) return ctx.fail(text, "expected an integer");
+                        out = n;
+                        return true;
+                }
+
+                inline bool read(subbuffer& val, int32_t& out, context& ctx, int32_t) { return read_integer(val, out, ctx); }
+                inline bool read(subbuffer& val, uint32_t& out, context& ctx, int32_t) { return read_integer(val, out, ctx); }
+                inline bool read(subbuffer& val, int64_t& out, context& ctx, int32_t) { return read_integer(val, out, ctx); }
+                inline bool read(subbuffer& val, uint64_t& out, context& ctx, int32_t) { return read_integer(val, out, ctx); }
+
+                inline bool read(subbuffer& val, double& out, context& ctx, int32_t)
+                {
+                        subbuffer text;
+                        if (!scan::number(val, text)) return read_null(val) || ctx.fail(val, "expected a number");
+                        if (!scan::to_double(text, out)) return ctx.fail(text, "invalid number");
+                        return true;
+                }
+
+                inline bool read(subbuffer& val, float& out, context& ctx, int32_t level)
+                {
+                        double d = out;
+                        if (!read(val, d, ctx, level)) return false;
+                        out = float(d);
+                        return true;
+                }
+
+                template<typename E>
+                bool read(subbuffer& val, std::vector<E>& out, context& ctx, int32_t level)
+                {
+                        if (JSON_MAX_PARSE_RECURSION < ++level) return ctx.fail(val, "too many levels of recursion");
+                        if (!val.starts_with('[')) return read_null(val) || ctx.fail(val, "expected an array");
+                        val.advance(1);
+                        out.clear();
+                        scan::skip_ws(val);
+                        if (val.starts_with(']'))
+                        {
+                                val.advance(1);
+                                return true;
+                        }
+                        while (true)
+                        {
+                                out.resize(out.size() + 1);
+                                scan::skip_ws(val);
+                                if (!read(val, out.back(), ctx, level)) return false;
+                                scan::skip_ws(val);
+                                if (val.starts_with(','))
+                                        val.advance(1);
+                                else if (val.starts_with(']'))
+                                {
+                                        val.advance(1);
+                                        return true;
+                                }
+                                else
+                                        return ctx.fail(val, "expected , or ] in array");
+                        }
+                }
+
+                // the elements of a vector<bool> are bits, so each is read into a bool and pushed
+                inline bool read(subbuffer& val, std::vector<bool>& out, context& ctx, int32_t level)
+                {
+                        if (JSON_MAX_PARSE_RECURSION < ++level) return ctx.fail(val, "too many levels of recursion");
+                        if (!val.starts_with('[')) return read_null(val) || ctx.fail(val, "expected an array");
+                        val.advance(1);
+                        out.clear();
+                        scan::skip_ws(val);
+                        if (val.starts_with(']'))
+                        {
+                                val.advance(1);
+                                return true;
+                        }
+                        while (true)
+                        {
+                                bool b = false;
+                                scan::skip_ws(val);
+                                if (!read(val, b, ctx, level)) return false;
+                                out.push_back(b);
+                                scan::skip_ws(val);
+                                if (val.starts_with(','))
+                                        val.advance(1);
+                                else if (val.starts_with(']'))
+                                {
+                                        val.advance(1);
+                                        return true;
+                                }
+                                else
+                                        return ctx.fail(val, "expected , or ] in array");
+                        }
+                }
+
+                template<typename BUFF, typename T> void write(BUFF& out, const T& obj);
+
+                template<typename BUFF> void write(BUFF& out, const std::string& val)
+                {
+                        out += '"';
+                        json_object::json_friendly::append(out, val);
+                        out += '"';
+                }
+
+                template<typename BUFF> void write(BUFF& out, const subbuffer& val)
+                {
+                        // already escaped, it came from JSON text
+                        out += '"';
+                        out.append(val.begin(), val.length());
+                        out += '"';
+                }
+
+                template<typename BUFF> void write(BUFF& out, bool val)
+                {
+                        if (val)
+                                out.append("true", 4);
+                        else
+                                out.append("false", 5);
+                }
+
+                template<typename BUFF, typename NUMB> void write_integer(BUFF& out, NUMB val)
+                {
+                        char buff[NTOA_BUFF_SIZE];
+                        out.append(buff, ntoa(val, buff));
+                }
+
+                template<typename BUFF> void write(BUFF& out, int32_t val) { write_integer(out, val); }
+                template<typename BUFF> void write(BUFF& out, uint32_t val) { write_integer(out, val); }
+                template<typename BUFF> void write(BUFF& out, int64_t val) { write_integer(out, val); }
+                template<typename BUFF> void write(BUFF& out, uint64_t val) { write_integer(out, val); }
+
+                template<typename BUFF> void write(BUFF& out, double val)
+                {
+                        char buff[NTOA_BUFF_SIZE];
+                        out.append(buff, dtoa(val, buff));
+                }
+
+                template<typename BUFF> void write(BUFF& out, float val) { write(out, double(val)); }
+
+                template<typename BUFF, typename E> void write(BUFF& out, const std::vector<E>& vals)
+                {
+                        out += '[';
+                        for (typename std::vector<E>::const_iterator it = vals.begin(); it != vals.end(); ++it)
+                        {
+                                if (it != vals.begin()) out += ',';
+                                write(out, *it);
+                        }
+                        out += ']';
+                }
+
+                /**
+                  @brief The per struct tables: the fields, their perfect hash and a reader per field.
+                 */
+                template<typename T>
+                struct bound
+                {
+                        typedef decltype(binding<T>::fields()) fields_t;
+                        static constexpr size_t N = std::tuple_size<fields_t>::value;
+                        typedef bool (*reader_t)(subbuffer&, T&, context&, int32_t);
+
+                        static constexpr fields_t s_fields = binding<T>::fields();
+                        static constexpr perfect_hash<N> s_hash = make_hash(binding<T>::fields(), std::make_index_sequence<N>());
+
+                        template<size_t I>
+                        static bool read_field(subbuffer& val, T& out, context& ctx, int32_t level)
+                        {
+                                return read(val, out.*(std::get<I>(s_fields).member), ctx, level);
+                        }
+
+                        template<size_t... I>
+                        static const reader_t* make_readers(std::index_sequence<I...>)
+                        {
+                                static const reader_t readers[] = { &read_field<I>... };
+                                return readers;
+                        }
+
+                        static const reader_t* readers()
+                        {
+                                static const reader_t* r = make_readers(std::make_index_sequence<N>());
+                                return r;
+                        }
+
+                        template<size_t I, typename BUFF>
+                        static void write_field(BUFF& out, const T& obj)
+                        {
+                                // the first key doesn't need the comma
+                                out.append(std::get<I>(s_fields).quoted + (I == 0), std::get<I>(s_fields).quoted_len - (I == 0));
+                                write(out, obj.*(std::get<I>(s_fields).member));
+                        }
+
+                        template<typename BUFF, size_t... I>
+                        static void write_fields(BUFF& out, const T& obj, std::index_sequence<I...>)
+                        {
+                                int expand[] = { 0, (write_field<I>(out, obj), 0)... };
+                                (void)expand;
+                        }
+
+                        template<size_t... I>
+                        static const bool* make_required(std::index_sequence<I...>)
+                        {
+                                static const bool req[] = { std::get<I>(s_fields).required... };
+                                return req;
+                        }
+
+                        static const bool* required()
+                        {
+                                static const bool* r = make_required(std::make_index_sequence<N>());
+                                return r;
+                        }
+                };
+
+                template<typename T> constexpr typename bound<T>::fields_t bound<T>::s_fields;
+                template<typename T> constexpr perfect_hash<bound<T>::N> bound<T>::s_hash;
+
+                template<typename T>
+                bool read(subbuffer& val, T& out, context& ctx, int32_t level)
+                {
+                        typedef bound<T> B;
+                        if (JSON_MAX_PARSE_RECURSION < ++level) return ctx.fail(val, "too many levels of recursion");
+                        if (!val.starts_with('{')) return read_null(val) || ctx.fail(val, "expected an object");
+                        val.advance(1);
+
+                        const typename B::reader_t* readers = B::readers();
+                        std::bitset<B::N> seen;
+                        scan::skip_ws(val);
+                        if (val.starts_with('}'))
+                                val.advance(1);
+                        else while (true)
+                        {
+                                scan::skip_ws(val);
+                                subbuffer key;
+                                if (!scan::string(val, key)) return ctx.fail(val, "expected a key");
+                                scan::skip_ws(val);
+                                if (!val.starts_with(':')) return ctx.fail(val, "expected : after key");
+                                val.advance(1);
+                                scan::skip_ws(val);
+
+                                int idx = B::s_hash.find(key.begin(), key.length());
+                                if (idx < 0)
+                                {
+                                        if (!scan::skip_value(val)) return ctx.fail(val, "invalid value");
+                                }
+                                else
+                                {
+                                        ctx.path.push_back(key);
+                                        if (!readers[idx](val, out, ctx, level)) return false;
+                                        ctx.path.pop_back();
+                                        seen.set(idx);
+                                }
+
+                                scan::skip_ws(val);
+                                if (val.starts_with(','))
+                                        val.advance(1);
+                                else if (val.starts_with('}'))
+                                {
+                                        val.advance(1);
+                                        break;
+                                }
+                                else
+                                        return ctx.fail(val, "expected , or } in object");
+                        }
+
+                        if (seen.count() != B::N)
+                        {
+                                const bool* required = B::required();
+                                for (size_t i = 0; i < B::N; i++)
+                                        if (!seen[i] && required[i])
+                                                ctx.missing(B::s_hash.key(i), B::s_hash.key_length(i));
+                        }
+                        return true;
+                }
+        }
+
+        namespace bind_internal
+        {
+                template<typename BUFF, typename T>
+                void write(BUFF& out, const T& obj)
+                {
+                        out += '{';
+                        bound<T>::write_fields(out, obj, std::make_index_sequence<bound<T>::N>());
+                        out += '}';
+                }
+        }
+
+        /**
+          @brief Append obj to out as JSON.
+          @details BUFF needs append(const char*, size_t) and operator+=(char), e.g. std::string,
+                   json_iovec, json_stream or json_fixed_buffer.
+         */
+        template<typename T, typename BUFF>
+        void to_json(const T& obj, BUFF& out)
+        {
+                bind_internal::write(out, obj);
+        }
+
+        /**
+          @brief Parse text into out.
+          @param [out] result Optional, says why the parse failed.
+          @returns false if the text isn't valid for T or a required key is missing.
+                   out may have been partially filled in.
+         */
+        template<typename T>
+        bool from_json(subbuffer text, T& out, bind_result* result = NULL)
+        {
+                bind_internal::context ctx(text, result);
+                subbuffer val(text);
+                scan::skip_ws(val);
+                if (!bind_internal::read(val, out, ctx, 0)) return false;
+                scan::skip_ws(val);
+                if (!val.empty()) return ctx.fail(val, "unexpected text after the value");
+                if (ctx.failed && result && result->error.empty()) result->error = "missing required keys";
+                return !ctx.failed;
+        }
+}
+
+/**
+  @brief Declare the fields of TYPE, each one a JSON_FIELD or JSON_FIELD_KEY.
+ */
+#define JSON_BIND(TYPE, ...)                                                            \
+        namespace json {                                                                \
+        template<> struct binding<TYPE>                                                 \
+        {                                                                               \
+                typedef TYPE type;                                                      \
+                static constexpr auto fields() { return std::make_tuple(__VA_ARGS__); } \
+        };                                                                              \
+        }
+
+/// A member whose JSON key is the member's name, FLAGS is json::REQUIRED or json::OPTIONAL
+#define JSON_FIELD(MEMBER, FLAGS) ::json::make_field(#MEMBER, ",\"" #MEMBER "\":", &type::MEMBER, FLAGS)
+
+/// A member with a different JSON key, KEY has to be a string literal
+#define JSON_FIELD_KEY(MEMBER, KEY, FLAGS) ::json::make_field(KEY, ",\"" KEY "\":", &type::MEMBER, FLAGS)
+
+#endif
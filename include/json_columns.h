@@ -0,0 +1,462 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    json_columns.h
+//: \details: Extract fields from every record of NDJSON text into typed columns.
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#ifndef _JSON_COLUMNS_H_
+#define _JSON_COLUMNS_H_
+
+#include "json_path.h"
+#include "json_scan.h"
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace json
+{
+        enum column_type { COLUMN_DOUBLE, COLUMN_INT64, COLUMN_STRING, COLUMN_BOOL };
+
+        /**
+          @brief One field of every record, in a contiguous vector of its type plus a null bitmap.
+
+          Only the vector for type() is filled. A row is null when the field is missing, null, of
+          another type, or (for COLUMN_INT64) not a whole number; the vector then holds 0, false or
+          an empty subbuffer for it.
+         */
+        class column
+        {
+        public:
+                column(const std::string& name, column_type type)
+                        : m_name(name), m_type(type), m_doubles(), m_ints(), m_strings(), m_bools(), m_nulls(), m_rows(0)
+                {}
+
+                const std::string& name() const { return m_name; }
+                column_type type() const { return m_type; }
+                size_t size() const { return m_rows; }
+
+                bool is_null(size_t row) const { return (m_nulls[row >> 6] >> (row & 63)) & 1; }
+
+                const std::vector<double>& doubles() const { return m_doubles; }
+                const std::vector<int64_t>& ints() const { return m_ints; }
+
+                /**
+                  @brief Point into the extracted text, still escaped (see scan::unescape), without the quotes.
+                 */
+                const std::vector<subbuffer>& strings() const { return m_strings; }
+
+                /**
+                  @brief 0 or 1 per row, a byte each so it is contiguous (unlike std::vector<bool>).
+                 */
+                const std::vector<uint8_t>& bools() const { return m_bools; }
+
+                /**
+                  @brief Bit (row & 63) of word (row >> 6) is set when the row is null.
+                 */
+                const std::vector<uint64_t>& null_bitmap() const { return m_nulls; }
+
+        private:
+                friend class ndjson_columns;
+
+                void add_null_row()
+                {
+                        size_t row = m_rows++;
+                        if (!(row & 63)) m_nulls.push_back(0);
+                        m_nulls[row >> 6] |= uint64_t(1) << (row & 63);
+                        switch (m_type)
+                        {
+                        case COLUMN_DOUBLE: m_doubles.push_back(0); break;
+                        case COLUMN_INT64: m_ints.push_back(0); break;
+                        case COLUMN_STRING: m_strings.push_back(subbuffer()); break;
+                        case COLUMN_BOOL: m_bools.push_back(0); break;
+                        }
+                }
+
+                void set_null(size_t row)
+                {
+                        m_nulls[row >> 6] |= uint64_t(1) << (row & 63);
+                }
+
+                /**
+                  @param [in] text The raw text of the value.
+                  @returns false, leaving the row null, if text is not of type().
+                 */
+                bool set(size_t row, subbuffer text)
+                {
+                        subbuffer num;
+                        double d;
+                        switch (m_type)
+                        {
+                        case COLUMN_DOUBLE:
+                                if (!scan::number(text, num) || !text.empty() || !scan::to_double(num, d)) return false;
+                                m_doubles[row] = d;
+                                break;
+                        case COLUMN_INT64:
+                        {
+                                if (!scan::number(text, num) || !text.empty()) return false;
+                                subbuffer rem;
+                                int64_t i = aton<int64_t>(num, &rem);
+                                if (!rem.empty())
+                                {
+                                        // 1.0 or 1e3 are whole numbers too
+                                        if (!scan::to_double(num, d) || !(d >= -9.2e18 && d <= 9.2e18) || d != double(int64_t(d))) return false;
+                                        i = int64_t(d);
+                                }
+                                m_ints[row] = i;
+                                break;
+                        }
+                        case COLUMN_STRING:
+                                if (!scan::string(text, num) || !text.empty()) return false;
+                                m_strings[row] = num;
+                                break;
+                        case COLUMN_BOOL:
+                                if (text.equals(CONST_SUBBUF("true")))
+                                        m_bools[row] = 1;
+                                else if (!text.equals(CONST_SUBBUF("false")))
+                                        return false;
+                                break;
+                        }
+                        m_nulls[row >> 6] &= ~(uint64_t(1) << (row & 63));
+                        return true;
+                }
+
+                void append(const column& rhs)
+                {
+                        m_doubles.insert(m_doubles.end(), rhs.m_doubles.begin(), rhs.m_doubles.end());
+                        m_ints.insert(m_ints.end(), rhs.m_ints.begin(), rhs.m_ints.end());
+                        m_strings.insert(m_strings.end(), rhs.m_strings.begin(), rhs.m_strings.end());
+                        m_bools.insert(m_bools.end(), rhs.m_bools.begin(), rhs.m_bools.end());
+                        size_t shift = m_rows & 63;
+                        if (!shift)
+                                m_nulls.insert(m_nulls.end(), rhs.m_nulls.begin(), rhs.m_nulls.end());
+                        else
+                        {
+                                // the rows of rhs start part way into our last word
+                                for (size_t i = 0; i < rhs.m_nulls.size(); i++)
+                                {
+                                        m_nulls.back() |= rhs.m_nulls[i] << shift;
+                                        m_nulls.push_back(rhs.m_nulls[i] >> (64 - shift));
+                                }
+                        }
+                        m_rows += rhs.m_rows;
+                        m_nulls.resize((m_rows + 63) >> 6);
+                }
+
+                void clear()
+                {
+                        m_doubles.clear();
+                        m_ints.clear();
+                        m_strings.clear();
+                        m_bools.clear();
+                        m_nulls.clear();
+                        m_rows = 0;
+                }
+
+                std::string m_name;
+                column_type m_type;
+                std::vector<double> m_doubles;
+                std::vector<int64_t> m_ints;
+                std::vector<subbuffer> m_strings;
+                std::vector<uint8_t> m_bools;
+                std::vector<uint64_t> m_nulls;
+                size_t m_rows;
+        };
+
+        /**
+          @brief Pulls a few fields out of every line of NDJSON text into columns, with no json::root per record.
+
+          Each record is scanned once for all the columns together: only the members and elements
+          on a column's path are looked into, everything else is skipped by counting brackets, and
+          the scan stops at the end of the line or as soon as every column has its value (the first
+          of repeated keys wins). The text is split at line boundaries and the pieces are extracted
+          on separate threads, then the columns are joined in order.
+
+          @code
+                json::ndjson_columns cols;
+                size_t price = cols.add_column("$.price", json::COLUMN_DOUBLE);
+                size_t user = cols.add_column("$.user.name", json::COLUMN_STRING);
+                cols.extract(file.contents());
+                for (size_t row = 0; row < cols.rows(); row++)
+                        if (!cols[price].is_null(row)) total += cols[price].doubles()[row];
+          @endcode
+
+          Column paths are JSONPath with members and indexes only, e.g. $.a.b[2]. String columns
+          point into the text, which must outlive them. Blank lines are skipped; a line that is
+          not well formed gives a row of nulls and is counted in errors().
+         */
+        class ndjson_columns
+        {
+        public:
+                ndjson_columns() :m_columns(), m_paths(), m_active(), m_seen(), m_rows(0), m_errors(0), m_error() {}
+
+                /**
+                  @returns The index of the new column, or npos (see error()) if path can't be used.
+                 */
+                size_t add_column(subbuffer path_text, column_type type)
+                {
+                        path p(path_text);
+                        if (!p.is_valid())
+                        {
+                                m_error = p.error();
+                                return npos;
+                        }
+                        const std::vector<path::step>& steps = p.steps();
+                        bool usable = !steps.empty();
+                        for (size_t i = 0; i < steps.size(); i++)
+                                if (steps[i].recursive || (steps[i].type != path::CHILD && steps[i].type != path::INDEX) || steps[i].index < 0)
+                                        usable = false;
+                        if (!usable)
+                        {
+                                m_error = "a column path is one or more members and (positive) indexes";
+                                return npos;
+                        }
+
+                        m_columns.push_back(column(std::string(path_text.begin(), path_text.length()), type));
+                        m_paths.push_back(steps);
+                        // every column starts out active at depth 0, the deeper levels are scratch
+                        if (m_active.size() < steps.size() + 1) m_active.resize(steps.size() + 1);
+                        m_active[0].push_back(m_columns.size() - 1);
+                        // the existing rows have nothing for it
+                        for (size_t i = 0; i < m_rows; i++) m_columns.back().add_null_row();
+                        return m_columns.size() - 1;
+                }
+
+                /**
+                  @brief Add a row to every column for each record in text.
+                  @param [in] threads How many threads to split the work over, 0 for one per core.
+                  @returns The number of rows added.
+                 */
+                size_t extract(subbuffer text, unsigned threads = 0)
+                {
+                        if (!threads) threads = std::thread::hardware_concurrency();
+                        // not worth a thread for less than this
+                        size_t max_threads = text.length() / (256 * 1024);
+                        if (threads > max_threads) threads = max_threads;
+                        if (threads <= 1) return extract_lines(text);
+
+                        std::vector<subbuffer> pieces;
+                        subbuffer rest = text;
+                        for (unsigned i = 1; i < threads && !rest.empty(); i++)
+                        {
+                                size_t cut = rest.length() / (threads - i + 1);
+                                const char* nl = (const char*)memchr(rest.begin() + cut, '\n', rest.length() - cut);
+                                if (!nl) break;
+                                size_t len = nl + 1 - rest.begin();
+                                pieces.push_back(rest.sub(0, len));
+                                rest.advance(len);
+                        }
+                        if (!rest.empty()) pieces.push_back(rest);
+
+                        std::vector<std::unique_ptr<ndjson_columns> > parts;
+                        std::vector<std::thread> workers;
+                        for (size_t i = 0; i < pieces.size(); i++)
+                                parts.push_back(std::unique_ptr<ndjson_columns>(new ndjson_columns(*this, false)));
+                        for (size_t i = 1; i < pieces.size(); i++)
+                                workers.push_back(std::thread(&ndjson_columns::extract_lines, parts[i].get(), pieces[i]));
+                        parts[0]->extract_lines(pieces[0]);
+                        for (size_t i = 0; i < workers.size(); i++)
+                                workers[i].join();
+
+                        size_t added = 0;
+                        for (size_t i = 0; i < parts.size(); i++)
+                        {
+                                for (size_t c = 0; c < m_columns.size(); c++)
+                                        m_columns[c].append(parts[i]->m_columns[c]);
+                                m_rows += parts[i]->m_rows;
+                                m_errors += parts[i]->m_errors;
+                                added += parts[i]->m_rows;
+                        }
+                        return added;
+                }
+
+                size_t columns() const { return m_columns.size(); }
+                const column& operator[](size_t i) const { return m_columns[i]; }
+                size_t rows() const { return m_rows; }
+
+                /**
+                  @brief Lines that were not well formed.
+                 */
+                size_t errors() const { return m_errors; }
+
+                /**
+                  @brief Why add_column() failed.
+                 */
+                const std::string& error() const { return m_error; }
+
+                /**
+                  @brief Drop the rows, keep the columns.
+                 */
+                void clear()
+                {
+                        for (size_t c = 0; c < m_columns.size(); c++)
+                                m_columns[c].clear();
+                        m_rows = 0;
+                        m_errors = 0;
+                }
+
+                static const size_t npos = size_t(-1);
+
+        private:
+                // the same columns, with no rows, for one thread's piece of the text
+                ndjson_columns(const ndjson_columns& defs, bool)
+                        : m_columns(), m_paths(defs.m_paths), m_active(defs.m_active), m_seen(), m_rows(0), m_errors(0), m_error()
+                {
+                        for (size_t c = 0; c < defs.m_columns.size(); c++)
+                                m_columns.push_back(column(defs.m_columns[c].m_name, defs.m_columns[c].m_type));
+                }
+
+                size_t extract_lines(subbuffer text)
+                {
+                        size_t before = m_rows;
+                        while (!text.empty())
+                        {
+                                const char* nl = (const char*)memchr(text.begin(), '\n', text.length());
+                                size_t len = nl ? nl - text.begin() : text.length();
+                                subbuffer line = text.sub(0, len);
+                                text.advance(len + 1);
+
+                                scan::skip_ws(line);
+                                if (line.empty()) continue;
+
+                                size_t row = m_rows++;
+                                for (size_t c = 0; c < m_columns.size(); c++)
+                                        m_columns[c].add_null_row();
+                                size_t remaining = m_columns.size();
+                                m_seen.assign(m_columns.size(), 0);
+                                bool ok = !remaining || walk(line, 0, row, remaining);
+                                if (ok && remaining)
+                                {
+                                        // read to the end, there must be nothing after the record
+                                        scan::skip_ws(line);
+                                        ok = line.empty();
+                                }
+                                if (!ok)
+                                {
+                                        for (size_t c = 0; c < m_columns.size(); c++)
+                                                m_columns[c].set_null(row);
+                                        m_errors++;
+                                }
+                        }
+                        return m_rows - before;
+                }
+
+                /**
+                  @brief Look for the columns in m_active[depth] in the value at the front of val.
+                  @details Their paths match the way here for depth steps. val is left just past the
+                           value, unless remaining got to 0 and the rest of the line doesn't matter.
+                 */
+                bool walk(subbuffer& val, size_t depth, size_t row, size_t& remaining)
+                {
+                        scan::skip_ws(val);
+                        char close;
+                        if (val.starts_with('{'))
+                                close = '}';
+                        else if (val.starts_with('['))
+                                close = ']';
+                        else
+                                return scan::skip_value(val);
+
+                        val.advance(1);
+                        scan::skip_ws(val);
+                        if (val.starts_with(close))
+                        {
+                                val.advance(1);
+                                return true;
+                        }
+                        const std::vector<size_t>& active = m_active[depth];
+                        std::vector<size_t>& next = m_active[depth + 1];
+                        for (int64_t k = 0; ; k++)
+                        {
+                                subbuffer key;
+                                if (close == '}')
+                                {
+                                        scan::skip_ws(val);
+                                        if (!scan::string(val, key)) return false;
+                                        scan::skip_ws(val);
+                                        if (!val.starts_with(':')) return false;
+                                        val.advance(1);
+                                }
+
+                                next.clear();
+                                subbuffer v;
+                                bool have_value = false;
+                                for (size_t i = 0; i < active.size(); i++)
+                                {
+                                        size_t c = active[i];
+                                        const path::step& s = m_paths[c][depth];
+                                        bool hit = close == '}' ? (s.type == path::CHILD && scan::same_string(key, subbuffer(s.name)))
+                                                                : (s.type == path::INDEX && s.index == k);
+                                        if (!hit) continue;
+                                        if (m_paths[c].size() > depth + 1)
+                                        {
+                                                next.push_back(c);
+                                                continue;
+                                        }
+                                        if (!have_value)
+                                        {
+                                                if (!scan::value_text(val, v)) return false;
+                                                have_value = true;
+                                        }
+                                        // the first of repeated keys wins
+                                        if (m_seen[c]) continue;
+                                        m_seen[c] = 1;
+                                        remaining--;
+                                        m_columns[c].set(row, v);
+                                }
+
+                                if (!next.empty())
+                                {
+                                        if (have_value)
+                                        {
+                                                subbuffer inner = v;
+                                                if (!walk(inner, depth + 1, row, remaining)) return false;
+                                        }
+                                        else if (!walk(val, depth + 1, row, remaining))
+                                                return false;
+                                }
+                                else if (!have_value && !scan::skip_value(val))
+                                        return false;
+
+                                if (!remaining) return true;
+                                scan::skip_ws(val);
+                                if (val.starts_with(close))
+                                {
+                                        val.advance(1);
+                                        return true;
+                                }
+                                if (!val.starts_with(',')) return false;
+                                val.advance(1);
+                        }
+                }
+
+                ndjson_columns(const ndjson_columns&);
+                ndjson_columns& operator=(const ndjson_columns&);
+
+                std::vector<column> m_columns;
+                std::vector<std::vector<path::step> > m_paths;
+                std::vector<std::vector<size_t> > m_active;     // per depth, the columns whose path matches so far
+                std::vector<uint8_t> m_seen;                    // per column, found in this record
+                size_t m_rows;
+                size_t m_errors;
+                std::string m_error;
+        };
+}
+
+#endif
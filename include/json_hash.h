@@ -0,0 +1,67 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    json_hash.h
+//: \details: A fast non cryptographic 64 bit hash for JSON text and values.
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#ifndef _JSON_HASH_H_
+#define _JSON_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace json
+{
+        /**
+          @brief Spread the bits of h over all 64 bits (the murmur3 finalizer).
+         */
+        inline uint64_t hash_mix(uint64_t h)
+        {
+                h ^= h >> 33;
+                h *= 0xFF51AFD7ED558CCDull;
+                h ^= h >> 33;
+                h *= 0xC4CEB9FE1A85EC53ull;
+                h ^= h >> 33;
+                return h;
+        }
+
+        /**
+          @brief Hash len bytes, 8 at a time with one multiply each. Not for anything an attacker controls the collisions of.
+         */
+        inline uint64_t hash_bytes(const char* p, size_t len, uint64_t seed = 0)
+        {
+                uint64_t h = 0x9E3779B97F4A7C15ull ^ seed ^ (len * 0xC2B2AE3D27D4EB4Full);
+                for (; len >= 8; p += 8, len -= 8)
+                {
+                        uint64_t w;
+                        memcpy(&w, p, 8);
+                        h = (h ^ w) * 0xFF51AFD7ED558CCDull;
+                        h ^= h >> 32;
+                }
+                if (len)
+                {
+                        uint64_t w = 0;
+                        memcpy(&w, p, len);
+                        h = (h ^ w) * 0xFF51AFD7ED558CCDull;
+                }
+                return hash_mix(h);
+        }
+}
+
+#endif
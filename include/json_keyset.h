@@ -0,0 +1,129 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    json_keyset.h
+//: \details: A fixed set of object keys, fetched from an object in one pass.
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#ifndef _JSON_KEYSET_H_
+#define _JSON_KEYSET_H_
+
+#if __cplusplus < 202002L
+#error "json_keyset.h needs C++20 (string literals as template arguments)"
+#endif
+
+#include "json_parser.h"
+#include "perfect_hash.h"
+
+#include <array>
+
+namespace json
+{
+        /**
+          @brief A string literal usable as a template argument, e.g. keyset<"id", "ts">.
+         */
+        template<size_t L>
+        struct key_literal
+        {
+                constexpr key_literal(const char (&s)[L]) :text()
+                {
+                        for (size_t i = 0; i < L; i++) text[i] = s[i];
+                }
+
+                static constexpr size_t length() { return L - 1; }
+
+                char text[L];
+        };
+
+        /**
+          @brief The keys a schema always looks up, with a perfect hash over them built at compile time.
+
+          fetch() walks the members of an object once, hashing each key and dropping it in its
+          slot, instead of one object::find per key. It stops as soon as every key is found.
+          Keys are matched against the key text as it is in the document, the same as
+          object::find, so a key that needs escaping must be declared escaped.
+
+          @code
+                typedef json::keyset<"id", "ts", "user"> event_keys;
+
+                event_keys::values v;
+                event_keys::fetch(doc, v);
+                if (v[event_keys::id<"ts">()]) ...      // NULL when the object has no "ts"
+          @endcode
+         */
+        template<key_literal... K>
+        class keyset
+        {
+        public:
+                static constexpr size_t N = sizeof...(K);
+
+                typedef std::array<const value*, N> values;
+
+                static_assert(N > 0, "keyset needs at least one key");
+
+                static constexpr const char* const s_keys[N] = { K.text... };
+                static constexpr size_t s_lens[N] = { K.length()... };
+                static constexpr perfect_hash<N> s_hash = perfect_hash<N>(s_keys, s_lens);
+
+                /**
+                  @returns The id of key, a compile error if it isn't one of the keys.
+                 */
+                template<key_literal KEY> static constexpr size_t id()
+                {
+                        constexpr int idx = s_hash.find(KEY.text, KEY.length());
+                        static_assert(idx >= 0, "not one of the keyset's keys");
+                        return size_t(idx);
+                }
+
+                /**
+                  @returns The id of key, or -1 if it isn't one of the keys.
+                 */
+                static int find(subbuffer key) { return s_hash.find(key.begin(), key.length()); }
+
+                static constexpr size_t size() { return N; }
+                static constexpr const char* key(size_t id) { return s_keys[id]; }
+
+                /**
+                  @brief Point out[id] at the member for each key, NULL for those obj doesn't have.
+                  @returns The number of keys found, 0 if obj isn't an object.
+                 */
+                static size_t fetch(const value& obj, values& out)
+                {
+                        out.fill(NULL);
+                        if (!obj.is_object()) return 0;
+                        const object& o = *obj.to_object();
+                        size_t found = 0;
+                        for (object::const_iterator iter = o.begin(); iter != o.end(); ++iter)
+                        {
+                                int idx = s_hash.find(iter->first.begin(), iter->first.length());
+                                if (idx < 0 || out[idx]) continue;
+                                out[idx] = &iter->second;
+                                if (++found == N) break;
+                        }
+                        return found;
+                }
+
+                static values fetch(const value& obj)
+                {
+                        values out;
+                        fetch(obj, out);
+                        return out;
+                }
+        };
+}
+
+#endif
@@ -0,0 +1,83 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    json_mapped.h
+//: \details: Parse a JSON file straight from a read only memory mapping.
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#ifndef _JSON_MAPPED_H_
+#define _JSON_MAPPED_H_
+
+#include "json_parser.h"
+#include "mapped_file.h"
+
+namespace json
+{
+        /**
+          @brief Holds the mapping for mapped_root. A base class so it is built before the root parses.
+         */
+        class mapped_source
+        {
+        protected:
+                explicit mapped_source(const char* path) :m_file()
+                {
+                        // the parser reads front to back, let the kernel read ahead
+                        m_file.open(path, MADV_SEQUENTIAL);
+                }
+
+                mapped_file m_file;
+        };
+
+        /**
+          @brief A json::root parsed from a file that is mapped instead of read into the heap.
+
+          Every subbuffer in the document points into the mapping, which lives as long as the
+          root does. Pages are only read in as the parser gets to them and can be dropped by
+          the kernel under memory pressure since they are backed by the file.
+
+          @code
+                json::mapped_root root("big.json");
+                if (root.is_valid())
+                        root["items"][0]["name"].str();
+          @endcode
+
+          @note The file must not be truncated or rewritten in place while the root is alive,
+                replace it with a rename instead.
+         */
+        class mapped_root : private mapped_source, public root
+        {
+        public:
+                explicit mapped_root(const char* path)
+                        : mapped_source(path), root(m_file.contents())
+                {
+                        // done reading front to back, what follows are lookups
+                        if (m_file.size()) m_file.advise(MADV_NORMAL);
+                }
+
+                /**
+                  @brief false if the file could not be opened or mapped (errno says why).
+                 */
+                bool is_open() const { return m_file.is_open(); }
+
+                /**
+                  @brief The mapped text of the file.
+                 */
+                subbuffer text() const { return m_file.contents(); }
+        };
+}
+
+#endif
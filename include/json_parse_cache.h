@@ -0,0 +1,218 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    json_parse_cache.h
+//: \details: A thread safe cache of parsed documents keyed by their text.
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#ifndef _JSON_PARSE_CACHE_H_
+#define _JSON_PARSE_CACHE_H_
+
+#include "json_hash.h"
+#include "json_parser.h"
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace json
+{
+        /**
+          @brief A parsed document that owns a copy of the text it was parsed from.
+         */
+        class cached_document
+        {
+        public:
+                cached_document(subbuffer text, const parse_options& opts, uint64_t hash)
+                        : m_text(text.empty() ? std::string() : std::string(text.begin(), text.length())),
+                          m_root(subbuffer(m_text), opts),
+                          m_hash(hash),
+                          m_bytes(sizeof(*this) + m_text.capacity() + m_root.footprint())
+                {}
+
+                const value& root() const { return m_root; }
+                bool is_valid() const { return m_root.is_valid(); }
+                subbuffer text() const { return subbuffer(m_text); }
+                uint64_t hash() const { return m_hash; }
+
+                /**
+                  @brief What the document is charged against the cache's budget.
+                 */
+                size_t bytes() const { return m_bytes; }
+
+        private:
+                cached_document(const cached_document&);
+                cached_document& operator=(const cached_document&);
+
+                std::string m_text;     // first, m_root points into it
+                json::root m_root;
+                uint64_t m_hash;
+                size_t m_bytes;
+        };
+
+        /**
+          @brief Hands out shared, read only parsed documents for text it has seen before.
+
+          Lookups hash the text (8 bytes at a time) and compare the bytes of any entry with the
+          same hash, so a hit costs about a memcmp of the text instead of a parse. A miss parses
+          without holding the lock and then inserts the document at the front of the LRU list,
+          evicting from the back until the cache is within its budget. Evicted documents stay
+          alive for as long as a caller still holds them.
+
+          Documents are parsed with parse_options::content_hashes set so that content_hash() on a
+          shared document only reads. They are const, do not modify them.
+
+          @code
+                static json::parse_cache cache(256 * 1024 * 1024);
+                json::parse_cache::document doc = cache.get(body);
+                if (doc->is_valid())
+                        doc->root()["route"].str();
+          @endcode
+         */
+        class parse_cache
+        {
+        public:
+                typedef std::shared_ptr<const cached_document> document;
+
+                struct counters
+                {
+                        counters() :hits(0), misses(0), evictions(0), entries(0), bytes(0) {}
+
+                        uint64_t hits;
+                        uint64_t misses;
+                        uint64_t evictions;
+                        uint64_t entries;       //!< in the cache now
+                        uint64_t bytes;         //!< charged to the budget now
+                };
+
+                /**
+                  @param [in] max_bytes The budget, see cached_document::bytes. A document bigger than all of it is parsed but not kept.
+                 */
+                explicit parse_cache(size_t max_bytes, const parse_options& opts = parse_options())
+                        : m_max_bytes(max_bytes), m_opts(opts), m_mutex(), m_lru(), m_index(), m_counters()
+                {
+                        m_opts.content_hashes = true;
+                }
+
+                /**
+                  @brief The parsed document for text, from the cache or parsed (and cached) now.
+                  @details Invalid JSON is cached too, check is_valid() on the result.
+                 */
+                document get(subbuffer text)
+                {
+                        uint64_t h = hash_bytes(text.begin(), text.length());
+                        {
+                                std::lock_guard<std::mutex> lock(m_mutex);
+                                document found = find(h, text);
+                                if (found)
+                                {
+                                        m_counters.hits++;
+                                        return found;
+                                }
+                                m_counters.misses++;
+                        }
+
+                        // parse without the lock, other threads keep getting their hits meanwhile
+                        document doc = std::make_shared<const cached_document>(text, m_opts, h);
+
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        // another thread may have parsed the same text meanwhile, everyone gets the first one
+                        document found = find(h, text);
+                        if (found) return found;
+                        if (doc->bytes() > m_max_bytes) return doc;
+
+                        m_lru.push_front(doc);
+                        m_index.insert(std::make_pair(h, m_lru.begin()));
+                        m_counters.entries++;
+                        m_counters.bytes += doc->bytes();
+                        evict(m_max_bytes);
+                        return doc;
+                }
+
+                counters get_counters() const
+                {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        return m_counters;
+                }
+
+                /**
+                  @brief Drop every document, the counters other than entries and bytes are kept.
+                 */
+                void clear()
+                {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        m_lru.clear();
+                        m_index.clear();
+                        m_counters.entries = 0;
+                        m_counters.bytes = 0;
+                }
+
+        private:
+                typedef std::list<document> lru_list;
+                typedef std::unordered_multimap<uint64_t, lru_list::iterator> index_map;
+
+                parse_cache(const parse_cache&);
+                parse_cache& operator=(const parse_cache&);
+
+                // with the lock held, moves a hit to the front
+                document find(uint64_t h, subbuffer text)
+                {
+                        std::pair<index_map::iterator, index_map::iterator> range = m_index.equal_range(h);
+                        for (index_map::iterator iter = range.first; iter != range.second; ++iter)
+                        {
+                                const document& doc = *iter->second;
+                                if (!doc->text().equals(text)) continue;
+                                m_lru.splice(m_lru.begin(), m_lru, iter->second);
+                                return doc;
+                        }
+                        return document();
+                }
+
+                // with the lock held
+                void evict(size_t max_bytes)
+                {
+                        while (m_counters.bytes > max_bytes && !m_lru.empty())
+                        {
+                                lru_list::iterator last = --m_lru.end();
+                                std::pair<index_map::iterator, index_map::iterator> range = m_index.equal_range((*last)->hash());
+                                for (index_map::iterator iter = range.first; iter != range.second; ++iter)
+                                {
+                                        if (iter->second == last)
+                                        {
+                                                m_index.erase(iter);
+                                                break;
+                                        }
+                                }
+                                m_counters.bytes -= (*last)->bytes();
+                                m_counters.entries--;
+                                m_counters.evictions++;
+                                m_lru.erase(last);
+                        }
+                }
+
+                size_t m_max_bytes;
+                parse_options m_opts;
+                mutable std::mutex m_mutex;
+                lru_list m_lru;
+                index_map m_index;
+                counters m_counters;
+        };
+}
+
+#endif
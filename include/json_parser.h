@@ -24,8 +24,12 @@
 
 #include "aton.h"
 #include "json.h"
+#include "json_hash.h"
+#include "json_scan.h"
 
-#include <map>
+#include <atomic>
+#include <mutex>
+#include <random>
 #include <vector>
 
 
@@ -75,6 +79,175 @@ namespace json
         class root;
         class object;
         class array;
+        class container;
+        class patcher;
+        class snapshot;
+        class path;
+
+        /**
+          @brief What the parser does with a key that is repeated in an OBJECT.
+         */
+        enum duplicate_keys
+        {
+                DUPLICATES_LAST,        //!< the last value wins, at the first one's position
+                DUPLICATES_FIRST,       //!< the first value wins, the later ones are skipped without being parsed
+                DUPLICATES_REJECT,      //!< the text is invalid
+                DUPLICATES_KEEP         //!< every one is a member, find() gives the first, see object::find_all()
+        };
+
+        /**
+          @brief Choices made while parsing, passed to json::root.
+         */
+        struct parse_options
+        {
+                parse_options() :content_hashes(false), packed_numbers(false), duplicates(DUPLICATES_LAST) {}
+
+                bool content_hashes;    //!< compute every OBJECT's and ARRAY's content_hash() while parsing
+                bool packed_numbers;    //!< keep ARRAYs of nothing but numbers as a packed buffer, see value::as_span()
+                duplicate_keys duplicates;    //!< what to do with a repeated key, see duplicate_keys
+        };
+
+        /**
+          @brief Appends bytes that already live in the parsed text.
+          json_iovec references them rather than copying them.
+         */
+        template<typename BUFF> inline void append_raw(BUFF& out, subbuffer sb) { out.append(sb.begin(), sb.length()); }
+        inline void append_raw(json_iovec& out, subbuffer sb) { out.reference(sb.begin(), sb.length()); }
+
+        /**
+          @brief Holds the text of everything added to a parsed document after it was parsed.
+          @details Owned by the root. Parsed values point into the input text, values added by
+                   set/insert/push_back point in here, so nothing that was parsed is ever copied.
+                   Text is handed out of large blocks and only freed when the root goes away.
+         */
+        class storage
+        {
+        public:
+                static const size_t BLOCK_SIZE = 16 * 1024;
+
+                inline storage() :m_blocks(), m_pos(NULL), m_avail(0), m_bytes(0) {}
+                inline ~storage()
+                {
+                        for (size_t i = 0; i < m_blocks.size(); i++)
+                                delete [] m_blocks[i];
+                }
+
+                inline char* alloc(size_t len)
+                {
+                        m_bytes += len;
+                        if (len > m_avail)
+                        {
+                                if (len > BLOCK_SIZE / 4)
+                                {
+                                        // big ones get a block of their own, keep using the current block
+                                        m_blocks.push_back(new char[len]);
+                                        return m_blocks.back();
+                                }
+                                m_blocks.push_back(new char[BLOCK_SIZE]);
+                                m_pos = m_blocks.back();
+                                m_avail = BLOCK_SIZE;
+                        }
+                        char* p = m_pos;
+                        m_pos += len;
+                        m_avail -= len;
+                        return p;
+                }
+
+                inline subbuffer copy(subbuffer src)
+                {
+                        if (src.empty()) return subbuffer("", 0);
+                        char* p = alloc(src.length());
+                        memcpy(p, src.begin(), src.length());
+                        return subbuffer(p, src.length());
+                }
+
+                /**
+                  @brief Copy src in, JSON escaped, the way parsed strings are kept.
+                 */
+                inline subbuffer escape(subbuffer src)
+                {
+                        if (json_object::json_friendly::scan(src.begin(), src.length()) == src.length())
+                                return copy(src);
+                        std::string tmp;
+                        json_object::json_friendly::append(tmp, src);
+                        return copy(tmp);
+                }
+
+                /**
+                  @brief Bytes handed out so far.
+                 */
+                inline size_t bytes() const { return m_bytes; }
+
+        private:
+                storage(const storage&);
+                storage& operator=(const storage&);
+
+                std::vector<char*> m_blocks;
+                char* m_pos;
+                size_t m_avail;
+                size_t m_bytes;
+        };
+
+        /**
+          @brief The packed numbers of an ARRAY, see parse_options::packed_numbers.
+         */
+        template<typename T> class span
+        {
+        public:
+                span() :m_data(NULL), m_size(0) {}
+                span(T* data, size_t size) :m_data(data), m_size(size) {}
+
+                T* data() const { return m_data; }
+                size_t size() const { return m_size; }
+                bool empty() const { return !m_size; }
+                T* begin() const { return m_data; }
+                T* end() const { return m_data + m_size; }
+                T& operator[](size_t i) const { return m_data[i]; }
+
+        private:
+                T* m_data;
+                size_t m_size;
+        };
+
+        /**
+          @returns The seed key hashes use, picked once per process so the collisions can't be planned.
+         */
+        inline uint64_t key_seed()
+        {
+                static const uint64_t seed = hash_mix((uint64_t(std::random_device()()) << 32) | std::random_device()());
+                return seed;
+        }
+
+        inline uint64_t hash_key(subbuffer name) { return hash_bytes(name.begin(), name.length(), key_seed()); }
+
+        /**
+          @brief An OBJECT key with its hash worked out once, for keys that are looked up over and over.
+
+          object::find(const key&) probes the object's hash index without hashing the key again and
+          only compares the bytes of a member whose hash matches, so a miss usually costs one hash
+          compare. Objects of up to object::SCAN_LIMIT members are just scanned.
+
+          @code
+                static const json::key price("price");
+                for (size_t i = 0; i < rows.size(); i++) total += rows[i][price].numb();
+          @endcode
+         */
+        class key
+        {
+        public:
+                /**
+                  @param name The key as it is in the JSON text, escapes and all. Not copied.
+                 */
+                explicit key(subbuffer name) :m_name(name), m_hash(hash_key(name)) {}
+
+                inline subbuffer name() const { return m_name; }
+                inline size_t length() const { return m_name.length(); }
+                inline uint64_t hash() const { return m_hash; }
+
+        private:
+                subbuffer m_name;
+                uint64_t m_hash;
+        };
 
         /**
           @brief The base class. Everything is a value.
@@ -83,9 +256,16 @@ namespace json
         {
                 friend class object;
                 friend class array;
+                friend class container;
+                friend class root;
+                friend class patcher;
+                friend class snapshot;
+                friend class path;
         public:
-                inline value() :m_type(UNSET), m_sval(), m_val() {}
-                inline virtual ~value();
+                inline value() :m_str(NULL), m_len(0), m_type(UNSET), m_val() {}
+                inline value(const value&) = default;
+                inline value& operator=(const value&) = default;
+                inline ~value();
 
 
                 /**
@@ -102,7 +282,17 @@ namespace json
                   @brief Helper method for converting portions of the parsed JSON back into JSON text.
                  */
                 template<typename BUFF> void to_json(BUFF& json_text) const;
+
+                /**
+                  @brief Write this value as JSON text.
+                  @details Subtrees that have not been modified since they were parsed are emitted
+                           by copying their original text (or referencing it when BUFF is a json_iovec).
+                           Only modified OBJECTs and ARRAYs are rebuilt.
+                 */
+                template<typename BUFF> void write(BUFF& out) const;
+
                 inline bool parse(subbuffer& val, int32_t level);
+                inline bool parse(subbuffer& val, int32_t level, const parse_options& opts);
 
                 /**
                   @brief Only valid for STRING and BOOL values.
@@ -110,7 +300,7 @@ namespace json
                  */
                 inline subbuffer str() const
                 {
-                        if (m_type == STRING) return m_sval;
+                        if (m_type == STRING) return sval();
                         if (m_type == BOOL)
                         {
                                 if (m_val.bval) return "true";
@@ -130,10 +320,10 @@ namespace json
                 }
 
                 /**
-                   @brief  Perform limited unescapging of string values into the provided dest buffer
-                   @details THIS FUNCTION IS ONLY PARTIALLY IMPLEMENTED.
-                            We only correctly unescape \", \\ and \/ sequences.  Lots more to be added
-                            http://www.ecma-international.org/publications/files/ECMA-ST/ECMA-404.pdf
+                   @brief  Unescape string values into the provided dest buffer
+                   @details Handles every escape in http://www.ecma-international.org/publications/files/ECMA-ST/ECMA-404.pdf
+                            \uXXXX sequences (including surrogate pairs) are written as UTF-8.
+                            Unknown escapes are replaced by the escaped char.
                    @returns A temporary object representing the destination string with
                  */
                 template <typename BUFF>
@@ -146,14 +336,8 @@ namespace json
                         }
                         else if (m_type == STRING)
                         {
-                                dest.reserve(m_sval.length());
-                                const char* first = m_sval.begin();
-                                const char* last = first + m_sval.length();
-                                while (first != last)
-                                {
-                                        if (*first == '\\')  ++first;
-                                        dest += *first++;
-                                }
+                                dest.reserve(sval().length());
+                                scan::unescape(sval(), dest);
                         }
                         return subbuffer(dest.c_str(), dest.length());
                 }
@@ -197,6 +381,8 @@ namespace json
                  */
                 inline value& operator[] (subbuffer key);
 
+                inline value& operator[] (const key& k);
+
                 /**
                   @brief Accessor for the values in and ARRAY.
                  */
@@ -206,6 +392,7 @@ namespace json
                   @brief Const accessor for the values in an OBJECT.
                  */
                 inline const value& operator[] (subbuffer key) const;
+                inline const value& operator[] (const key& k) const;
 
                 /**
                   @brief Const accessor for the values in and ARRAY.
@@ -213,7 +400,8 @@ namespace json
                 inline const value& operator[] (size_t key) const;
 
                 /**
-                  @brief Check of the existence of a key/value pair in an OBJECT.
+                  @brief Check of the existence of a key/value pair in an OBJECT, key as it is in the document
+                         or unescaped as given to set().
                  */
                 inline bool exists(subbuffer key) const;
 
@@ -222,6 +410,13 @@ namespace json
                  */
                 inline size_t size() const;
 
+                /**
+                  @brief The elements of an ARRAY parsed with parse_options::packed_numbers, without copying them.
+                  @details T is double or int64_t (whole numbers of up to 15 digits are packed as int64_t).
+                           Empty if this isn't an ARRAY packed as T, see array::as_span.
+                 */
+                template<typename T> span<const T> as_span() const;
+
                 inline bool is_string() const { return m_type == STRING; }
                 inline bool is_number() const { return m_type == NUMBER; }
                 inline bool is_bool() const { return m_type == BOOL; }
@@ -231,6 +426,58 @@ namespace json
                 inline val_type get_type() const { return m_type; }
 
                 inline subbuffer raw_subbuffer() const;
+
+                /**
+                  @brief Flag this OBJECT/ARRAY and every container above it as modified so that write()
+                         rebuilds them instead of copying their original text.
+                  @note Leaf values have no container of their own, call mark_modified on the parent.
+                 */
+                inline void mark_modified();
+
+                /**
+                  @brief true if this OBJECT/ARRAY, or anything below it, has been modified.
+                 */
+                inline bool is_modified() const;
+
+                /**
+                  @brief A hash of the value's content, the same for values that equals() would call equal.
+                  @details Numbers are hashed by value, strings by their unescaped text and the members of
+                           an OBJECT in no particular order, so the formatting of the text does not matter.
+                           OBJECTs and ARRAYs keep their hash (parse_options::content_hashes computes them
+                           while parsing) until they are modified.
+                 */
+                inline uint64_t content_hash() const;
+
+                /**
+                  @brief Same type and content: numbers compared by value, strings unescaped, members in any order.
+                  @details Returns false straight away when both sides already have different content hashes,
+                           and true straight away for unmodified containers parsed from the same text.
+                 */
+                inline bool equals(const value& rhs) const;
+
+                /**
+                  @brief Roughly the heap bytes used by this value's OBJECTs and ARRAYs, not counting the text.
+                 */
+                inline size_t footprint() const;
+
+                /**
+                  @name Modifying a parsed document
+                  Keys and strings are given unescaped and are escaped into the root's storage,
+                  numbers are formatted into it. A value from anywhere (even another root) is deep copied.
+                  Passing a val_type adds an empty value of that type, e.g. set("list", json::ARRAY).
+                  Every change marks the containers above it modified so write() rebuilds only those.
+                  @returns The added value, or an unset value if this isn't an OBJECT (set by key)
+                           or an ARRAY (the rest) or the document has no root.
+                 */
+                //@{
+                template<typename T> value& set(subbuffer key, const T& val);
+                inline bool erase(subbuffer key);
+
+                template<typename T> value& set(size_t idx, const T& val);
+                template<typename T> value& push_back(const T& val);
+                template<typename T> value& insert(size_t idx, const T& val);
+                inline bool erase(size_t idx);
+                //@}
         protected:
                 /**
                   @brief Reset the member variables to a pristine state.
@@ -238,8 +485,10 @@ namespace json
                 inline void clear();
 
         private:
+                // 24 bytes: no vtable, and the text is a pointer and a 32 bit length instead of a subbuffer
+                const char* m_str;      //!< the text of a STRING (still escaped) or NUMBER
+                uint32_t m_len;
                 val_type m_type;
-                subbuffer m_sval;
                 union
                 {
                         double dval;
@@ -247,43 +496,218 @@ namespace json
                         object* oval;
                         array*  aval;
                 } m_val;
+
+                inline container* get_container() const;
+
+                inline subbuffer sval() const { return subbuffer(m_str, m_len); }
+                inline void set_sval(subbuffer text)
+                {
+                        m_str = text.begin();
+                        m_len = uint32_t(text.length());
+                }
+
+                // the hash of the unescaped text, without unescaping when there is nothing to unescape
+                static inline uint64_t hash_string(subbuffer escaped);
+                static inline uint64_t hash_seed(val_type type) { return (type + 1) * 0x9E3779B97F4A7C15ull; }
+                static inline uint64_t hash_number(double d)
+                {
+                        // -0.0 == 0.0 so they have to hash the same
+                        if (d == 0.0) d = 0.0;
+                        uint64_t bits;
+                        memcpy(&bits, &d, sizeof(bits));
+                        return hash_mix(bits ^ hash_seed(NUMBER));
+                }
+
+                // build a value for the mutation calls, text goes into st
+                static inline value make(storage& st, subbuffer val);
+                static inline value make(storage& st, const char* val) { return make(st, subbuffer(val)); }
+                static inline value make(storage& st, double val);
+                static inline value make(storage& st, int32_t val) { return make_integer(st, int64_t(val)); }
+                static inline value make(storage& st, uint32_t val) { return make_integer(st, uint64_t(val)); }
+                static inline value make(storage& st, int64_t val) { return make_integer(st, val); }
+                static inline value make(storage& st, uint64_t val) { return make_integer(st, val); }
+                static inline value make(storage& st, bool val);
+                static inline value make(storage& st, val_type type);
+                static inline value make(storage& st, const value& src);
+                template<typename NUMB> static value make_integer(storage& st, NUMB val);
         };
 
-        static value s_unset;
+        /**
+          @brief What the const lookups return for a missing key or index.
+          @details const, so nothing can be written through it, and initialized once (thread safe),
+                   so any number of threads can share it and the document they look things up in.
+         */
+        inline const value& unset_value()
+        {
+                static const value s_unset;
+                return s_unset;
+        }
+
+        /**
+          @brief What the non-const lookups and the mutation calls return when there is nothing to return.
+          @details They hand out a value&, so this is one value per thread, reset to UNSET every time
+                   it is handed out. Writing through one can't show up in the next lookup or in another thread.
+         */
+        inline value& scratch_unset()
+        {
+                static thread_local value s_scratch;
+                s_scratch = value();
+                return s_scratch;
+        }
+
+        /**
+          @brief Bookkeeping shared by OBJECTs and ARRAYs.
+          @details Every container knows the container it lives in so a modification can be
+                   propagated up to the root. A container that is not modified (and nothing below it
+                   is modified) can be written by copying its raw_subbuffer().
+         */
+        class container
+        {
+                friend class value;
+                friend class root;
+                friend class patcher;
+                friend class snapshot;
+        public:
+                inline container() :m_hash(0), m_parent(NULL), m_modified(false), m_storage(NULL) {}
+
+                inline bool is_modified() const { return m_modified; }
+
+                inline void mark_modified()
+                {
+                        // once a container is marked (and has no hash), everything above it is already marked
+                        // (and has no hash either, a hash is only kept when the hashes below it are)
+                        for (container* c = this; c && (!c->m_modified || c->m_hash); c = c->m_parent)
+                        {
+                                c->m_modified = true;
+                                c->m_hash = 0;
+                        }
+                }
+
+        protected:
+                uint64_t m_hash;        //!< content hash, 0 until computed
+
+                /**
+                  @brief Make this container the parent of v, if v is an OBJECT or ARRAY.
+                 */
+                inline void adopt(const value& v)
+                {
+                        container* c = v.get_container();
+                        if (c) c->m_parent = this;
+                }
+
+                /**
+                  @brief The storage of the root this container belongs to, NULL if there is none.
+                 */
+                inline storage* get_storage() const
+                {
+                        const container* c = this;
+                        while (c->m_parent) c = c->m_parent;
+                        return c->m_storage;
+                }
+
+        private:
+                container(const container&);
+                container& operator=(const container&);
+
+                container* m_parent;
+                bool m_modified;
+                storage* m_storage;     //!< only set on the top container, by the root
+        };
 
         /**
           @brief Represents a set of key/value pairs parsed from JSON text.
+
+          The members are kept in the order they are in the text (new ones go on the end), so
+          iterating is a walk down a vector and write() reproduces the input order. Small objects
+          are searched linearly, bigger ones through a hash index over the keys.
          */
-        class object
+        class object : public container
         {
                 friend class value;
+                friend class patcher;
+                friend class snapshot;
+                friend class path;
         public:
-                inline object() :m_vals(), m_unset(), m_sval() {}
-                inline ~object() {}
+                typedef std::pair<subbuffer, value> member;
+                typedef std::vector<member>::iterator iterator;
+                typedef std::vector<member>::const_iterator const_iterator;
+
+                //! Objects with more members than this are searched through the hash index.
+                static const size_t SCAN_LIMIT = 8;
+                static const size_t npos = size_t(-1);
+
+                inline object() :container(), m_vals(), m_sval(), m_index(NULL) {}
+                inline ~object() { delete m_index.load(std::memory_order_relaxed); }
 
                 /**
-                  @brief Check of the existence of a key/value pair.
+                  @brief Check of the existence of a key/value pair, key as it is in the document or unescaped as given to set().
                  */
-                inline bool exists(subbuffer key) const { return m_vals.count(key); }
+                inline bool exists(subbuffer key) const
+                {
+                        if (position(key) != npos) return true;
+                        return json_object::json_friendly::scan(key.begin(), key.length()) != key.length() && unescaped_position(key) != npos;
+                }
 
                 /**
                   @brief An invalid call for OBJECT values.
                  */
-                inline const value& operator[] (size_t /*key*/) const { return s_unset; }
+                inline const value& operator[] (size_t /*key*/) const { return unset_value(); }
 
                 /**
                   @brief Find the value associated with the provided key. Remember to check "is_unset()" on the returned value.
                   @returns The value if found or an unset value if not found.
                  */
-                inline const value& operator[] (subbuffer key)
+                inline const value& operator[] (subbuffer key) const
                 {
-                        std::map<subbuffer, value>::iterator iter = m_vals.find(key);
-                        if (iter == m_vals.end())
+                        const value* v = find(key);
+                        if (!v)
                         {
                                 JSON_TRACE("failed to find value for key: '%.*s'\n", (int)key.length(), key.begin());
-                                return m_unset;
+                                return unset_value();
+                        }
+                        return *v;
+                }
+
+                /**
+                  @returns The value for key, NULL if there is none.
+                 */
+                inline const value* find(subbuffer key) const
+                {
+                        size_t pos = position(key);
+                        return pos == npos ? NULL : &m_vals[pos].second;
+                }
+                inline value* find(subbuffer key)
+                {
+                        return const_cast<value*>(static_cast<const object*>(this)->find(key));
+                }
+
+                /**
+                  @returns The value for k, NULL if there is none. Safe from several readers at once.
+                 */
+                inline const value* find(const key& k) const
+                {
+                        size_t pos = m_vals.size() <= SCAN_LIMIT ? scan(k.name()) : index()->find(m_vals, k.name(), k.hash());
+                        return pos == npos ? NULL : &m_vals[pos].second;
+                }
+                inline value* find(const key& k)
+                {
+                        return const_cast<value*>(static_cast<const object*>(this)->find(k));
+                }
+
+                /**
+                  @brief Every value for key, in document order. Only parsing with DUPLICATES_KEEP leaves more than one.
+                  @returns The number added to out.
+                 */
+                inline size_t find_all(subbuffer key, std::vector<const value*>& out) const
+                {
+                        size_t n = 0;
+                        for (const_iterator iter = m_vals.begin(); iter != m_vals.end(); ++iter)
+                        {
+                                if (!iter->first.equals(key)) continue;
+                                out.push_back(&iter->second);
+                                n++;
                         }
-                        return iter->second;
+                        return n;
                 }
 
                 /**
@@ -292,7 +716,7 @@ namespace json
                 inline void to_json(json_object& obj)
                 {
                         json_object subobj;
-                        for (std::map<subbuffer, value>::iterator iter = m_vals.begin();
+                        for (iterator iter = m_vals.begin();
                              iter != m_vals.end();
                              ++iter)
                         {
@@ -300,7 +724,7 @@ namespace json
                         }
                 }
 
-                inline bool parse(subbuffer& val, int32_t level)
+                inline bool parse(subbuffer& val, int32_t level, const parse_options& opts)
                 {
                         if (!val.starts_with('{'))
                         {
@@ -350,13 +774,45 @@ namespace json
                                         val.trim(spacecomma);
                                         continue;
                                 }
+                                size_t dup = opts.duplicates == DUPLICATES_KEEP ? npos : parsed_member(key);
+                                if (dup != npos && opts.duplicates != DUPLICATES_LAST)
+                                {
+                                        if (opts.duplicates == DUPLICATES_REJECT)
+                                        {
+                                                JSON_WARNING("object::parse, duplicate key '%.*s'\n", SUBBUF_FORMAT(key));
+                                                return false;
+                                        }
+                                        // DUPLICATES_FIRST, the value is only skipped over
+                                        if (!scan::skip_value(val))
+                                        {
+                                                JSON_WARNING("object::parse, failed to skip '%.*s'\n", SUBBUF_FORMAT(val.sub(0, 100)));
+                                                return false;
+                                        }
+                                        val.ltrim(space);
+                                        if (!val.starts_with(',') && !val.starts_with('}'))
+                                        {
+                                                JSON_WARNING("object::parse, invalid JSON, missing comma (,) or right brace (}), val: '%.*s'\n",
+                                                             SUBBUF_FORMAT(m_sval));
+                                                return false;
+                                        }
+                                        val.ltrim(spacecomma);
+                                        continue;
+                                }
                                 value v;
-                                if (!v.parse(val, level))
+                                if (!v.parse(val, level, opts))
                                 {
                                         JSON_WARNING("object::parse, v failed to parse '%.*s'\n", SUBBUF_FORMAT(val.sub(0, 100)));
                                         return false;
                                 }
-                                m_vals[key] = v;
+                                if (dup == npos)
+                                        m_vals.push_back(member(key, v));
+                                else
+                                {
+                                        // DUPLICATES_LAST, the first position with the last value
+                                        m_vals[dup].second.clear();
+                                        m_vals[dup].second = v;
+                                }
+                                adopt(v);
                                 val.ltrim(space);
                                 if (!val.starts_with(',') && !val.starts_with('}'))
                                 {
@@ -369,112 +825,551 @@ namespace json
                         if (val.starts_with('}')) val.advance(1);
                         // resize m_sval
                         m_sval.remove_from(m_sval.length() - val.length());
+                        // every member is parsed (and hashed) by now, so this is one pass over the members
+                        if (opts.content_hashes) m_hash = hash_contents();
                         return true;
                 }
 
+                /**
+                  @brief Order independent: a sum over the members of a mix of the key and value hashes.
+                 */
+                inline uint64_t hash_contents() const
+                {
+                        uint64_t h = value::hash_seed(OBJECT) + m_vals.size();
+                        for (const_iterator iter = m_vals.begin(); iter != m_vals.end(); ++iter)
+                        {
+                                uint64_t vh = iter->second.content_hash();
+                                h += hash_mix(value::hash_string(iter->first) ^ ((vh << 1) | (vh >> 63)));
+                        }
+                        h = hash_mix(h);
+                        return h ? h : 1;
+                }
+
 
                 inline subbuffer raw_subbuffer() const { return m_sval; }
 
-                inline std::map<subbuffer, value>::iterator begin() { return m_vals.begin(); }
-                inline std::map<subbuffer, value>::iterator end() { return m_vals.end(); }
-
-        private:
-                inline void clear()
+                template<typename BUFF> void write(BUFF& out) const
                 {
-                        for (std::map<subbuffer, value>::iterator iter = m_vals.begin();
+                        if (!is_modified() && m_sval.is_set())
+                        {
+                                append_raw(out, m_sval);
+                                return;
+                        }
+                        out += '{';
+                        for (const_iterator iter = m_vals.begin();
                              iter != m_vals.end();
                              ++iter)
                         {
-                                iter->second.clear();
+                                if (iter != m_vals.begin()) out += ',';
+                                out += '\"';
+                                append_raw(out, iter->first);
+                                out += '\"';
+                                out += ':';
+                                iter->second.write(out);
                         }
-                        m_vals.clear();
+                        out += '}';
                 }
 
-                std::map<subbuffer, value> m_vals;
-                value m_unset;
-                subbuffer m_sval;
-        };
-
-        class array
-        {
-                friend class value;
-                friend class object;
-        public:
-                inline array():m_vals(), m_sval() {}
-                inline ~array() {}
-
-
+                /**
+                  @brief The members in document order.
+                 */
+                inline iterator begin() { return m_vals.begin(); }
+                inline iterator end() { return m_vals.end(); }
+                inline const_iterator begin() const { return m_vals.begin(); }
+                inline const_iterator end() const { return m_vals.end(); }
                 inline size_t size() const { return m_vals.size(); }
 
-                inline void to_json(json_array& arr)
+                /**
+                  @brief Add key, or replace its value. See value::set.
+                 */
+                template<typename T> value& set(subbuffer key, const T& val)
                 {
-                        for (std::vector<value>::iterator iter = m_vals.begin();
-                             iter != m_vals.end();
-                             ++iter)
+                        storage* st = get_storage();
+                        if (!st) return scratch_unset();
+                        subbuffer esc = key;
+                        if (json_object::json_friendly::scan(key.begin(), key.length()) != key.length())
+                                esc = st->escape(key);
+                        // val may be inside the value being replaced, or a member that push_back would move,
+                        // so it is copied before either happens
+                        value tmp = value::make(*st, val);
+                        size_t pos = position(esc);
+                        value* found;
+                        if (pos == npos)
                         {
-                                iter->to_json(arr);
+                                m_vals.push_back(member(st->copy(esc), tmp));
+                                found = &m_vals.back().second;
+                                drop_index();
                         }
+                        else
+                        {
+                                found = &m_vals[pos].second;
+                                found->clear();
+                                *found = tmp;
+                        }
+                        adopt(*found);
+                        mark_modified();
+                        return *found;
                 }
 
-                inline bool parse(subbuffer& val, int32_t level)
+                inline bool erase(subbuffer key)
                 {
-                        if (!val.starts_with('['))
+                        size_t pos = unescaped_position(key);
+                        if (pos == npos) return false;
+                        iterator iter = m_vals.begin() + pos;
+                        iter->second.clear();
+                        m_vals.erase(iter);
+                        drop_index();
+                        mark_modified();
+                        return true;
+                }
+
+        private:
+                // the position of key given unescaped, as set() and erase() take it
+                inline size_t unescaped_position(subbuffer key) const
+                {
+                        if (json_object::json_friendly::scan(key.begin(), key.length()) == key.length()) return position(key);
+                        std::string esc;
+                        json_object::json_friendly::append(esc, key);
+                        return position(subbuffer(esc));
+                }
+
+                // open addressing, at most half full, pos is npos in an empty slot
+                struct key_index
+                {
+                        struct slot
                         {
-                                JSON_ERROR("array::parse, does not start with '['\n");
-                                return false;
-                        }
+                                uint64_t hash;
+                                size_t pos;     //!< of the member in m_vals
+                        };
 
-                        if (JSON_MAX_PARSE_RECURSION < ++level)
+                        key_index() :slots(), count(0) {}
+
+                        inline size_t find(const std::vector<member>& vals, subbuffer name, uint64_t h) const
                         {
-                                JSON_ERROR("object::parse, too many levels of recursion (%d)\n", level);
-                                return false;
+                                size_t mask = slots.size() - 1;
+                                for (size_t s = h & mask; slots[s].pos != npos; s = (s + 1) & mask)
+                                        if (slots[s].hash == h && vals[slots[s].pos].first.equals(name)) return slots[s].pos;
+                                return npos;
                         }
 
-                        m_sval = val;
-
-                        val.advance(1).ltrim(space);
+                        inline void insert(uint64_t h, size_t pos)
+                        {
+                                if ((count + 1) * 2 > slots.size()) grow((count + 1) * 2);
+                                size_t mask = slots.size() - 1;
+                                size_t s = h & mask;
+                                while (slots[s].pos != npos) s = (s + 1) & mask;
+                                slots[s].hash = h;
+                                slots[s].pos = pos;
+                                count++;
+                        }
 
-                        while (!val.empty() && !val.starts_with(']'))
+                        inline void grow(size_t want)
                         {
-                                value v;
-                                if (!v.parse(val, level)) return false;
-                                m_vals.push_back(v);
-                                if (m_vals.size() > 10000000)
-                                {
-                                        JSON_ERROR("m_vals.size > 10 million, should not be here\n");
-                                        JSON_ERROR("orig val: %.*s\n", SUBBUF_FORMAT(m_sval.sub(0, 1000)));
-                                        JSON_ERROR("val: %.*s\n", SUBBUF_FORMAT(val.sub(0, 100)));
-                                        exit(0);
-                                }
-                                val.ltrim(spacecomma);
+                                size_t n = 16;
+                                while (n < want) n <<= 1;
+                                std::vector<slot> old;
+                                old.swap(slots);
+                                slot empty = { 0, npos };
+                                slots.assign(n, empty);
+                                count = 0;
+                                for (size_t i = 0; i < old.size(); i++)
+                                        if (old[i].pos != npos) insert(old[i].hash, old[i].pos);
                         }
-                        if (val.starts_with(']')) val.advance(1);
-                        // trim m_sval down to just the array data
-                        m_sval.remove_from(m_sval.length() - val.length());
-                        return true;
+
+                        std::vector<slot> slots;
+                        size_t count;
+                };
+
+                inline size_t scan(subbuffer name) const
+                {
+                        for (size_t i = 0; i < m_vals.size(); i++)
+                                if (m_vals[i].first.equals(name)) return i;
+                        return npos;
                 }
 
-                inline value& operator[] (subbuffer /*key*/) const { return s_unset; }
-                inline value& operator[] (size_t key)
+                inline size_t position(subbuffer name) const
                 {
-                        if (m_vals.size() <= key) return s_unset;
-                        return m_vals[key];
+                        return m_vals.size() <= SCAN_LIMIT ? scan(name) : index()->find(m_vals, name, hash_key(name));
                 }
 
-                inline subbuffer raw_subbuffer() const { return m_sval; }
-        private:
-                inline void clear()
+                /**
+                  @brief The hash index over the keys, built by whichever reader needs it first.
+                 */
+                inline const key_index* index() const
                 {
-                        for (std::vector<value>::iterator iter = m_vals.begin();
-                             iter != m_vals.end();
+                        key_index* idx = m_index.load(std::memory_order_acquire);
+                        if (idx) return idx;
+
+                        key_index* built = new key_index;
+                        built->grow(m_vals.size() * 2);
+                        for (size_t i = 0; i < m_vals.size(); i++)
+                                built->insert(hash_key(m_vals[i].first), i);
+                        // another reader may have got there first, keep theirs
+                        if (m_index.compare_exchange_strong(idx, built, std::memory_order_acq_rel, std::memory_order_acquire))
+                                return built;
+                        delete built;
+                        return idx;
+                }
+
+                /**
+                  @brief While parsing, the position of the member already parsed for key, npos if there is none.
+                  @details Past SCAN_LIMIT members the index is built as they are parsed, so a wide object
+                           (or one key repeated thousands of times) costs one hash and probe per member.
+                 */
+                inline size_t parsed_member(subbuffer key)
+                {
+                        if (m_vals.size() < SCAN_LIMIT) return scan(key);
+                        key_index* idx = m_index.load(std::memory_order_relaxed);
+                        if (!idx)
+                        {
+                                idx = new key_index;
+                                for (size_t i = 0; i < m_vals.size(); i++)
+                                        idx->insert(hash_key(m_vals[i].first), i);
+                                m_index.store(idx, std::memory_order_relaxed);
+                        }
+                        uint64_t h = hash_key(key);
+                        size_t pos = idx->find(m_vals, key, h);
+                        // parse adds the member at the end next
+                        if (pos == npos) idx->insert(h, m_vals.size());
+                        return pos;
+                }
+
+                /**
+                  @brief Members were added or removed, the index is rebuilt on the next lookup that needs it.
+                 */
+                inline void drop_index()
+                {
+                        delete m_index.exchange(NULL, std::memory_order_relaxed);
+                }
+
+                inline void clear()
+                {
+                        for (iterator iter = m_vals.begin();
+                             iter != m_vals.end();
+                             ++iter)
+                        {
+                                iter->second.clear();
+                        }
+                        m_vals.clear();
+                        drop_index();
+                }
+
+                std::vector<member> m_vals;
+                subbuffer m_sval;
+                mutable std::atomic<key_index*> m_index;
+        };
+
+        class array : public container
+        {
+                friend class value;
+                friend class object;
+                friend class patcher;
+                friend class snapshot;
+                friend class path;
+        public:
+                inline array():container(), m_doubles(), m_ints(), m_packing(PACKED_NONE), m_unpacked(), m_vals(), m_sval() {}
+                inline ~array() {}
+
+
+                inline size_t size() const
+                {
+                        switch (m_packing)
+                        {
+                        case PACKED_DOUBLE: return m_doubles.size();
+                        case PACKED_INT64: return m_ints.size();
+                        default: return m_vals.size();
+                        }
+                }
+
+                inline void to_json(json_array& arr)
+                {
+                        std::vector<value>& vals = unpacked();
+                        for (std::vector<value>::iterator iter = vals.begin();
+                             iter != vals.end();
+                             ++iter)
+                        {
+                                iter->to_json(arr);
+                        }
+                }
+
+                inline bool parse(subbuffer& val, int32_t level, const parse_options& opts)
+                {
+                        if (!val.starts_with('['))
+                        {
+                                JSON_ERROR("array::parse, does not start with '['\n");
+                                return false;
+                        }
+
+                        if (JSON_MAX_PARSE_RECURSION < ++level)
+                        {
+                                JSON_ERROR("object::parse, too many levels of recursion (%d)\n", level);
+                                return false;
+                        }
+
+                        m_sval = val;
+
+                        val.advance(1).ltrim(space);
+
+                        if (!opts.packed_numbers || !parse_packed(val, level))
+                        {
+                                while (!val.empty() && !val.starts_with(']'))
+                                {
+                                        value v;
+                                        if (!v.parse(val, level, opts)) return false;
+                                        m_vals.push_back(v);
+                                        adopt(v);
+                                        if (m_vals.size() > 10000000)
+                                        {
+                                                JSON_ERROR("m_vals.size > 10 million, should not be here\n");
+                                                JSON_ERROR("orig val: %.*s\n", SUBBUF_FORMAT(m_sval.sub(0, 1000)));
+                                                JSON_ERROR("val: %.*s\n", SUBBUF_FORMAT(val.sub(0, 100)));
+                                                exit(0);
+                                        }
+                                        val.ltrim(spacecomma);
+                                }
+                        }
+                        if (val.starts_with(']')) val.advance(1);
+                        // trim m_sval down to just the array data
+                        m_sval.remove_from(m_sval.length() - val.length());
+                        if (opts.content_hashes) m_hash = hash_contents();
+                        return true;
+                }
+
+                inline uint64_t hash_contents() const
+                {
+                        uint64_t h = hash_mix(value::hash_seed(ARRAY) + size());
+                        if (m_packing == PACKED_DOUBLE)
+                        {
+                                for (size_t i = 0; i < m_doubles.size(); i++)
+                                        h = hash_mix(h + value::hash_number(m_doubles[i]));
+                        }
+                        else if (m_packing == PACKED_INT64)
+                        {
+                                for (size_t i = 0; i < m_ints.size(); i++)
+                                        h = hash_mix(h + value::hash_number(double(m_ints[i])));
+                        }
+                        else
+                        {
+                                for (std::vector<value>::const_iterator iter = m_vals.begin(); iter != m_vals.end(); ++iter)
+                                        h = hash_mix(h + iter->content_hash());
+                        }
+                        return h ? h : 1;
+                }
+
+                inline const value& operator[] (subbuffer /*key*/) const { return unset_value(); }
+                inline const value& operator[] (size_t key) const
+                {
+                        if (size() <= key) return unset_value();
+                        return values()[key];
+                }
+                inline value& operator[] (size_t key)
+                {
+                        if (size() <= key) return scratch_unset();
+                        return unpacked()[key];
+                }
+
+                inline subbuffer raw_subbuffer() const { return m_sval; }
+
+                /**
+                  @brief true while the elements are kept as a packed buffer, see as_span().
+                 */
+                inline bool is_packed() const { return m_packing != PACKED_NONE; }
+
+                /**
+                  @brief The elements of a packed ARRAY, as T, without copying them.
+                  @details T is double or int64_t. Arrays of whole numbers (of up to 15 digits) are packed as
+                           int64_t and the others as double. Empty if the array is not packed as T.
+                 */
+                template<typename T> span<const T> as_span() const
+                {
+                        const T* p = NULL;
+                        size_t n = packed(p);
+                        return span<const T>(p, n);
+                }
+
+                /**
+                  @brief The elements as values.
+                  @details For a packed array they are parsed from its text the first time they are asked
+                           for (once, even with several threads reading), and the packed buffer stays too.
+                 */
+                inline const std::vector<value>& values() const { return unpacked(); }
+
+                /**
+                  @brief The elements as values, to be changed: a packed array stops being packed.
+                 */
+                inline std::vector<value>& values()
+                {
+                        if (m_packing != PACKED_NONE)
+                        {
+                                unpacked();
+                                std::vector<double>().swap(m_doubles);
+                                std::vector<int64_t>().swap(m_ints);
+                                m_packing = PACKED_NONE;
+                        }
+                        return m_vals;
+                }
+
+                /**
+                  @brief See value::set etc.
+                 */
+                template<typename T> value& set(size_t idx, const T& val)
+                {
+                        storage* st = get_storage();
+                        std::vector<value>& vals = values();
+                        if (!st || idx >= vals.size()) return scratch_unset();
+                        // val may be inside the value being replaced, copy it before clearing that
+                        value tmp = value::make(*st, val);
+                        vals[idx].clear();
+                        vals[idx] = tmp;
+                        adopt(vals[idx]);
+                        mark_modified();
+                        return vals[idx];
+                }
+
+                template<typename T> value& insert(size_t idx, const T& val)
+                {
+                        storage* st = get_storage();
+                        std::vector<value>& vals = values();
+                        if (!st || idx > vals.size()) return scratch_unset();
+                        std::vector<value>::iterator iter = vals.insert(vals.begin() + idx, value::make(*st, val));
+                        adopt(*iter);
+                        mark_modified();
+                        return *iter;
+                }
+
+                template<typename T> value& push_back(const T& val) { return insert(size(), val); }
+
+                inline bool erase(size_t idx)
+                {
+                        std::vector<value>& vals = values();
+                        if (idx >= vals.size()) return false;
+                        vals[idx].clear();
+                        vals.erase(vals.begin() + idx);
+                        mark_modified();
+                        return true;
+                }
+
+                template<typename BUFF> void write(BUFF& out) const
+                {
+                        if (!is_modified() && m_sval.is_set())
+                        {
+                                append_raw(out, m_sval);
+                                return;
+                        }
+                        out += '[';
+                        const std::vector<value>& vals = values();
+                        for (std::vector<value>::const_iterator iter = vals.begin();
+                             iter != vals.end();
+                             ++iter)
+                        {
+                                if (iter != vals.begin()) out += ',';
+                                iter->write(out);
+                        }
+                        out += ']';
+                }
+        private:
+                enum packing { PACKED_NONE, PACKED_DOUBLE, PACKED_INT64 };
+
+                inline void clear()
+                {
+                        for (std::vector<value>::iterator iter = m_vals.begin();
+                             iter != m_vals.end();
                              ++iter)
                         {
                                 (*iter).clear();
                         }
                         m_vals.clear();
+                        m_doubles.clear();
+                        m_ints.clear();
+                }
+
+                inline size_t packed(const double*& p) const
+                {
+                        if (m_packing != PACKED_DOUBLE) return 0;
+                        p = m_doubles.data();
+                        return m_doubles.size();
+                }
+
+                inline size_t packed(const int64_t*& p) const
+                {
+                        if (m_packing != PACKED_INT64) return 0;
+                        p = m_ints.data();
+                        return m_ints.size();
+                }
+
+                /**
+                  @brief Parse the elements into a packed buffer if every one of them is a number.
+                  @returns false, leaving val alone, if they aren't (or there are none).
+                 */
+                inline bool parse_packed(subbuffer& val, int32_t level)
+                {
+                        subbuffer rest = val;
+                        std::vector<double> numbs;
+                        bool whole = true;
+                        while (!rest.empty() && !rest.starts_with(']'))
+                        {
+                                rest.ltrim(spacecommacolon);
+                                if (rest.empty() || !(isdigit(rest.at(0)) || rest.at(0) == '-')) return false;
+                                value v;
+                                if (!v.parse(rest, level) || v.m_type != NUMBER) return false;
+                                numbs.push_back(v.m_val.dval);
+                                // up to 15 digits are exact as a double
+                                if (whole)
+                                {
+                                        subbuffer digits = v.sval();
+                                        if (digits.starts_with('-')) digits.advance(1);
+                                        whole = !digits.empty() && digits.length() <= 15;
+                                        for (size_t i = 0; whole && i < digits.length(); i++)
+                                                whole = digits[i] >= '0' && digits[i] <= '9';
+                                }
+                                rest.ltrim(spacecomma);
+                        }
+                        if (numbs.empty()) return false;
+
+                        if (whole)
+                        {
+                                m_ints.reserve(numbs.size());
+                                for (size_t i = 0; i < numbs.size(); i++)
+                                        m_ints.push_back(int64_t(numbs[i]));
+                                m_packing = PACKED_INT64;
+                        }
+                        else
+                        {
+                                numbs.shrink_to_fit();
+                                m_doubles.swap(numbs);
+                                m_packing = PACKED_DOUBLE;
+                        }
+                        val = rest;
+                        return true;
+                }
+
+                inline std::vector<value>& unpacked() const
+                {
+                        if (m_packing != PACKED_NONE)
+                                std::call_once(m_unpacked, &array::unpack, this);
+                        return m_vals;
+                }
+
+                // parse the values of a packed array from its text, through unpacked()
+                inline void unpack() const
+                {
+                        subbuffer rest = m_sval;
+                        rest.advance(1).ltrim(space);
+                        m_vals.reserve(size());
+                        while (!rest.empty() && !rest.starts_with(']'))
+                        {
+                                value v;
+                                if (!v.parse(rest, 0)) break;
+                                m_vals.push_back(v);
+                                rest.ltrim(spacecomma);
+                        }
                 }
 
-                std::vector<value> m_vals;
+                std::vector<double> m_doubles;
+                std::vector<int64_t> m_ints;
+                packing m_packing;
+                mutable std::once_flag m_unpacked;
+                mutable std::vector<value> m_vals;      // filled in by a const values() when packed
                 subbuffer m_sval;
         };
 
@@ -484,6 +1379,12 @@ namespace json
                 return 0;
         }
 
+        template<typename T> span<const T> value::as_span() const
+        {
+                if (m_type != ARRAY) return span<const T>();
+                return m_val.aval->as_span<T>();
+        }
+
         subbuffer value::raw_subbuffer() const
         {
                 switch (m_type)
@@ -493,29 +1394,173 @@ namespace json
                 case ARRAY:
                         return m_val.aval->raw_subbuffer();
                 default:
-                        return m_sval;
+                        return sval();
+                }
+        }
+
+        container* value::get_container() const
+        {
+                if (m_type == OBJECT) return m_val.oval;
+                if (m_type == ARRAY) return m_val.aval;
+                return NULL;
+        }
+
+        void value::mark_modified()
+        {
+                container* c = get_container();
+                if (c) c->mark_modified();
+        }
+
+        bool value::is_modified() const
+        {
+                container* c = get_container();
+                return c && c->is_modified();
+        }
+
+        uint64_t value::hash_string(subbuffer escaped)
+        {
+                if (!memchr(escaped.begin(), '\\', escaped.length()))
+                        return hash_bytes(escaped.begin(), escaped.length(), hash_seed(STRING));
+                std::string plain;
+                scan::unescape(escaped, plain);
+                return hash_bytes(plain.data(), plain.length(), hash_seed(STRING));
+        }
+
+        uint64_t value::content_hash() const
+        {
+                switch (m_type)
+                {
+                case NUMBER:
+                        return hash_number(m_val.dval);
+                case STRING:
+                        return hash_string(sval());
+                case BOOL:
+                        return hash_mix(hash_seed(BOOL) + m_val.bval);
+                case OBJECT:
+                        if (!m_val.oval->m_hash) m_val.oval->m_hash = m_val.oval->hash_contents();
+                        return m_val.oval->m_hash;
+                case ARRAY:
+                        if (!m_val.aval->m_hash) m_val.aval->m_hash = m_val.aval->hash_contents();
+                        return m_val.aval->m_hash;
+                default:
+                        return hash_mix(hash_seed(UNSET));
+                }
+        }
+
+        size_t value::footprint() const
+        {
+                size_t n = 0;
+                if (m_type == OBJECT)
+                {
+                        const object* o = m_val.oval;
+                        n = sizeof(object) + o->m_vals.capacity() * sizeof(object::member);
+                        const object::key_index* idx = o->m_index.load(std::memory_order_relaxed);
+                        if (idx) n += sizeof(*idx) + idx->slots.capacity() * sizeof(object::key_index::slot);
+                        for (object::const_iterator iter = o->m_vals.begin(); iter != o->m_vals.end(); ++iter)
+                                n += iter->second.footprint();
+                }
+                else if (m_type == ARRAY)
+                {
+                        // a packed array's values only exist once something asked for them
+                        const std::vector<value>& a = m_val.aval->m_vals;
+                        n = sizeof(array) + a.capacity() * sizeof(value) +
+                            m_val.aval->m_doubles.capacity() * sizeof(double) + m_val.aval->m_ints.capacity() * sizeof(int64_t);
+                        for (std::vector<value>::const_iterator iter = a.begin(); iter != a.end(); ++iter)
+                                n += iter->footprint();
+                }
+                return n;
+        }
+
+        bool value::equals(const value& rhs) const
+        {
+                if (this == &rhs) return true;
+                if (m_type != rhs.m_type) return false;
+                switch (m_type)
+                {
+                case NUMBER:
+                        return m_val.dval == rhs.m_val.dval;
+                case BOOL:
+                        return m_val.bval == rhs.m_val.bval;
+                case STRING:
+                {
+                        subbuffer a_text = sval();
+                        subbuffer b_text = rhs.sval();
+                        if (a_text.equals(b_text)) return true;
+                        // only different escaping can make different text equal
+                        if (!memchr(a_text.begin(), '\\', a_text.length()) && !memchr(b_text.begin(), '\\', b_text.length()))
+                                return false;
+                        std::string a, b;
+                        unescape(a);
+                        rhs.unescape(b);
+                        return a == b;
+                }
+                case OBJECT:
+                case ARRAY:
+                {
+                        const container* a = get_container();
+                        const container* b = rhs.get_container();
+                        if (a->m_hash && b->m_hash && a->m_hash != b->m_hash) return false;
+                        if (!a->m_modified && !b->m_modified && raw_subbuffer().equals(rhs.raw_subbuffer())) return true;
+                        if (m_type == ARRAY)
+                        {
+                                const array* aa = m_val.aval;
+                                const array* ba = rhs.m_val.aval;
+                                if (aa->size() != ba->size()) return false;
+                                if (aa->m_packing == array::PACKED_DOUBLE && ba->m_packing == array::PACKED_DOUBLE)
+                                        return aa->m_doubles == ba->m_doubles;
+                                if (aa->m_packing == array::PACKED_INT64 && ba->m_packing == array::PACKED_INT64)
+                                        return aa->m_ints == ba->m_ints;
+                                const std::vector<value>& av = aa->values();
+                                const std::vector<value>& bv = ba->values();
+                                if (av.size() != bv.size()) return false;
+                                for (size_t i = 0; i < av.size(); i++)
+                                        if (!av[i].equals(bv[i])) return false;
+                                return true;
+                        }
+                        const object* ao = m_val.oval;
+                        const object* bo = rhs.m_val.oval;
+                        if (ao->size() != bo->size()) return false;
+                        for (object::const_iterator iter = ao->begin(); iter != ao->end(); ++iter)
+                        {
+                                const value* found = bo->find(iter->first);
+                                if (!found || !iter->second.equals(*found)) return false;
+                        }
+                        return true;
+                }
+                default:
+                        return true;
                 }
         }
 
         value& value::operator[] (subbuffer key)
         {
-                if (m_type == OBJECT) return const_cast<value&>((*m_val.oval)[key]);
-                return s_unset;
+                value* v = m_type == OBJECT ? m_val.oval->find(key) : NULL;
+                return v ? *v : scratch_unset();
         }
         value& value::operator[] (size_t key)
         {
                 if (m_type == ARRAY) return (*m_val.aval)[key];
-                return s_unset;
+                return scratch_unset();
         }
         const value& value::operator[] (subbuffer key) const
         {
-                if (m_type == OBJECT) return (*m_val.oval)[key];
-                return s_unset;
+                if (m_type == OBJECT) return static_cast<const object&>(*m_val.oval)[key];
+                return unset_value();
+        }
+        value& value::operator[] (const key& k)
+        {
+                value* v = m_type == OBJECT ? m_val.oval->find(k) : NULL;
+                return v ? *v : scratch_unset();
+        }
+        const value& value::operator[] (const key& k) const
+        {
+                const value* v = m_type == OBJECT ? static_cast<const object*>(m_val.oval)->find(k) : NULL;
+                return v ? *v : unset_value();
         }
         const value& value::operator[] (size_t key) const
         {
-                if (m_type == ARRAY) return (*m_val.aval)[key];
-                return s_unset;
+                if (m_type == ARRAY) return static_cast<const array&>(*m_val.aval)[key];
+                return unset_value();
         }
 
         bool value::exists(subbuffer key) const
@@ -524,6 +1569,160 @@ namespace json
                 return false;
         }
 
+        template<typename T> value& value::set(subbuffer key, const T& val)
+        {
+                if (m_type == OBJECT) return m_val.oval->set(key, val);
+                return scratch_unset();
+        }
+
+        bool value::erase(subbuffer key)
+        {
+                if (m_type == OBJECT) return m_val.oval->erase(key);
+                return false;
+        }
+
+        template<typename T> value& value::set(size_t idx, const T& val)
+        {
+                if (m_type == ARRAY) return m_val.aval->set(idx, val);
+                return scratch_unset();
+        }
+
+        template<typename T> value& value::push_back(const T& val)
+        {
+                if (m_type == ARRAY) return m_val.aval->push_back(val);
+                return scratch_unset();
+        }
+
+        template<typename T> value& value::insert(size_t idx, const T& val)
+        {
+                if (m_type == ARRAY) return m_val.aval->insert(idx, val);
+                return scratch_unset();
+        }
+
+        bool value::erase(size_t idx)
+        {
+                if (m_type == ARRAY) return m_val.aval->erase(idx);
+                return false;
+        }
+
+        value value::make(storage& st, subbuffer val)
+        {
+                value v;
+                v.m_type = STRING;
+                v.set_sval(st.escape(val));
+                return v;
+        }
+
+        value value::make(storage& st, double val)
+        {
+                char buff[NTOA_BUFF_SIZE];
+                value v;
+                v.m_type = NUMBER;
+                v.m_val.dval = val;
+                v.set_sval(st.copy(subbuffer(buff, dtoa(val, buff))));
+                return v;
+        }
+
+        template<typename NUMB> value value::make_integer(storage& st, NUMB val)
+        {
+                char buff[NTOA_BUFF_SIZE];
+                value v;
+                v.m_type = NUMBER;
+                v.m_val.dval = double(val);
+                size_t len = ntoa(val, buff);
+                // ntoa never fills the buffer, the clamp just tells the compiler so
+                if (len > sizeof(buff)) len = sizeof(buff);
+                v.set_sval(st.copy(subbuffer(buff, len)));
+                return v;
+        }
+
+        value value::make(storage&, bool val)
+        {
+                value v;
+                v.m_type = BOOL;
+                v.m_val.bval = val;
+                return v;
+        }
+
+        value value::make(storage& st, val_type type)
+        {
+                value v;
+                switch (type)
+                {
+                case OBJECT:
+                        v.m_val.oval = new object;
+                        break;
+                case ARRAY:
+                        v.m_val.aval = new array;
+                        break;
+                case STRING:
+                        v.set_sval(subbuffer("", 0));
+                        break;
+                case NUMBER:
+                        return make(st, int64_t(0));
+                case BOOL:
+                        v.m_val.bval = false;
+                        break;
+                default:
+                        break;
+                }
+                v.m_type = type;
+                return v;
+        }
+
+        value value::make(storage& st, const value& src)
+        {
+                value v;
+                switch (src.m_type)
+                {
+                case OBJECT:
+                case ARRAY:
+                        if (!src.is_modified() && src.raw_subbuffer().is_set())
+                        {
+                                // one copy of the text and a parse is cheaper than copying node by node
+                                subbuffer text = st.copy(src.raw_subbuffer());
+                                v.parse(text, 0);
+                        }
+                        else if (src.m_type == OBJECT)
+                        {
+                                v = make(st, OBJECT);
+                                std::vector<object::member>& members = v.m_val.oval->m_vals;
+                                members.reserve(src.m_val.oval->m_vals.size());
+                                for (object::const_iterator iter = src.m_val.oval->m_vals.begin();
+                                     iter != src.m_val.oval->m_vals.end();
+                                     ++iter)
+                                {
+                                        members.push_back(object::member(st.copy(iter->first), make(st, iter->second)));
+                                        v.m_val.oval->adopt(members.back().second);
+                                }
+                        }
+                        else
+                        {
+                                v = make(st, ARRAY);
+                                std::vector<value>& vals = v.m_val.aval->m_vals;
+                                const std::vector<value>& src_vals = static_cast<const array*>(src.m_val.aval)->values();
+                                vals.reserve(src_vals.size());
+                                for (std::vector<value>::const_iterator iter = src_vals.begin();
+                                     iter != src_vals.end();
+                                     ++iter)
+                                {
+                                        vals.push_back(make(st, *iter));
+                                        v.m_val.aval->adopt(vals.back());
+                                }
+                        }
+                        break;
+                case STRING:
+                case NUMBER:
+                        v = src;
+                        v.set_sval(st.copy(src.sval()));
+                        break;
+                default:
+                        v = src;
+                        break;
+                }
+                return v;
+        }
+
         void value::clear()
         {
                 if (m_type == OBJECT && m_val.oval)
@@ -553,20 +1752,41 @@ namespace json
                 switch (m_type)
                 {
                 case OBJECT:
-                {
-                        json_object obj;
-                        m_val.oval->to_json(obj);
-                        obj.to_string(json_text);
+                case ARRAY:
+                        write(json_text);
+                        break;
+                default:
                         break;
                 }
-                case ARRAY:
+        }
+
+        template<typename BUFF> void value::write(BUFF& out) const
+        {
+                switch (m_type)
                 {
-                        json_array arr;
-                        m_val.aval->to_json(arr);
-                        arr.to_string(json_text);
+                case OBJECT:
+                        m_val.oval->write(out);
+                        break;
+                case ARRAY:
+                        m_val.aval->write(out);
+                        break;
+                case STRING:
+                        // strings are still escaped exactly as they were in the parsed text
+                        out += '\"';
+                        append_raw(out, sval());
+                        out += '\"';
+                        break;
+                case NUMBER:
+                        append_raw(out, sval());
+                        break;
+                case BOOL:
+                        if (m_val.bval)
+                                out.append("true", 4);
+                        else
+                                out.append("false", 5);
                         break;
-                }
                 default:
+                        out.append("null", 4);
                         break;
                 }
         }
@@ -590,7 +1810,8 @@ namespace json
                         break;
                 }
                 case STRING:
-                        obj.add(key, m_sval);
+                        // still escaped from the parsed text
+                        obj.add_encoded(key, sval(), json_verbatim());
                         break;
                 case NUMBER:
                         obj.add(key, m_val.dval);
@@ -622,7 +1843,7 @@ namespace json
                         break;
                 }
                 case STRING:
-                        arr.add(m_sval);
+                        arr.add_encoded(sval(), json_verbatim());
                         break;
                 case NUMBER:
                         arr.add(m_val.dval);
@@ -636,6 +1857,11 @@ namespace json
         }
 
         bool value::parse(subbuffer& val, int32_t level)
+        {
+                return parse(val, level, parse_options());
+        }
+
+        bool value::parse(subbuffer& val, int32_t level, const parse_options& opts)
         {
                 if (JSON_MAX_PARSE_RECURSION < ++level)
                 {
@@ -650,38 +1876,22 @@ namespace json
                 {
                         val.advance(1);
                         // need to find an unescaped double quote
-                        size_t dq = 0;
-                        while (dq != subbuffer::npos)
+                        const char* dq = scan::string_end(val.begin(), val.begin() + val.length());
+                        if (!dq) return false;
+                        if (size_t(dq - val.begin()) > UINT32_MAX)
                         {
-                                dq = val.find('"', dq);
-                                if (dq == 0)
-                                {
-                                        m_sval.clear();
-                                        break;
-                                }
-                                else if (dq == subbuffer::npos)
-                                {
-                                        return false;
-                                }
-                                else if (val.at(dq - 1) == '\\')
-                                {
-                                        dq++;
-                                        continue;
-                                }
-                                else
-                                {
-                                        m_sval = val.sub(0, dq);
-                                        break;
-                                }
+                                JSON_ERROR("value::parse, string longer than 4GB\n");
+                                return false;
                         }
+                        set_sval(val.sub(0, dq - val.begin()));
                         m_type = STRING;
-                        val.advance(m_sval.length() + 1);
+                        val.advance(m_len + 1);
                         return true;
                 }
                 else if (val.starts_with('['))
                 {
                         m_val.aval = new array();
-                        if (!m_val.aval->parse(val, level))
+                        if (!m_val.aval->parse(val, level, opts))
                         {
                                 m_val.aval->clear();
                                 delete m_val.aval;
@@ -693,7 +1903,7 @@ namespace json
                 else if (val.starts_with('{'))
                 {
                         m_val.oval = new object;
-                        if (!m_val.oval->parse(val, level))
+                        if (!m_val.oval->parse(val, level, opts))
                         {
                                 m_val.oval->clear();
                                 delete m_val.oval;
@@ -716,31 +1926,18 @@ namespace json
                 }
                 else if (isdigit(val.at(0)) || val.at(0) == '-')
                 {
-                        subbuffer rem;
-                        m_val.dval = aton<double>(val, &rem);
-                        if (!rem.empty() && !rem.starts_with(spacecomma) && !rem.starts_with(braces) && !rem.starts_with(brackets))
+                        subbuffer rem = val;
+                        subbuffer num;
+                        if (!scan::number(rem, num) || !scan::to_double(num, m_val.dval) ||
+                            (!rem.empty() && !rem.starts_with(spacecomma) && !rem.starts_with(braces) && !rem.starts_with(brackets)))
                         {
-                                if (rem.starts_with("e+", CASE_INSENSITIVE))
-                                {
-                                        subbuffer rem2;
-                                        int32_t mult = aton<int32_t>(rem.sub(2), &rem2);
-                                        m_val.dval *= mult;
-                                        rem = rem2;
-                                }
-                                else
-                                {
-                                        JSON_ERROR("value::parse, failed to parse full number value, val: '%.*s', rem: '%.*s'\n",
-                                                   SUBBUF_FORMAT(val.sub(0, 100)), SUBBUF_FORMAT(rem.sub(0, 100)));
-                                        m_type = UNSET;
-                                        return false;
-                                }
+                                JSON_ERROR("value::parse, failed to parse full number value, val: '%.*s', rem: '%.*s'\n",
+                                           SUBBUF_FORMAT(val.sub(0, 100)), SUBBUF_FORMAT(rem.sub(0, 100)));
+                                m_type = UNSET;
+                                return false;
                         }
 
-                        if (rem.empty())
-                                m_sval = val;
-                        else
-                                m_sval = val.sub(0, rem.begin() - val.begin());
-
+                        set_sval(num);
                         m_type = NUMBER;
                         val = rem;
                 }
@@ -771,15 +1968,27 @@ namespace json
 
         class root : public value
         {
+                friend class patcher;
+                friend class snapshot;
         public:
                 inline root()
-                        : value(), m_is_valid(false)
+                        : value(), m_is_valid(false), m_storage()
                 {}
                 inline root(subbuffer val)
-                        : value(), m_is_valid(false)
+                        : value(), m_is_valid(false), m_storage()
                 {
                         int32_t level = 0;
                         m_is_valid = this->parse(val, level);
+                        container* c = get_container();
+                        if (c) c->m_storage = &m_storage;
+                }
+                inline root(subbuffer val, const parse_options& opts)
+                        : value(), m_is_valid(false), m_storage()
+                {
+                        int32_t level = 0;
+                        m_is_valid = this->parse(val, level, opts);
+                        container* c = get_container();
+                        if (c) c->m_storage = &m_storage;
                 }
 
                 inline ~root()
@@ -791,8 +2000,14 @@ namespace json
                 {
                         return m_is_valid;
                 }
+
+                /**
+                  @brief Where the text added by set/insert/push_back lives.
+                 */
+                inline const storage& get_storage() const { return m_storage; }
         private:
                 bool m_is_valid;
+                storage m_storage;
         };
 };
 
@@ -0,0 +1,475 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    json_patch.h
+//: \details: RFC 6902 JSON Patch and RFC 7396 JSON Merge Patch on a parsed json::root
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#ifndef _JSON_PATCH_H_
+#define _JSON_PATCH_H_
+
+#include "json_parser.h"
+
+#include <string>
+
+/**
+  @brief Apply patches to a parsed document in place.
+
+  Only the containers on the path to each change are touched (and marked modified), every
+  other subtree keeps pointing into the original text and is written out by copying it.
+  Values taken from the patch are copied into the document's storage so the patch can go
+  away afterwards, "move" re-links the subtree without copying it at all.
+
+  @code
+        json::root doc(text);
+        json::patch_result res;
+        if (!json::apply_patch(doc, "[{\"op\": \"replace\", \"path\": \"/a/0\", \"value\": 5}]", &res))
+                // res.failed_op and res.error say which operation failed and why
+        json::merge_patch(doc, "{\"b\": null, \"c\": {\"d\": true}}");
+        doc.write(out);
+  @endcode
+
+  @note A JSON Patch is not atomic here: the operations before a failed one stay applied.
+        Apply it to a copy of the document if that matters.
+ */
+
+namespace json
+{
+        struct patch_result
+        {
+                patch_result() :failed_op(0), error() {}
+
+                size_t failed_op;       //!< index of the operation that failed
+                std::string error;
+        };
+
+        /**
+          @brief Does the work for apply_patch and merge_patch, a friend of the DOM classes.
+         */
+        class patcher
+        {
+        public:
+                static bool apply(root& doc, const value& patch, patch_result* res)
+                {
+                        std::string err;
+                        if (!patch.is_array())
+                        {
+                                if (res) res->error = "a JSON Patch must be an array";
+                                return false;
+                        }
+                        for (size_t i = 0; i < patch.size(); i++)
+                        {
+                                if (!apply_op(doc, patch[i], err))
+                                {
+                                        if (res)
+                                        {
+                                                res->failed_op = i;
+                                                res->error = err;
+                                        }
+                                        return false;
+                                }
+                        }
+                        return true;
+                }
+
+                static void merge(root& doc, const value& patch)
+                {
+                        if (!patch.is_object())
+                        {
+                                set_root(doc, value::make(doc.m_storage, patch));
+                                return;
+                        }
+                        if (!doc.is_object()) set_root(doc, value::make(doc.m_storage, OBJECT));
+                        merge_object(doc.m_storage, *doc.m_val.oval, *patch.m_val.oval);
+                }
+
+        private:
+                /**
+                  @brief Where a JSON Pointer points: the container and the key or index in it.
+                 */
+                struct location
+                {
+                        location() :is_root(false), parent(NULL), key(), idx(0), append(false) {}
+
+                        bool is_root;           //!< the pointer was "", the whole document
+                        value* parent;
+                        std::string key;        //!< escaped, the way object keys are kept
+                        size_t idx;
+                        bool append;            //!< the index was "-"
+                private:
+                        location(const location&);
+                        location& operator=(const location&);
+                };
+
+                static bool fail(std::string& err, const char* msg, subbuffer detail = subbuffer())
+                {
+                        err = msg;
+                        if (!detail.empty())
+                        {
+                                err += ": ";
+                                err.append(detail.begin(), detail.length());
+                        }
+                        return false;
+                }
+
+                /**
+                  @brief Decode one reference token (~1 is / and ~0 is ~) and JSON escape it.
+                 */
+                static bool decode_token(subbuffer token, std::string& esc, std::string& err)
+                {
+                        std::string plain;
+                        for (size_t i = 0; i < token.length(); i++)
+                        {
+                                if (token[i] != '~')
+                                        plain += token[i];
+                                else if (i + 1 < token.length() && token[i + 1] == '0')
+                                        plain += '~', i++;
+                                else if (i + 1 < token.length() && token[i + 1] == '1')
+                                        plain += '/', i++;
+                                else
+                                        return fail(err, "invalid ~ escape in path", token);
+                        }
+                        esc.clear();
+                        json_object::json_friendly::append(esc, plain);
+                        return true;
+                }
+
+                static bool parse_index(subbuffer token, size_t& idx)
+                {
+                        if (token.empty() || token.length() > 18 || (token[0] == '0' && token.length() > 1)) return false;
+                        idx = 0;
+                        for (size_t i = 0; i < token.length(); i++)
+                        {
+                                if (token[i] < '0' || token[i] > '9') return false;
+                                idx = idx * 10 + (token[i] - '0');
+                        }
+                        return true;
+                }
+
+                static value* child(value* cur, subbuffer token, std::string& err)
+                {
+                        if (cur->m_type == OBJECT)
+                        {
+                                std::string esc;
+                                if (!decode_token(token, esc, err)) return NULL;
+                                value* found = cur->m_val.oval->find(esc);
+                                if (found) return found;
+                        }
+                        else if (cur->m_type == ARRAY)
+                        {
+                                size_t idx;
+                                std::vector<value>& vals = cur->m_val.aval->values();
+                                if (parse_index(token, idx) && idx < vals.size())
+                                        return &vals[idx];
+                        }
+                        fail(err, "path does not exist", token);
+                        return NULL;
+                }
+
+                /**
+                  @param [out] loc Must be freshly constructed.
+                 */
+                static bool resolve(root& doc, subbuffer path, location& loc, std::string& err)
+                {
+                        if (path.empty())
+                        {
+                                loc.is_root = true;
+                                return true;
+                        }
+                        if (!path.starts_with('/')) return fail(err, "path must start with /", path);
+
+                        value* cur = &doc;
+                        path.advance(1);
+                        size_t slash;
+                        while ((slash = path.find('/')) != subbuffer::npos)
+                        {
+                                cur = child(cur, path.sub(0, slash), err);
+                                if (!cur) return false;
+                                path.advance(slash + 1);
+                        }
+
+                        loc.parent = cur;
+                        if (cur->m_type == OBJECT)
+                                return decode_token(path, loc.key, err);
+                        if (cur->m_type == ARRAY)
+                        {
+                                if (path.equals("-"))
+                                        loc.append = true;
+                                else if (!parse_index(path, loc.idx))
+                                        return fail(err, "invalid array index", path);
+                                return true;
+                        }
+                        return fail(err, "parent is not an object or array", path);
+                }
+
+                static value* target(const location& loc, root& doc)
+                {
+                        if (loc.is_root) return &doc;
+                        if (loc.parent->m_type == OBJECT)
+                        {
+                                return loc.parent->m_val.oval->find(loc.key);
+                        }
+                        std::vector<value>& vals = loc.parent->m_val.aval->values();
+                        if (loc.append || loc.idx >= vals.size()) return NULL;
+                        return &vals[loc.idx];
+                }
+
+                static void set_root(root& doc, const value& v)
+                {
+                        static_cast<value&>(doc).clear();
+                        static_cast<value&>(doc) = v;
+                        container* c = v.get_container();
+                        if (c)
+                        {
+                                c->m_parent = NULL;
+                                c->m_storage = &doc.m_storage;
+                        }
+                }
+
+                /**
+                  @brief Link v (already owned by doc) in at loc. replace: the key/index must exist and is overwritten.
+                 */
+                static bool put(root& doc, const location& loc, const value& v, bool replace, std::string& err)
+                {
+                        if (loc.is_root)
+                        {
+                                set_root(doc, v);
+                                return true;
+                        }
+                        if (loc.parent->m_type == OBJECT)
+                        {
+                                object* obj = loc.parent->m_val.oval;
+                                value* found = obj->find(loc.key);
+                                if (!found)
+                                {
+                                        if (replace) return fail(err, "path does not exist", loc.key);
+                                        obj->m_vals.push_back(object::member(doc.m_storage.copy(loc.key), value()));
+                                        obj->drop_index();
+                                        found = &obj->m_vals.back().second;
+                                }
+                                else
+                                        found->clear();
+                                *found = v;
+                                obj->adopt(v);
+                                obj->mark_modified();
+                                return true;
+                        }
+
+                        array* arr = loc.parent->m_val.aval;
+                        std::vector<value>& vals = arr->values();
+                        size_t idx = loc.append ? vals.size() : loc.idx;
+                        if (replace)
+                        {
+                                if (loc.append || idx >= vals.size()) return fail(err, "index out of range");
+                                vals[idx].clear();
+                                vals[idx] = v;
+                        }
+                        else
+                        {
+                                if (idx > vals.size()) return fail(err, "index out of range");
+                                vals.insert(vals.begin() + idx, v);
+                        }
+                        arr->adopt(v);
+                        arr->mark_modified();
+                        return true;
+                }
+
+                /**
+                  @brief Unlink the value at loc without freeing it.
+                 */
+                static bool take(const location& loc, value& out, std::string& err)
+                {
+                        if (loc.is_root) return fail(err, "can not remove the whole document");
+                        if (loc.parent->m_type == OBJECT)
+                        {
+                                object* obj = loc.parent->m_val.oval;
+                                size_t pos = obj->position(loc.key);
+                                if (pos == object::npos) return fail(err, "path does not exist", loc.key);
+                                out = obj->m_vals[pos].second;
+                                obj->m_vals.erase(obj->m_vals.begin() + pos);
+                                obj->drop_index();
+                                obj->mark_modified();
+                        }
+                        else
+                        {
+                                array* arr = loc.parent->m_val.aval;
+                                std::vector<value>& vals = arr->values();
+                                if (loc.append || loc.idx >= vals.size()) return fail(err, "index out of range");
+                                out = vals[loc.idx];
+                                vals.erase(vals.begin() + loc.idx);
+                                arr->mark_modified();
+                        }
+                        container* c = out.get_container();
+                        if (c) c->m_parent = NULL;
+                        return true;
+                }
+
+                static bool apply_op(root& doc, const value& op, std::string& err)
+                {
+                        if (!op.is_object()) return fail(err, "an operation must be an object");
+                        const value& name = op["op"];
+                        const value& path_val = op["path"];
+                        if (!name.is_string()) return fail(err, "missing op");
+                        if (!path_val.is_string()) return fail(err, "missing path");
+                        std::string path;
+                        path_val.unescape(path);
+
+                        location loc;
+                        subbuffer op_name = name.str();
+                        if (op_name.equals("add") || op_name.equals("replace") || op_name.equals("test"))
+                        {
+                                if (!op.exists("value")) return fail(err, "missing value");
+                                if (!resolve(doc, path, loc, err)) return false;
+                                if (op_name.equals("test"))
+                                {
+                                        value* t = target(loc, doc);
+                                        if (!t) return fail(err, "path does not exist", path);
+                                        if (!t->equals(op["value"])) return fail(err, "test failed", path);
+                                        return true;
+                                }
+                                value v = value::make(doc.m_storage, op["value"]);
+                                if (put(doc, loc, v, op_name.equals("replace"), err)) return true;
+                                v.clear();
+                                return false;
+                        }
+                        if (op_name.equals("remove"))
+                        {
+                                value v;
+                                if (!resolve(doc, path, loc, err) || !take(loc, v, err)) return false;
+                                v.clear();
+                                return true;
+                        }
+                        if (op_name.equals("move") || op_name.equals("copy"))
+                        {
+                                const value& from_val = op["from"];
+                                if (!from_val.is_string()) return fail(err, "missing from");
+                                std::string from;
+                                from_val.unescape(from);
+                                location from_loc;
+                                if (!resolve(doc, from, from_loc, err)) return false;
+
+                                value v;
+                                if (op_name.equals("copy"))
+                                {
+                                        value* src = target(from_loc, doc);
+                                        if (!src) return fail(err, "from does not exist", from);
+                                        v = value::make(doc.m_storage, *src);
+                                }
+                                else
+                                {
+                                        if (from == path) return target(from_loc, doc) || fail(err, "from does not exist", from);
+                                        if (path.compare(0, from.length() + 1, from + "/") == 0)
+                                                return fail(err, "can not move a value into itself", path);
+                                        // no copy, the subtree is unlinked and linked in again
+                                        if (!take(from_loc, v, err)) return false;
+                                }
+                                // the path is resolved after the removal, as the RFC says
+                                if (resolve(doc, path, loc, err) && put(doc, loc, v, false, err)) return true;
+                                v.clear();
+                                return false;
+                        }
+                        return fail(err, "unknown op", op_name);
+                }
+
+                static void merge_object(storage& st, object& target, const object& patch)
+                {
+                        for (object::const_iterator iter = patch.m_vals.begin(); iter != patch.m_vals.end(); ++iter)
+                        {
+                                size_t pos = target.position(iter->first);
+                                if (iter->second.is_unset())
+                                {
+                                        if (pos != object::npos)
+                                        {
+                                                target.m_vals[pos].second.clear();
+                                                target.m_vals.erase(target.m_vals.begin() + pos);
+                                                target.drop_index();
+                                                target.mark_modified();
+                                        }
+                                        continue;
+                                }
+                                if (iter->second.is_object() && pos != object::npos && target.m_vals[pos].second.is_object())
+                                {
+                                        merge_object(st, *target.m_vals[pos].second.m_val.oval, *iter->second.m_val.oval);
+                                        continue;
+                                }
+
+                                value v;
+                                if (iter->second.is_object())
+                                {
+                                        // nulls in it still mean "remove", so it is merged into an empty object
+                                        v = value::make(st, OBJECT);
+                                        merge_object(st, *v.m_val.oval, *iter->second.m_val.oval);
+                                }
+                                else
+                                        v = value::make(st, iter->second);
+
+                                if (pos == object::npos)
+                                {
+                                        pos = target.m_vals.size();
+                                        target.m_vals.push_back(object::member(st.copy(iter->first), value()));
+                                        target.drop_index();
+                                }
+                                else
+                                        target.m_vals[pos].second.clear();
+                                target.m_vals[pos].second = v;
+                                target.adopt(v);
+                                target.mark_modified();
+                        }
+                }
+        };
+
+        /**
+          @brief Apply an RFC 6902 JSON Patch (an array of operations) to doc.
+          @returns false if an operation failed, see the note on atomicity above.
+         */
+        inline bool apply_patch(root& doc, const value& patch, patch_result* res = NULL)
+        {
+                return patcher::apply(doc, patch, res);
+        }
+
+        inline bool apply_patch(root& doc, subbuffer patch_text, patch_result* res = NULL)
+        {
+                root patch(patch_text);
+                if (!patch.is_valid())
+                {
+                        if (res) res->error = "the patch is not valid JSON";
+                        return false;
+                }
+                return patcher::apply(doc, patch, res);
+        }
+
+        /**
+          @brief Apply an RFC 7396 JSON Merge Patch to doc.
+         */
+        inline void merge_patch(root& doc, const value& patch)
+        {
+                patcher::merge(doc, patch);
+        }
+
+        /**
+          @returns false if patch_text isn't valid JSON.
+         */
+        inline bool merge_patch(root& doc, subbuffer patch_text)
+        {
+                root patch(patch_text);
+                if (!patch.is_valid()) return false;
+                patcher::merge(doc, patch);
+                return true;
+        }
+}
+
+#endif
@@ -0,0 +1,787 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    json_path.h
+//: \details: Compiled JSONPath queries over a parsed document.
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#ifndef _JSON_PATH_H_
+#define _JSON_PATH_H_
+
+#include "json_parser.h"
+#include "json_scan.h"
+
+#include <string>
+#include <vector>
+
+/**
+  @brief JSONPath, compiled once and run as often as needed.
+
+  Supported:
+        $                       the root
+        .name ['name'] ["name"] a member
+        .* [*]                  every member or element
+        [3] [-1]                an element, negative counts from the end
+        [1:5] [::2] [-3:]       a slice, [start:end:step]
+        ..name ..* ..[0]        the same, at any depth (recursive descent)
+        [?(filter)]             the members or elements the filter is true for
+
+  A filter is made of @-relative paths (members and indexes only) compared with ==, !=, <, <=, >
+  or >= to a number, a 'string' or "string", true, false or null. A path on its own tests that
+  it exists. Terms are combined with && and || (&& first), e.g. [?(@.age > 30 && @.name)].
+
+  @code
+        json::path p("$.items[?(@.price < 10)].name");
+        if (!p.is_valid()) fprintf(stderr, "%s\n", p.error().c_str());
+        std::vector<const json::value*> names;
+        p.select(root, names);
+  @endcode
+
+  Matches are pointers into the document, in document order, nothing is copied. Member names
+  are escaped while compiling so a lookup is usually one object::find; a key written with other
+  escapes ("k\u0041" for $.kA) is matched by unescaping it, on the DOM and when streaming.
+ */
+
+namespace json
+{
+        class path
+        {
+        public:
+                enum step_type { CHILD, INDEX, SLICE, WILDCARD, FILTER };
+
+                struct step
+                {
+                        step() :type(CHILD), recursive(false), name(), index(0), start(0), end(0), stride(1),
+                                 has_start(false), has_end(false), filter(0) {}
+
+                        step_type type;
+                        bool recursive;         //!< ..
+                        std::string name;       //!< CHILD, escaped like the keys in the document
+                        int64_t index;          //!< INDEX
+                        int64_t start;          //!< SLICE
+                        int64_t end;
+                        int64_t stride;
+                        bool has_start;
+                        bool has_end;
+                        size_t filter;          //!< FILTER, index into m_filters
+                };
+
+                path() :m_steps(), m_filters(), m_error() {}
+
+                explicit path(subbuffer query) :m_steps(), m_filters(), m_error()
+                {
+                        compile(query);
+                }
+
+                /**
+                  @returns false (see error()) if the query could not be compiled.
+                 */
+                bool compile(subbuffer query)
+                {
+                        m_steps.clear();
+                        m_filters.clear();
+                        m_error.clear();
+                        subbuffer q = query;
+                        scan::skip_ws(q);
+                        if (!q.starts_with('$')) return fail("a query starts with $", q);
+                        q.advance(1);
+                        while (!q.empty())
+                        {
+                                if (!parse_step(q)) return false;
+                        }
+                        return true;
+                }
+
+                bool is_valid() const { return m_error.empty(); }
+                const std::string& error() const { return m_error; }
+                const std::vector<step>& steps() const { return m_steps; }
+
+                /**
+                  @brief Append every match under root to out.
+                  @returns The number of matches appended.
+                 */
+                size_t select(const value& root, std::vector<const value*>& out) const
+                {
+                        size_t before = out.size();
+                        if (is_valid()) walk(root, 0, out);
+                        return out.size() - before;
+                }
+
+                /**
+                  @returns The first match or NULL.
+                 */
+                const value* first(const value& root) const
+                {
+                        std::vector<const value*> out;
+                        select(root, out);
+                        return out.empty() ? NULL : out[0];
+                }
+
+                /**
+                  @brief true if the query can be run by stream(): no .. and no negative indexes.
+                 */
+                bool streamable() const
+                {
+                        if (!is_valid()) return false;
+                        for (size_t i = 0; i < m_steps.size(); i++)
+                        {
+                                const step& s = m_steps[i];
+                                if (s.recursive || s.index < 0 || s.start < 0 || s.end < 0) return false;
+                                if (s.type != FILTER) continue;
+                                const filter_expr& f = m_filters[s.filter];
+                                for (size_t g = 0; g < f.size(); g++)
+                                        for (size_t k = 0; k < f[g].size(); k++)
+                                                for (size_t r = 0; r < f[g][k].rel.size(); r++)
+                                                        if (f[g][k].rel[r].index < 0) return false;
+                        }
+                        return true;
+                }
+
+                /**
+                  @brief Run the query during one forward scan of text, without building a document.
+
+                  emit(subbuffer) is called with the text of each match, in document order. The text is
+                  the value as written, strings keep their quotes. Subtrees that cannot match are skipped
+                  by counting brackets and nothing is allocated, so memory does not depend on the size
+                  of text. A filter looks at each candidate element before it is descended into.
+                  A key repeated in an object matches at its first value only, the same as select() on
+                  a json::root parsed with DUPLICATES_FIRST. The default DUPLICATES_LAST keeps the last
+                  value instead, which a single forward scan cannot know about without reading ahead.
+
+                  @returns false if the query is not streamable() or text is not well formed, in which
+                           case the matches before the error have already been emitted.
+                 */
+                template<class F> bool stream(subbuffer text, F emit) const
+                {
+                        if (!streamable()) return false;
+                        if (!stream_value(text, 0, emit)) return false;
+                        scan::skip_ws(text);
+                        return text.empty();
+                }
+
+        private:
+                enum compare_op { EXISTS, EQ, NE, LT, LE, GT, GE };
+
+                struct term
+                {
+                        term() :rel(), op(EXISTS), type(UNSET), dval(0), sval(), bval(false) {}
+
+                        std::vector<step> rel;  //!< CHILD and INDEX steps from @
+                        compare_op op;
+                        val_type type;          //!< of the literal, UNSET for null
+                        double dval;
+                        std::string sval;       //!< unescaped
+                        bool bval;
+                };
+
+                // terms[i] are and-ed, the groups are or-ed
+                typedef std::vector<std::vector<term> > filter_expr;
+
+                bool fail(const char* msg, subbuffer at)
+                {
+                        m_error = msg;
+                        m_error += " at '";
+                        m_error.append(at.begin(), std::min(at.length(), size_t(20)));
+                        m_error += "'";
+                        return false;
+                }
+
+                static bool is_name_char(char c)
+                {
+                        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                               c == '_' || c == '-' || c == '$' || (c & 0x80);
+                }
+
+                static subbuffer take_name(subbuffer& q)
+                {
+                        size_t n = 0;
+                        while (n < q.length() && is_name_char(q[n])) n++;
+                        subbuffer name = q.sub(0, n);
+                        q.advance(n);
+                        return name;
+                }
+
+                static std::string escape(subbuffer name)
+                {
+                        std::string esc;
+                        json_object::json_friendly::append(esc, name);
+                        return esc;
+                }
+
+                // 'text' or "text", the JSON escapes are allowed in either
+                bool take_quoted(subbuffer& q, std::string& out)
+                {
+                        char quote = q.empty() ? 0 : q[0];
+                        if (quote != '\'' && quote != '"') return fail("expected a quoted string", q);
+                        size_t i = 1;
+                        for (; i < q.length() && q[i] != quote; i++)
+                                if (q[i] == '\\') i++;
+                        if (i >= q.length()) return fail("unterminated string", q);
+                        out.clear();
+                        scan::unescape(q.sub(1, i - 1), out);
+                        q.advance(i + 1);
+                        return true;
+                }
+
+                static bool take_int(subbuffer& q, int64_t& out)
+                {
+                        size_t n = (!q.empty() && q[0] == '-') ? 1 : 0;
+                        size_t digits = n;
+                        while (digits < q.length() && q[digits] >= '0' && q[digits] <= '9') digits++;
+                        if (digits == n) return false;
+                        out = aton<int64_t>(q.sub(0, digits));
+                        q.advance(digits);
+                        return true;
+                }
+
+                bool parse_step(subbuffer& q)
+                {
+                        step s;
+                        if (q.starts_with(CONST_SUBBUF("..")))
+                        {
+                                s.recursive = true;
+                                q.advance(2);
+                                if (q.starts_with('[')) return parse_bracket(q, s);
+                        }
+                        else if (q.starts_with('.'))
+                                q.advance(1);
+                        else if (q.starts_with('['))
+                                return parse_bracket(q, s);
+                        else
+                                return fail("expected . or [", q);
+
+                        if (q.starts_with('*'))
+                        {
+                                q.advance(1);
+                                s.type = WILDCARD;
+                        }
+                        else
+                        {
+                                subbuffer name = take_name(q);
+                                if (name.empty()) return fail("expected a member name", q);
+                                s.name = escape(name);
+                        }
+                        m_steps.push_back(s);
+                        return true;
+                }
+
+                bool parse_bracket(subbuffer& q, step& s)
+                {
+                        q.advance(1);
+                        scan::skip_ws(q);
+                        if (q.starts_with('*'))
+                        {
+                                q.advance(1);
+                                s.type = WILDCARD;
+                        }
+                        else if (q.starts_with('\'') || q.starts_with('"'))
+                        {
+                                std::string name;
+                                if (!take_quoted(q, name)) return false;
+                                s.name = escape(name);
+                        }
+                        else if (q.starts_with('?'))
+                        {
+                                q.advance(1);
+                                scan::skip_ws(q);
+                                if (!q.starts_with('(')) return fail("expected ( after ?", q);
+                                q.advance(1);
+                                filter_expr f;
+                                if (!parse_filter(q, f)) return false;
+                                if (!q.starts_with(')')) return fail("expected )", q);
+                                q.advance(1);
+                                s.type = FILTER;
+                                s.filter = m_filters.size();
+                                m_filters.push_back(f);
+                        }
+                        else
+                        {
+                                // an index or a slice
+                                s.type = INDEX;
+                                s.has_start = take_int(q, s.start);
+                                if (q.starts_with(':'))
+                                {
+                                        s.type = SLICE;
+                                        q.advance(1);
+                                        s.has_end = take_int(q, s.end);
+                                        if (q.starts_with(':'))
+                                        {
+                                                q.advance(1);
+                                                if (take_int(q, s.stride) && s.stride <= 0)
+                                                        return fail("a slice step must be positive", q);
+                                        }
+                                }
+                                else if (!s.has_start)
+                                        return fail("expected *, a name, an index, a slice or a filter", q);
+                                else
+                                        s.index = s.start;
+                        }
+                        scan::skip_ws(q);
+                        if (!q.starts_with(']')) return fail("expected ]", q);
+                        q.advance(1);
+                        m_steps.push_back(s);
+                        return true;
+                }
+
+                bool parse_filter(subbuffer& q, filter_expr& f)
+                {
+                        f.push_back(std::vector<term>());
+                        while (true)
+                        {
+                                term t;
+                                if (!parse_term(q, t)) return false;
+                                f.back().push_back(t);
+                                scan::skip_ws(q);
+                                if (q.starts_with(CONST_SUBBUF("&&")))
+                                        q.advance(2);
+                                else if (q.starts_with(CONST_SUBBUF("||")))
+                                {
+                                        q.advance(2);
+                                        f.push_back(std::vector<term>());
+                                }
+                                else
+                                        return true;
+                        }
+                }
+
+                bool parse_term(subbuffer& q, term& t)
+                {
+                        scan::skip_ws(q);
+                        if (!q.starts_with('@')) return fail("a filter term starts with @", q);
+                        q.advance(1);
+                        while (q.starts_with('.') || q.starts_with('['))
+                        {
+                                step s;
+                                if (q.starts_with('.'))
+                                {
+                                        q.advance(1);
+                                        subbuffer name = take_name(q);
+                                        if (name.empty()) return fail("expected a member name", q);
+                                        s.name = escape(name);
+                                }
+                                else
+                                {
+                                        q.advance(1);
+                                        scan::skip_ws(q);
+                                        if (q.starts_with('\'') || q.starts_with('"'))
+                                        {
+                                                std::string name;
+                                                if (!take_quoted(q, name)) return false;
+                                                s.name = escape(name);
+                                        }
+                                        else if (take_int(q, s.index))
+                                                s.type = INDEX;
+                                        else
+                                                return fail("expected a name or an index", q);
+                                        scan::skip_ws(q);
+                                        if (!q.starts_with(']')) return fail("expected ]", q);
+                                        q.advance(1);
+                                }
+                                t.rel.push_back(s);
+                        }
+
+                        scan::skip_ws(q);
+                        static const char* ops[] = { "==", "!=", "<=", ">=", "<", ">" };
+                        static const compare_op codes[] = { EQ, NE, LE, GE, LT, GT };
+                        for (size_t i = 0; i < 6; i++)
+                        {
+                                if (q.starts_with(subbuffer(ops[i])))
+                                {
+                                        t.op = codes[i];
+                                        q.advance(strlen(ops[i]));
+                                        return parse_literal(q, t);
+                                }
+                        }
+                        return true;
+                }
+
+                bool parse_literal(subbuffer& q, term& t)
+                {
+                        scan::skip_ws(q);
+                        subbuffer num;
+                        if (q.starts_with('\'') || q.starts_with('"'))
+                        {
+                                t.type = STRING;
+                                return take_quoted(q, t.sval);
+                        }
+                        if (scan::literal(q, "true", 4) || scan::literal(q, "false", 5))
+                        {
+                                t.type = BOOL;
+                                t.bval = q.begin()[-1] == 'e' && q.begin()[-2] == 'u';
+                                return true;
+                        }
+                        if (scan::literal(q, "null", 4))
+                        {
+                                t.type = UNSET;
+                                return true;
+                        }
+                        if (scan::number(q, num) && scan::to_double(num, t.dval))
+                        {
+                                t.type = NUMBER;
+                                return true;
+                        }
+                        return fail("expected a number, a string, true, false or null", q);
+                }
+
+                // find() compares the key text as written, so a miss looks again at the keys with
+                // escapes in them, unescaped, the same as the stream evaluator does
+                static const value* member(const value& v, const std::string& name)
+                {
+                        if (v.m_type != OBJECT) return NULL;
+                        const object* o = static_cast<const object*>(v.m_val.oval);
+                        const value* found = o->find(subbuffer(name));
+                        if (found) return found;
+                        for (object::const_iterator iter = o->begin(); iter != o->end(); ++iter)
+                        {
+                                if (memchr(iter->first.begin(), '\\', iter->first.length()) && scan::same_string(iter->first, subbuffer(name)))
+                                        return &iter->second;
+                        }
+                        return NULL;
+                }
+
+                static const value* element(const value& v, int64_t idx)
+                {
+                        if (v.m_type != ARRAY) return NULL;
+                        const std::vector<value>& a = static_cast<const array*>(v.m_val.aval)->values();
+                        if (idx < 0) idx += a.size();
+                        if (idx < 0 || idx >= int64_t(a.size())) return NULL;
+                        return &a[idx];
+                }
+
+                // escaped is the text between the quotes
+                static int compare_strings(subbuffer escaped, const std::string& lit)
+                {
+                        if (memchr(escaped.begin(), '\\', escaped.length()))
+                        {
+                                std::string plain;
+                                scan::unescape(escaped, plain);
+                                return plain.compare(lit);
+                        }
+                        int cmp = memcmp(escaped.begin(), lit.data(), std::min(escaped.length(), lit.length()));
+                        if (cmp) return cmp;
+                        return escaped.length() < lit.length() ? -1 : (escaped.length() > lit.length() ? 1 : 0);
+                }
+
+                static int compare_numbers(double d, double lit)
+                {
+                        return d < lit ? -1 : (d > lit ? 1 : 0);
+                }
+
+                static bool compared(compare_op op, int cmp)
+                {
+                        switch (op)
+                        {
+                        case EQ: return cmp == 0;
+                        case NE: return cmp != 0;
+                        case LT: return cmp < 0;
+                        case LE: return cmp <= 0;
+                        case GT: return cmp > 0;
+                        default: return cmp >= 0;
+                        }
+                }
+
+                static bool test(const value& v, const term& t)
+                {
+                        const value* cur = &v;
+                        for (size_t i = 0; cur && i < t.rel.size(); i++)
+                                cur = t.rel[i].type == INDEX ? element(*cur, t.rel[i].index) : member(*cur, t.rel[i].name);
+                        if (!cur) return false;
+                        if (t.op == EXISTS) return true;
+                        if (cur->m_type != t.type) return t.op == NE;
+
+                        switch (t.type)
+                        {
+                        case NUMBER:
+                                if (t.op == EQ) return cur->m_val.dval == t.dval;
+                                if (t.op == NE) return cur->m_val.dval != t.dval;
+                                return compared(t.op, compare_numbers(cur->m_val.dval, t.dval));
+                        case STRING:
+                                return compared(t.op, compare_strings(cur->sval(), t.sval));
+                        case BOOL:
+                                return compared(t.op, int(cur->m_val.bval) - int(t.bval));
+                        default:
+                                return compared(t.op, 0);
+                        }
+                }
+
+                bool matches(const value& v, const filter_expr& f) const
+                {
+                        for (size_t g = 0; g < f.size(); g++)
+                        {
+                                bool all = true;
+                                for (size_t i = 0; all && i < f[g].size(); i++)
+                                        all = test(v, f[g][i]);
+                                if (all) return true;
+                        }
+                        return false;
+                }
+
+                void walk(const value& v, size_t i, std::vector<const value*>& out) const
+                {
+                        if (i == m_steps.size())
+                        {
+                                out.push_back(&v);
+                                return;
+                        }
+                        if (m_steps[i].recursive)
+                                descend(v, i, out);
+                        else
+                                apply(v, i, out);
+                }
+
+                // step i on v and on everything below v
+                void descend(const value& v, size_t i, std::vector<const value*>& out) const
+                {
+                        apply(v, i, out);
+                        if (v.m_type == OBJECT)
+                        {
+                                const std::vector<object::member>& m = v.m_val.oval->m_vals;
+                                for (object::const_iterator iter = m.begin(); iter != m.end(); ++iter)
+                                        if (iter->second.m_type == OBJECT || iter->second.m_type == ARRAY)
+                                                descend(iter->second, i, out);
+                        }
+                        else if (v.m_type == ARRAY)
+                        {
+                                const std::vector<value>& a = static_cast<const array*>(v.m_val.aval)->values();
+                                for (size_t k = 0; k < a.size(); k++)
+                                        if (a[k].m_type == OBJECT || a[k].m_type == ARRAY)
+                                                descend(a[k], i, out);
+                        }
+                }
+
+                // step i on v only
+                void apply(const value& v, size_t i, std::vector<const value*>& out) const
+                {
+                        const step& s = m_steps[i];
+                        switch (s.type)
+                        {
+                        case CHILD:
+                        {
+                                const value* c = member(v, s.name);
+                                if (c) walk(*c, i + 1, out);
+                                break;
+                        }
+                        case INDEX:
+                        {
+                                const value* c = element(v, s.index);
+                                if (c) walk(*c, i + 1, out);
+                                break;
+                        }
+                        case SLICE:
+                        {
+                                if (v.m_type != ARRAY) break;
+                                const std::vector<value>& a = static_cast<const array*>(v.m_val.aval)->values();
+                                int64_t len = a.size();
+                                int64_t start = s.has_start ? s.start : 0;
+                                int64_t end = s.has_end ? s.end : len;
+                                if (start < 0) start = std::max(start + len, int64_t(0));
+                                if (end < 0) end += len;
+                                if (end > len) end = len;
+                                for (int64_t k = start; k < end; k += s.stride)
+                                        walk(a[k], i + 1, out);
+                                break;
+                        }
+                        case WILDCARD:
+                        case FILTER:
+                        {
+                                const filter_expr* f = s.type == FILTER ? &m_filters[s.filter] : NULL;
+                                if (v.m_type == OBJECT)
+                                {
+                                        const std::vector<object::member>& m = v.m_val.oval->m_vals;
+                                        for (object::const_iterator iter = m.begin(); iter != m.end(); ++iter)
+                                                if (!f || matches(iter->second, *f)) walk(iter->second, i + 1, out);
+                                }
+                                else if (v.m_type == ARRAY)
+                                {
+                                        const std::vector<value>& a = static_cast<const array*>(v.m_val.aval)->values();
+                                        for (size_t k = 0; k < a.size(); k++)
+                                                if (!f || matches(a[k], *f)) walk(a[k], i + 1, out);
+                                }
+                                break;
+                        }
+                        }
+                }
+
+                static bool in_slice(const step& s, int64_t k)
+                {
+                        return (!s.has_start || k >= s.start) && (!s.has_end || k < s.end) &&
+                               (k - (s.has_start ? s.start : 0)) % s.stride == 0;
+                }
+
+                // the member or element s names in the raw value v
+                static bool child_raw(subbuffer v, const step& s, subbuffer& out)
+                {
+                        scan::skip_ws(v);
+                        char close;
+                        if (s.type == CHILD && v.starts_with('{'))
+                                close = '}';
+                        else if (s.type == INDEX && v.starts_with('['))
+                                close = ']';
+                        else
+                                return false;
+                        v.advance(1);
+                        scan::skip_ws(v);
+                        if (v.starts_with(close)) return false;
+                        for (int64_t k = 0; ; k++)
+                        {
+                                bool hit;
+                                if (close == '}')
+                                {
+                                        subbuffer key;
+                                        scan::skip_ws(v);
+                                        if (!scan::string(v, key)) return false;
+                                        scan::skip_ws(v);
+                                        if (!v.starts_with(':')) return false;
+                                        v.advance(1);
+                                        hit = scan::same_string(key, subbuffer(s.name));
+                                }
+                                else
+                                        hit = k == s.index;
+                                if (!scan::value_text(v, out)) return false;
+                                if (hit) return true;
+                                scan::skip_ws(v);
+                                if (!v.starts_with(',')) return false;
+                                v.advance(1);
+                        }
+                }
+
+                static bool test_raw(subbuffer v, const term& t)
+                {
+                        subbuffer cur = v;
+                        for (size_t i = 0; i < t.rel.size(); i++)
+                                if (!child_raw(cur, t.rel[i], cur)) return false;
+                        if (t.op == EXISTS) return true;
+
+                        scan::skip_ws(cur);
+                        subbuffer text;
+                        double d;
+                        switch (cur.empty() ? 0 : cur[0])
+                        {
+                        case '"':
+                                if (t.type != STRING || !scan::string(cur, text)) return t.op == NE;
+                                return compared(t.op, compare_strings(text, t.sval));
+                        case 't':
+                        case 'f':
+                                if (t.type != BOOL) return t.op == NE;
+                                return compared(t.op, int(cur[0] == 't') - int(t.bval));
+                        case 'n':
+                                if (t.type != UNSET) return t.op == NE;
+                                return compared(t.op, 0);
+                        case '{':
+                        case '[':
+                        case 0:
+                                return t.op == NE;
+                        default:
+                                if (t.type != NUMBER || !scan::number(cur, text) || !scan::to_double(text, d)) return t.op == NE;
+                                if (t.op == EQ) return d == t.dval;
+                                if (t.op == NE) return d != t.dval;
+                                return compared(t.op, compare_numbers(d, t.dval));
+                        }
+                }
+
+                bool matches_raw(subbuffer v, const filter_expr& f) const
+                {
+                        for (size_t g = 0; g < f.size(); g++)
+                        {
+                                bool all = true;
+                                for (size_t i = 0; all && i < f[g].size(); i++)
+                                        all = test_raw(v, f[g][i]);
+                                if (all) return true;
+                        }
+                        return false;
+                }
+
+                // step i on the raw value at the front of val, val is left just past it
+                template<class F> bool stream_value(subbuffer& val, size_t i, F& emit) const
+                {
+                        if (i == m_steps.size())
+                        {
+                                subbuffer match;
+                                if (!scan::value_text(val, match)) return false;
+                                emit(match);
+                                return true;
+                        }
+
+                        scan::skip_ws(val);
+                        char close;
+                        if (val.starts_with('{'))
+                                close = '}';
+                        else if (val.starts_with('['))
+                                close = ']';
+                        else
+                                return scan::skip_value(val);
+
+                        const step& s = m_steps[i];
+                        val.advance(1);
+                        scan::skip_ws(val);
+                        if (val.starts_with(close))
+                        {
+                                val.advance(1);
+                                return true;
+                        }
+                        // a repeated key only matches once, at its first value
+                        bool found = false;
+                        for (int64_t k = 0; ; k++)
+                        {
+                                bool hit;
+                                if (close == '}')
+                                {
+                                        subbuffer key;
+                                        scan::skip_ws(val);
+                                        if (!scan::string(val, key)) return false;
+                                        scan::skip_ws(val);
+                                        if (!val.starts_with(':')) return false;
+                                        val.advance(1);
+                                        hit = s.type == WILDCARD || s.type == FILTER ||
+                                              (s.type == CHILD && !found && scan::same_string(key, subbuffer(s.name)));
+                                        found = found || (hit && s.type == CHILD);
+                                }
+                                else
+                                        hit = s.type == WILDCARD || s.type == FILTER || (s.type == INDEX && k == s.index) ||
+                                              (s.type == SLICE && in_slice(s, k));
+
+                                if (hit && s.type == FILTER)
+                                {
+                                        subbuffer v;
+                                        if (!scan::value_text(val, v)) return false;
+                                        if (matches_raw(v, m_filters[s.filter]) && !stream_value(v, i + 1, emit)) return false;
+                                }
+                                else if (hit)
+                                {
+                                        if (!stream_value(val, i + 1, emit)) return false;
+                                }
+                                else if (!scan::skip_value(val))
+                                        return false;
+
+                                scan::skip_ws(val);
+                                if (val.starts_with(close))
+                                {
+                                        val.advance(1);
+                                        return true;
+                                }
+                                if (!val.starts_with(',')) return false;
+                                val.advance(1);
+                        }
+                }
+
+                std::vector<step> m_steps;
+                std::vector<filter_expr> m_filters;
+                std::string m_error;
+        };
+}
+
+#endif
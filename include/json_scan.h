@@ -0,0 +1,398 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    json_scan.h
+//: \details: Low level JSON lexing helpers shared by the DOM parser and the struct binding.
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#ifndef _JSON_SCAN_H_
+#define _JSON_SCAN_H_
+
+#include "aton.h"
+#include "subbuffer.h"
+
+#include <locale.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__APPLE__)
+#include <xlocale.h>
+#endif
+
+#include <string>
+
+/**
+  @brief Lexing primitives that work directly on the JSON text.
+
+  Each function takes the remaining text as a subbuffer, consumes what it recognized
+  by advancing it and returns false if the text is not what was expected.
+  Nothing is allocated and nothing is copied, values are returned as subbuffers into the text.
+ */
+
+namespace json
+{
+namespace scan
+{
+        /// 1 for the chars skip_value has to look at inside an object or array
+        static const uint8_t s_structural[256] = {
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,         // 0
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,         // 16
+                0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,         // 32 "
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,         // 48
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,         // 64
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 0, 0,         // 80 [ ]
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,         // 96
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 0, 0,         // 112 { }
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,         // 128
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,         // 144
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,         // 160
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,         // 176
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,         // 192
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,         // 208
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,         // 224
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,         // 240
+        };
+
+        inline bool is_ws(char c)
+        {
+                return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+        }
+
+        inline void skip_ws(subbuffer& val)
+        {
+                const char* p = val.begin();
+                const char* end = p + val.length();
+                while (p != end && is_ws(*p)) ++p;
+                val.advance(p - val.begin());
+        }
+
+        /**
+          @brief Find the closing quote of a string.
+          @param [in] p Just past the opening quote.
+          @returns The closing quote or NULL if there isn't one.
+         */
+        inline const char* string_end(const char* p, const char* end)
+        {
+                const char* first = p;
+                while (p != end)
+                {
+                        const char* q = (const char*)memchr(p, '"', end - p);
+                        if (!q) return NULL;
+                        // escaped only if preceded by an odd number of backslashes
+                        const char* b = q;
+                        while (b != first && b[-1] == '\\') --b;
+                        if (!((q - b) & 1)) return q;
+                        p = q + 1;
+                }
+                return NULL;
+        }
+
+        /**
+          @brief Consume a string, val must start with the opening quote.
+          @param [out] out The contents between the quotes, still escaped.
+         */
+        inline bool string(subbuffer& val, subbuffer& out)
+        {
+                if (!val.starts_with('"')) return false;
+                const char* first = val.begin() + 1;
+                const char* q = string_end(first, val.begin() + val.length());
+                if (!q) return false;
+                out = subbuffer(first, q - first);
+                val.advance(q + 1 - val.begin());
+                return true;
+        }
+
+        /**
+          @brief Consume the chars that make up a number.
+          @param [out] out The text of the number.
+         */
+        inline bool number(subbuffer& val, subbuffer& out)
+        {
+                const char* p = val.begin();
+                const char* end = p + val.length();
+                while (p != end && ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E'))
+                        ++p;
+                if (p == val.begin()) return false;
+                out = subbuffer(val.begin(), p - val.begin());
+                val.advance(p - val.begin());
+                return true;
+        }
+
+        /**
+          @brief The C locale, so strtod reads '.' as the decimal point whatever the program set.
+         */
+        inline locale_t c_locale()
+        {
+                static locale_t loc = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+                return loc;
+        }
+
+        /**
+          @brief Convert the text of a number (as returned by number()) to the nearest double.
+          @details Up to 15 significant digits and a power of ten up to 1e22 are both exact
+                   doubles, so one multiply or divide rounds once; anything else goes to strtod.
+          @returns false unless all of text is a number.
+         */
+        inline bool to_double(subbuffer text, double& d)
+        {
+                static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                                1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+                const char* p = text.begin();
+                const char* end = p + text.length();
+                bool neg = p != end && *p == '-';
+                if (neg) ++p;
+                if (p == end || *p < '0' || *p > '9') return false;
+
+                uint64_t mant = 0;
+                int digits = 0;
+                int exp10 = 0;
+                for (; p != end && *p >= '0' && *p <= '9'; ++p)
+                {
+                        if (mant || *p != '0') { if (++digits <= 15) mant = mant * 10 + (*p - '0'); }
+                }
+                if (p != end && *p == '.')
+                {
+                        const char* frac = ++p;
+                        for (; p != end && *p >= '0' && *p <= '9'; ++p)
+                        {
+                                if (mant || *p != '0') { if (++digits <= 15) mant = mant * 10 + (*p - '0'); }
+                                exp10--;
+                        }
+                        if (p == frac) return false;
+                }
+                if (p != end && (*p == 'e' || *p == 'E'))
+                {
+                        ++p;
+                        bool eneg = p != end && *p == '-';
+                        if (p != end && (*p == '-' || *p == '+')) ++p;
+                        const char* first = p;
+                        int e = 0;
+                        for (; p != end && *p >= '0' && *p <= '9'; ++p)
+                        {
+                                if (e < 100000) e = e * 10 + (*p - '0');
+                        }
+                        if (p == first) return false;
+                        exp10 += eneg ? -e : e;
+                }
+                if (p != end) return false;
+
+                if (digits <= 15 && exp10 >= -22 && exp10 <= 22)
+                {
+                        d = exp10 < 0 ? double(mant) / pow10[-exp10] : double(mant) * pow10[exp10];
+                        if (neg) d = -d;
+                        return true;
+                }
+
+                // too many digits or too big an exponent to do exactly, strtod needs it NUL terminated
+                char buff[64];
+                if (text.length() < sizeof(buff))
+                {
+                        memcpy(buff, text.begin(), text.length());
+                        buff[text.length()] = 0;
+                        d = strtod_l(buff, NULL, c_locale());
+                }
+                else
+                {
+                        std::string copy(text.begin(), text.length());
+                        d = strtod_l(copy.c_str(), NULL, c_locale());
+                }
+                return true;
+        }
+
+        /**
+          @brief Consume a literal such as true, false or null.
+         */
+        inline bool literal(subbuffer& val, const char* lit, size_t len)
+        {
+                if (val.length() < len || memcmp(val.begin(), lit, len)) return false;
+                val.advance(len);
+                return true;
+        }
+
+        /**
+          @brief Consume a value of any type without looking at what is in it.
+
+          Objects and arrays are skipped by counting brackets, only strings (which may hold
+          brackets) are looked at on the way, so the skipped text is not fully validated.
+         */
+        inline bool skip_value(subbuffer& val)
+        {
+                skip_ws(val);
+                if (val.empty()) return false;
+                subbuffer out;
+                switch (val[0])
+                {
+                case '"':
+                        return string(val, out);
+                case 't':
+                        return literal(val, "true", 4);
+                case 'f':
+                        return literal(val, "false", 5);
+                case 'n':
+                        return literal(val, "null", 4);
+                case '{':
+                case '[':
+                        break;
+                default:
+                        return number(val, out);
+                }
+
+                const char* p = val.begin();
+                const char* end = p + val.length();
+                size_t depth = 0;
+                for (; p != end; ++p)
+                {
+                        if (!s_structural[uint8_t(*p)]) continue;
+                        switch (*p)
+                        {
+                        case '"':
+                                p = string_end(p + 1, end);
+                                if (!p) return false;
+                                break;
+                        case '{':
+                        case '[':
+                                depth++;
+                                break;
+                        default:
+                                if (!--depth)
+                                {
+                                        val.advance(p + 1 - val.begin());
+                                        return true;
+                                }
+                                break;
+                        }
+                }
+                return false;
+        }
+
+        /**
+          @brief Consume a value like skip_value() does.
+          @param [out] out The text of the value, strings with their quotes.
+         */
+        inline bool value_text(subbuffer& val, subbuffer& out)
+        {
+                skip_ws(val);
+                subbuffer first = val;
+                if (!skip_value(val)) return false;
+                // not val.begin(), an emptied subbuffer no longer points into the text
+                out = first.sub(0, first.length() - val.length());
+                return true;
+        }
+
+        inline bool hex4(const char* p, const char* last, uint32_t& cp)
+        {
+                if (last - p < 4) return false;
+                for (int i = 0; i < 4; i++)
+                {
+                        uint8_t v = s_aton_conversion_table[uint8_t(p[i])];
+                        if (v >= 16) return false;
+                        cp = (cp << 4) | v;
+                }
+                return true;
+        }
+
+        /**
+          @brief Decode the XXXX of a \uXXXX (and a following low surrogate) into UTF-8.
+          @returns Where to continue from.
+         */
+        template <typename BUFF>
+        const char* unescape_unicode(const char* p, const char* last, BUFF& dest)
+        {
+                uint32_t cp = 0;
+                if (!hex4(p, last, cp)) return p;
+                p += 4;
+                if (cp >= 0xD800 && cp <= 0xDBFF && last - p >= 6 && p[0] == '\\' && p[1] == 'u')
+                {
+                        uint32_t lo = 0;
+                        if (hex4(p + 2, last, lo) && lo >= 0xDC00 && lo <= 0xDFFF)
+                        {
+                                cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                                p += 6;
+                        }
+                }
+                if (cp < 0x80)
+                        dest += char(cp);
+                else if (cp < 0x800)
+                {
+                        dest += char(0xC0 | (cp >> 6));
+                        dest += char(0x80 | (cp & 0x3F));
+                }
+                else if (cp < 0x10000)
+                {
+                        dest += char(0xE0 | (cp >> 12));
+                        dest += char(0x80 | ((cp >> 6) & 0x3F));
+                        dest += char(0x80 | (cp & 0x3F));
+                }
+                else
+                {
+                        dest += char(0xF0 | (cp >> 18));
+                        dest += char(0x80 | ((cp >> 12) & 0x3F));
+                        dest += char(0x80 | ((cp >> 6) & 0x3F));
+                        dest += char(0x80 | (cp & 0x3F));
+                }
+                return p;
+        }
+
+        /**
+          @brief Append the unescaped form of the string contents in src to dest.
+          @details Handles every escape in http://www.ecma-international.org/publications/files/ECMA-ST/ECMA-404.pdf
+                   \uXXXX sequences (including surrogate pairs) are written as UTF-8.
+                   Unknown escapes are replaced by the escaped char.
+         */
+        template <typename BUFF>
+        void unescape(subbuffer src, BUFF& dest)
+        {
+                const char* first = src.begin();
+                const char* last = first + src.length();
+                while (first != last)
+                {
+                        const char* bs = (const char*)memchr(first, '\\', last - first);
+                        if (!bs) bs = last;
+                        dest.append(first, bs - first);
+                        first = bs;
+                        if (first == last || ++first == last) break;
+                        switch (*first)
+                        {
+                        case 'b': dest += '\b'; break;
+                        case 'f': dest += '\f'; break;
+                        case 'n': dest += '\n'; break;
+                        case 'r': dest += '\r'; break;
+                        case 't': dest += '\t'; break;
+                        case 'u':
+                                first = unescape_unicode(first + 1, last, dest) - 1;
+                                break;
+                        default: dest += *first; break;
+                        }
+                        ++first;
+                }
+        }
+
+        /**
+          @brief Compare the contents of two strings, still escaped, as they would be unescaped.
+         */
+        inline bool same_string(subbuffer a, subbuffer b)
+        {
+                if (!memchr(a.begin(), '\\', a.length()) && !memchr(b.begin(), '\\', b.length())) return a.equals(b);
+                std::string ua, ub;
+                unescape(a, ua);
+                unescape(b, ub);
+                return ua == ub;
+        }
+}
+}
+
+#endif
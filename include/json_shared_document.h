@@ -0,0 +1,241 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    json_shared_document.h
+//: \details: A parsed document many threads read while another one replaces it.
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#ifndef _JSON_SHARED_DOCUMENT_H_
+#define _JSON_SHARED_DOCUMENT_H_
+
+#include "json_parse_cache.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace json
+{
+        /**
+          @brief Holds the current version of a document, readers get it with one atomic load.
+
+          Reclamation is quiescent state based (QSBR): every reader thread has a reader object and
+          calls quiescent() at points where it holds nothing it got from get(), e.g. between
+          requests. publish() swaps the pointer and retires the old version, which is deleted once
+          every online reader has passed a quiescent point since the swap. Nothing on the read side
+          takes a lock or writes shared memory except quiescent(), a single store to the reader's
+          own cache line.
+
+          @code
+                json::shared_document config;
+                config.publish(text);                   // writer, any time
+
+                json::shared_document::reader r(config); // once per reader thread
+                while (serving)
+                {
+                        const json::value& root = r.get()->root();
+                        ...                             // use root for this request
+                        r.quiescent();                  // done with it
+                }
+          @endcode
+
+          @note A reader that blocks for a long time without calling quiescent() keeps every
+                version published since alive. Call offline() before blocking and online() after.
+         */
+        class shared_document
+        {
+        private:
+                // one per reader, on its own cache line so quiescent() doesn't slow the other readers
+                struct alignas(64) slot
+                {
+                        slot() :epoch(0) {}
+
+                        std::atomic<uint64_t> epoch;    //!< the last epoch seen, 0 when offline
+                };
+
+        public:
+                class reader
+                {
+                public:
+                        explicit reader(shared_document& doc) :m_doc(doc), m_slot(doc.attach()) {}
+                        ~reader() { m_doc.detach(m_slot); }
+
+                        /**
+                          @brief The current version, valid until this reader's next quiescent() or offline().
+                          @returns NULL if nothing has been published yet.
+                         */
+                        const cached_document* get() const
+                        {
+                                return m_doc.m_current.load(std::memory_order_acquire);
+                        }
+
+                        /**
+                          @brief Declare that nothing from get() is in use any more.
+                         */
+                        void quiescent()
+                        {
+                                m_slot->epoch.store(m_doc.m_epoch.load(std::memory_order_acquire), std::memory_order_release);
+                        }
+
+                        /**
+                          @brief Stop holding back reclamation, get() must not be called until online().
+                         */
+                        void offline() { m_slot->epoch.store(0, std::memory_order_release); }
+
+                        void online()
+                        {
+                                // seq_cst, so a writer scanning the slots either sees this or has already swapped
+                                m_slot->epoch.store(m_doc.m_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+                        }
+
+                private:
+                        reader(const reader&);
+                        reader& operator=(const reader&);
+
+                        shared_document& m_doc;
+                        slot* m_slot;
+                };
+
+                explicit shared_document(const parse_options& opts = parse_options())
+                        : m_current(NULL), m_epoch(1), m_opts(opts), m_mutex(), m_slots(), m_retired()
+                {
+                        // readers share the document, content_hash() must not write
+                        m_opts.content_hashes = true;
+                }
+
+                /**
+                  @note Every reader must be gone by now.
+                 */
+                ~shared_document()
+                {
+                        delete m_current.load();
+                        for (size_t i = 0; i < m_retired.size(); i++)
+                                delete m_retired[i].doc;
+                }
+
+                /**
+                  @brief Parse (a copy of) text and make it the current version.
+                  @returns false, leaving the current version in place, if text isn't valid JSON.
+                 */
+                bool publish(subbuffer text)
+                {
+                        std::unique_ptr<cached_document> doc(new cached_document(text, m_opts, hash_bytes(text.begin(), text.length())));
+                        if (!doc->is_valid()) return false;
+                        publish(std::move(doc));
+                        return true;
+                }
+
+                /**
+                  @brief Make doc the current version, it is deleted once no reader can see it any more.
+                 */
+                void publish(std::unique_ptr<cached_document> doc)
+                {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        const cached_document* old = m_current.exchange(doc.release(), std::memory_order_seq_cst);
+                        // a reader that has seen this epoch (or a later one) can only get() the new version
+                        uint64_t e = m_epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+                        if (old)
+                        {
+                                retired r = { old, e };
+                                m_retired.push_back(r);
+                        }
+                        reclaim_locked();
+                }
+
+                /**
+                  @brief Delete the retired versions no reader can see any more, publish() does this too.
+                  @returns The number of versions still waiting.
+                 */
+                size_t reclaim()
+                {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        return reclaim_locked();
+                }
+
+                size_t pending() const
+                {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        return m_retired.size();
+                }
+
+        private:
+                struct retired
+                {
+                        const cached_document* doc;
+                        uint64_t epoch;         //!< readers at this epoch or later are past it
+                };
+
+                shared_document(const shared_document&);
+                shared_document& operator=(const shared_document&);
+
+                slot* attach()
+                {
+                        slot* s = new slot;
+                        {
+                                std::lock_guard<std::mutex> lock(m_mutex);
+                                m_slots.push_back(s);
+                        }
+                        s->epoch.store(m_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+                        return s;
+                }
+
+                void detach(slot* s)
+                {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        for (size_t i = 0; i < m_slots.size(); i++)
+                        {
+                                if (m_slots[i] == s)
+                                {
+                                        m_slots.erase(m_slots.begin() + i);
+                                        break;
+                                }
+                        }
+                        delete s;
+                        reclaim_locked();
+                }
+
+                size_t reclaim_locked()
+                {
+                        uint64_t oldest = UINT64_MAX;
+                        for (size_t i = 0; i < m_slots.size(); i++)
+                        {
+                                uint64_t e = m_slots[i]->epoch.load(std::memory_order_seq_cst);
+                                if (e && e < oldest) oldest = e;
+                        }
+                        size_t kept = 0;
+                        for (size_t i = 0; i < m_retired.size(); i++)
+                        {
+                                if (m_retired[i].epoch <= oldest)
+                                        delete m_retired[i].doc;
+                                else
+                                        m_retired[kept++] = m_retired[i];
+                        }
+                        m_retired.resize(kept);
+                        return kept;
+                }
+
+                std::atomic<const cached_document*> m_current;
+                std::atomic<uint64_t> m_epoch;
+                parse_options m_opts;
+                mutable std::mutex m_mutex;     // writers, attach and detach, never readers
+                std::vector<slot*> m_slots;
+                std::vector<retired> m_retired;
+        };
+}
+
+#endif
@@ -0,0 +1,537 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    json_snapshot.h
+//: \details: A binary image of a parsed document that is used in place, without parsing.
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#ifndef _JSON_SNAPSHOT_H_
+#define _JSON_SNAPSHOT_H_
+
+#include "json_hash.h"
+#include "json_parser.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+
+/**
+  @brief Write a parsed json::root once, then map it and read it with no parsing at all.
+
+  The image is a header, an array of fixed size nodes and a blob with the (still escaped)
+  keys and strings. Numbers are stored already converted, the members of every object are
+  stored next to each other sorted by key so a lookup is a binary search, and the elements
+  of every array are next to each other so indexing is direct. Nothing in it is a pointer,
+  so the file can be used straight from the mapping: opening one only checks the header.
+  Offsets read from the body are checked against the image as they are followed, so a damaged
+  body gives wrong values (UNSET, empty strings) but never a read outside it; verify() checks
+  the body's checksum when that matters.
+
+  @code
+        json::root root(text);
+        json::snapshot::save(root, "ref.snap", "ref.json");
+
+        // at the next start
+        json::snapshot_file snap;
+        if (snap.open("ref.snap", "ref.json"))  // false if missing, the header is damaged or ref.json changed
+                double d = snap.root()["prices"][3].numb();
+  @endcode
+
+  The image is in native byte order and checked to be on load, it is a cache and not an
+  exchange format.
+ */
+
+namespace json
+{
+        struct snapshot_header
+        {
+                char magic[8];
+                uint32_t version;
+                uint32_t byte_order;            //!< 0x01020304 as written
+                uint64_t node_count;
+                uint64_t nodes_offset;
+                uint64_t blob_offset;
+                uint64_t blob_length;
+                uint64_t file_length;
+                uint64_t source_size;           //!< of the JSON file the snapshot was made from, 0 if none
+                int64_t source_mtime_sec;
+                int64_t source_mtime_nsec;
+                uint64_t checksum;              //!< of everything after the header
+        };
+
+        struct snapshot_node
+        {
+                uint8_t type;                   //!< a val_type
+                uint8_t bval;
+                uint16_t reserved;
+                uint32_t key_length;            //!< when the parent is an OBJECT
+                uint32_t key_offset;            //!< into the blob, keys come first and are shared
+                uint32_t count;                 //!< STRING: length, OBJECT/ARRAY: children
+                union
+                {
+                        double dval;
+                        uint64_t offset;        //!< STRING: into the blob, OBJECT/ARRAY: index of the first child
+                } u;
+        };
+
+        class snapshot;
+
+        /**
+          @brief A read only value in a snapshot, the same accessors as a const json::value.
+          @details Missing keys and out of range indexes give an UNSET value.
+         */
+        class snapshot_value
+        {
+        public:
+                snapshot_value() :m_blob(NULL), m_nodes(NULL), m_node(NULL), m_blob_length(0), m_node_count(0) {}
+                snapshot_value(const snapshot_value& rhs) :
+                        m_blob(rhs.m_blob),
+                        m_nodes(rhs.m_nodes),
+                        m_node(rhs.m_node),
+                        m_blob_length(rhs.m_blob_length),
+                        m_node_count(rhs.m_node_count)
+                {}
+                snapshot_value& operator=(const snapshot_value& rhs)
+                {
+                        m_blob = rhs.m_blob;
+                        m_nodes = rhs.m_nodes;
+                        m_node = rhs.m_node;
+                        m_blob_length = rhs.m_blob_length;
+                        m_node_count = rhs.m_node_count;
+                        return *this;
+                }
+
+                inline val_type get_type() const { return m_node ? val_type(m_node->type) : UNSET; }
+                inline bool is_string() const { return get_type() == STRING; }
+                inline bool is_number() const { return get_type() == NUMBER; }
+                inline bool is_bool() const { return get_type() == BOOL; }
+                inline bool is_object() const { return get_type() == OBJECT; }
+                inline bool is_array() const { return get_type() == ARRAY; }
+                inline bool is_unset() const { return get_type() == UNSET; }
+
+                /**
+                  @brief The number of members of an OBJECT or elements of an ARRAY.
+                 */
+                inline size_t size() const
+                {
+                        return ((is_object() || is_array()) && has_children()) ? m_node->count : 0;
+                }
+
+                /**
+                  @brief Look up an (escaped) key in an OBJECT.
+                 */
+                snapshot_value operator[] (subbuffer key) const
+                {
+                        const snapshot_node* n = find(key);
+                        return n ? child(n) : snapshot_value();
+                }
+
+                snapshot_value operator[] (size_t idx) const
+                {
+                        if (idx >= size()) return snapshot_value();
+                        return child(m_nodes + m_node->u.offset + idx);
+                }
+
+                /**
+                  @brief true for a member with a null value too, unlike !(*this)[key].is_unset().
+                 */
+                inline bool exists(subbuffer key) const { return find(key) != NULL; }
+
+                /**
+                  @brief The key of an OBJECT member (e.g. one reached by index), still escaped.
+                 */
+                inline subbuffer key() const
+                {
+                        if (!m_node || !m_node->key_length) return subbuffer(0, 0);
+                        return blob(m_node->key_offset, m_node->key_length);
+                }
+
+                /**
+                  @returns The still escaped text of a STRING, "true" or "false" for a BOOL.
+                 */
+                inline subbuffer str() const
+                {
+                        if (is_string()) return blob(m_node->u.offset, m_node->count);
+                        if (is_bool()) return m_node->bval ? "true" : "false";
+                        return subbuffer(0, 0);
+                }
+
+                inline double numb(double default_val = 0.0) const
+                {
+                        if (is_number()) return m_node->u.dval;
+                        if (is_bool()) return m_node->bval ? 1.0 : 0.0;
+                        return default_val;
+                }
+
+                inline bool bval() const { return is_bool() && m_node->bval; }
+
+                template <typename BUFF>
+                subbuffer unescape(BUFF& dest) const
+                {
+                        dest.clear();
+                        if (is_bool())
+                                dest.assign(m_node->bval ? "true" : "false");
+                        else if (is_string())
+                                scan::unescape(str(), dest);
+                        return subbuffer(dest.c_str(), dest.length());
+                }
+
+                /**
+                  @brief The order members are stored (and searched) in.
+                 */
+                static int compare(subbuffer a, subbuffer b)
+                {
+                        int cmp = memcmp(a.begin(), b.begin(), std::min(a.length(), b.length()));
+                        if (cmp) return cmp;
+                        return a.length() < b.length() ? -1 : (a.length() > b.length() ? 1 : 0);
+                }
+
+        private:
+                friend class snapshot;
+
+                // binary search of the sorted members
+                const snapshot_node* find(subbuffer key) const
+                {
+                        if (!is_object() || !has_children()) return NULL;
+                        const snapshot_node* first = m_nodes + m_node->u.offset;
+                        const snapshot_node* last = first + m_node->count;
+                        while (first < last)
+                        {
+                                const snapshot_node* mid = first + (last - first) / 2;
+                                int cmp = compare(blob(mid->key_offset, mid->key_length), key);
+                                if (cmp == 0) return mid;
+                                if (cmp < 0)
+                                        first = mid + 1;
+                                else
+                                        last = mid;
+                        }
+                        return NULL;
+                }
+
+                snapshot_value(const char* blob, uint64_t blob_length, const snapshot_node* nodes, uint64_t node_count,
+                               const snapshot_node* node) :
+                        m_blob(blob),
+                        m_nodes(nodes),
+                        m_node(node),
+                        m_blob_length(blob_length),
+                        m_node_count(node_count)
+                {}
+
+                snapshot_value child(const snapshot_node* node) const
+                {
+                        return snapshot_value(m_blob, m_blob_length, m_nodes, m_node_count, node);
+                }
+
+                // the children of a container are inside the node array
+                bool has_children() const
+                {
+                        return m_node->u.offset <= m_node_count && m_node->count <= m_node_count - m_node->u.offset;
+                }
+
+                // text in the blob, empty if the offsets point outside it
+                subbuffer blob(uint64_t offset, uint64_t length) const
+                {
+                        if (offset > m_blob_length || length > m_blob_length - offset) return subbuffer(0, 0);
+                        return subbuffer(m_blob + offset, length);
+                }
+
+                const char* m_blob;
+                const snapshot_node* m_nodes;
+                const snapshot_node* m_node;
+                uint64_t m_blob_length;
+                uint64_t m_node_count;
+        };
+
+        /**
+          @brief A snapshot image in memory, see snapshot_file for one that is mapped from disk.
+         */
+        class snapshot
+        {
+        public:
+                static const uint32_t VERSION = 1;
+
+                snapshot() :m_header(NULL), m_nodes(NULL), m_blob(NULL) {}
+
+                /**
+                  @brief Use image (which must outlive this) as the document. Only the header is checked.
+                  @returns false if it isn't a snapshot of this version and byte order, or is truncated.
+                 */
+                bool load(subbuffer image)
+                {
+                        m_header = NULL;
+                        m_nodes = NULL;
+                        m_blob = NULL;
+                        if (image.length() < sizeof(snapshot_header) || (uintptr_t(image.begin()) & 7)) return false;
+                        const snapshot_header* h = reinterpret_cast<const snapshot_header*>(image.begin());
+                        if (memcmp(h->magic, magic(), sizeof(h->magic)) || h->version != VERSION || h->byte_order != 0x01020304)
+                                return false;
+                        if (h->file_length != image.length() || h->node_count == 0 ||
+                            h->nodes_offset != sizeof(snapshot_header) ||
+                            h->node_count > (image.length() - h->nodes_offset) / sizeof(snapshot_node) ||
+                            h->blob_offset != h->nodes_offset + h->node_count * sizeof(snapshot_node) ||
+                            h->blob_length != image.length() - h->blob_offset)
+                                return false;
+                        m_header = h;
+                        m_nodes = reinterpret_cast<const snapshot_node*>(image.begin() + h->nodes_offset);
+                        m_blob = image.begin() + h->blob_offset;
+                        return true;
+                }
+
+                /**
+                  @brief Recompute the checksum, this reads the whole image.
+                 */
+                bool verify() const
+                {
+                        if (!m_header) return false;
+                        const char* body = reinterpret_cast<const char*>(m_header) + sizeof(snapshot_header);
+                        return hash_bytes(body, m_header->file_length - sizeof(snapshot_header)) == m_header->checksum;
+                }
+
+                bool is_loaded() const { return m_header != NULL; }
+                const snapshot_header* header() const { return m_header; }
+
+                snapshot_value root() const
+                {
+                        if (!m_header) return snapshot_value();
+                        return snapshot_value(m_blob, m_header->blob_length, m_nodes, m_header->node_count, m_nodes);
+                }
+
+                /**
+                  @brief Write the image of v to out.
+                  @param [in] source The stat of the file v was parsed from, recorded so a stale snapshot can be spotted.
+                  @returns false if the document is too big for the format (over 4GB of keys).
+                 */
+                static bool build(const value& v, std::string& out, const struct stat* source = NULL)
+                {
+                        std::vector<snapshot_node> nodes;
+                        std::vector<subbuffer> keys;
+                        std::vector<subbuffer> strings;
+                        std::map<subbuffer, uint32_t> key_index;
+
+                        // breadth first so the children of every container are next to each other
+                        std::vector<const value*> order;
+                        std::vector<std::pair<subbuffer, const value*> > members;
+                        order.push_back(&v);
+                        nodes.push_back(snapshot_node());
+                        for (size_t i = 0; i < order.size(); i++)
+                        {
+                                const value& cur = *order[i];
+                                snapshot_node n = nodes[i];
+                                n.type = uint8_t(cur.m_type);
+                                switch (cur.m_type)
+                                {
+                                case NUMBER:
+                                        n.u.dval = cur.m_val.dval;
+                                        break;
+                                case BOOL:
+                                        n.bval = cur.m_val.bval;
+                                        break;
+                                case STRING:
+                                        n.count = uint32_t(cur.m_len);
+                                        n.u.offset = strings.size();
+                                        strings.push_back(cur.sval());
+                                        break;
+                                case OBJECT:
+                                {
+                                        members.clear();
+                                        const object& o = *cur.m_val.oval;
+                                        for (object::const_iterator iter = o.begin(); iter != o.end(); ++iter)
+                                                members.push_back(std::make_pair(iter->first, &iter->second));
+                                        std::sort(members.begin(), members.end(), member_less);
+                                        n.count = uint32_t(members.size());
+                                        n.u.offset = nodes.size();
+                                        for (size_t j = 0; j < members.size(); j++)
+                                        {
+                                                snapshot_node child = snapshot_node();
+                                                std::map<subbuffer, uint32_t>::iterator k = key_index.find(members[j].first);
+                                                if (k == key_index.end())
+                                                {
+                                                        k = key_index.insert(std::make_pair(members[j].first, uint32_t(keys.size()))).first;
+                                                        keys.push_back(members[j].first);
+                                                }
+                                                // the key's index for now, its offset once the blob is laid out
+                                                child.key_offset = k->second;
+                                                child.key_length = uint32_t(members[j].first.length());
+                                                nodes.push_back(child);
+                                                order.push_back(members[j].second);
+                                        }
+                                        break;
+                                }
+                                case ARRAY:
+                                {
+                                        const std::vector<value>& a = static_cast<const array*>(cur.m_val.aval)->values();
+                                        n.count = uint32_t(a.size());
+                                        n.u.offset = nodes.size();
+                                        nodes.resize(nodes.size() + a.size(), snapshot_node());
+                                        for (size_t j = 0; j < a.size(); j++)
+                                                order.push_back(&a[j]);
+                                        break;
+                                }
+                                default:
+                                        break;
+                                }
+                                nodes[i] = n;
+                        }
+
+                        // the blob: every distinct key, then every string
+                        std::vector<uint64_t> key_offsets(keys.size());
+                        uint64_t blob_length = 0;
+                        for (size_t i = 0; i < keys.size(); i++)
+                        {
+                                key_offsets[i] = blob_length;
+                                blob_length += keys[i].length();
+                        }
+                        if (blob_length > 0xFFFFFFFFull) return false;
+                        std::vector<uint64_t> string_offsets(strings.size());
+                        for (size_t i = 0; i < strings.size(); i++)
+                        {
+                                string_offsets[i] = blob_length;
+                                blob_length += strings[i].length();
+                        }
+
+                        snapshot_header h = snapshot_header();
+                        memcpy(h.magic, magic(), sizeof(h.magic));
+                        h.version = VERSION;
+                        h.byte_order = 0x01020304;
+                        h.node_count = nodes.size();
+                        h.nodes_offset = sizeof(snapshot_header);
+                        h.blob_offset = h.nodes_offset + nodes.size() * sizeof(snapshot_node);
+                        h.blob_length = blob_length;
+                        h.file_length = h.blob_offset + blob_length;
+                        if (source)
+                        {
+                                h.source_size = source->st_size;
+                                h.source_mtime_sec = source->st_mtim.tv_sec;
+                                h.source_mtime_nsec = source->st_mtim.tv_nsec;
+                        }
+
+                        for (size_t i = 0; i < nodes.size(); i++)
+                        {
+                                snapshot_node& n = nodes[i];
+                                if (n.key_length) n.key_offset = uint32_t(key_offsets[n.key_offset]);
+                                if (n.type == STRING) n.u.offset = string_offsets[n.u.offset];
+                        }
+
+                        out.resize(h.file_length);
+                        char* p = &out[0] + sizeof(snapshot_header);
+                        memcpy(p, &nodes[0], nodes.size() * sizeof(snapshot_node));
+                        p += nodes.size() * sizeof(snapshot_node);
+                        for (size_t i = 0; i < keys.size(); i++)
+                        {
+                                memcpy(p, keys[i].begin(), keys[i].length());
+                                p += keys[i].length();
+                        }
+                        for (size_t i = 0; i < strings.size(); i++)
+                        {
+                                memcpy(p, strings[i].begin(), strings[i].length());
+                                p += strings[i].length();
+                        }
+                        h.checksum = hash_bytes(out.data() + sizeof(snapshot_header), h.file_length - sizeof(snapshot_header));
+                        memcpy(&out[0], &h, sizeof(h));
+                        return true;
+                }
+
+                /**
+                  @brief Build the image of v and write it to path.
+                  @param [in] source_path The file v was parsed from, so snapshot_file::open can tell when it changed.
+                 */
+                static bool save(const value& v, const char* path, const char* source_path = NULL)
+                {
+                        struct stat st;
+                        if (source_path && ::stat(source_path, &st) != 0) return false;
+                        std::string image;
+                        if (!build(v, image, source_path ? &st : NULL)) return false;
+
+                        // write a temporary and rename it so a reader never maps half a file
+                        std::string tmp(path);
+                        tmp += ".tmp";
+                        FILE* f = fopen(tmp.c_str(), "wb");
+                        if (!f) return false;
+                        bool ok = fwrite(image.data(), 1, image.length(), f) == image.length();
+                        ok = (fclose(f) == 0) && ok;
+                        if (ok) ok = ::rename(tmp.c_str(), path) == 0;
+                        if (!ok) ::unlink(tmp.c_str());
+                        return ok;
+                }
+
+        private:
+                snapshot(const snapshot&);
+                snapshot& operator=(const snapshot&);
+
+                static bool member_less(const std::pair<subbuffer, const value*>& a, const std::pair<subbuffer, const value*>& b)
+                {
+                        return snapshot_value::compare(a.first, b.first) < 0;
+                }
+
+                static const char* magic() { return "JSNAPSHT"; }
+
+                const snapshot_header* m_header;
+                const snapshot_node* m_nodes;
+                const char* m_blob;
+        };
+
+        /**
+          @brief A snapshot mapped from a file.
+         */
+        class snapshot_file : public snapshot
+        {
+        public:
+                snapshot_file() :snapshot(), m_file() {}
+
+                /**
+                  @param [in] source_path If given, the JSON file the snapshot was made from. The snapshot
+                              is refused when that file's size or modification time changed since.
+                  @returns false if the file is missing, its header isn't a valid snapshot's or it is stale.
+                 */
+                bool open(const char* path, const char* source_path = NULL)
+                {
+                        if (!m_file.open(path, MADV_RANDOM) || !load(m_file.contents()))
+                        {
+                                m_file.close();
+                                return false;
+                        }
+                        if (source_path && !is_current(source_path))
+                        {
+                                load(subbuffer());
+                                m_file.close();
+                                return false;
+                        }
+                        return true;
+                }
+
+                /**
+                  @returns true if source_path has the size and modification time recorded in the snapshot.
+                 */
+                bool is_current(const char* source_path) const
+                {
+                        struct stat st;
+                        const snapshot_header* h = header();
+                        if (!h || ::stat(source_path, &st) != 0) return false;
+                        return uint64_t(st.st_size) == h->source_size && st.st_mtim.tv_sec == h->source_mtime_sec &&
+                               st.st_mtim.tv_nsec == h->source_mtime_nsec;
+                }
+
+        private:
+                mapped_file m_file;
+        };
+}
+
+#endif
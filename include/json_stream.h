@@ -0,0 +1,402 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    json_stream.h
+//: \details: Writes JSON text through a fixed size buffer to a fd, FILE* or callback.
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#ifndef _JSON_STREAM_H_
+#define _JSON_STREAM_H_
+
+#include "json.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+/**
+ * @brief Streams JSON text out as it is built.
+ *
+ * json_object and json_array hold everything in memory until to_string is called.
+ * json_stream writes into a fixed size buffer and flushes it to the destination every
+ * time it fills up, so memory use is bounded by the buffer size no matter how much
+ * JSON is produced.
+ *
+ * json_stream js(fileno(stdout));
+ * js.begin_array();
+ * for (...)
+ * {
+ *         js.begin_object();
+ *         js.add("id", id);
+ *         js.key("tags").begin_array().value("a").value("b").end_array();
+ *         js.end_object();
+ * }
+ * js.end_array();
+ * js.flush();
+ *
+ * json_stream can also be passed anywhere a BUFF is expected (it has append and +=),
+ * e.g. json_object::to_string(js).
+ */
+class json_stream
+{
+public:
+        /**
+         * @brief Destination for the callback constructor.
+         * @returns false to stop the stream, good() will return false from then on.
+         */
+        typedef bool (*flush_func)(const char* p, size_t len, void* ctx);
+
+        static const size_t DEFAULT_BUFFER_SIZE = 64 * 1024;
+
+        explicit json_stream(int fd, size_t buff_size = DEFAULT_BUFFER_SIZE):
+                m_buff(new char[buff_size ? buff_size : 1]),
+                m_size(buff_size ? buff_size : 1),
+                m_used(0),
+                m_sink(FD_SINK),
+                m_fd(fd),
+                m_fp(NULL),
+                m_func(NULL),
+                m_ctx(NULL),
+                m_good(true),
+                m_flushed(0),
+                m_stack(),
+                m_need_comma(false)
+        {}
+
+        explicit json_stream(FILE* fp, size_t buff_size = DEFAULT_BUFFER_SIZE):
+                m_buff(new char[buff_size ? buff_size : 1]),
+                m_size(buff_size ? buff_size : 1),
+                m_used(0),
+                m_sink(FILE_SINK),
+                m_fd(-1),
+                m_fp(fp),
+                m_func(NULL),
+                m_ctx(NULL),
+                m_good(fp != NULL),
+                m_flushed(0),
+                m_stack(),
+                m_need_comma(false)
+        {}
+
+        json_stream(flush_func func, void* ctx, size_t buff_size = DEFAULT_BUFFER_SIZE):
+                m_buff(new char[buff_size ? buff_size : 1]),
+                m_size(buff_size ? buff_size : 1),
+                m_used(0),
+                m_sink(FUNC_SINK),
+                m_fd(-1),
+                m_fp(NULL),
+                m_func(func),
+                m_ctx(ctx),
+                m_good(func != NULL),
+                m_flushed(0),
+                m_stack(),
+                m_need_comma(false)
+        {}
+
+        /**
+         * @brief Flushes whatever is left in the buffer.
+         */
+        ~json_stream()
+        {
+                flush();
+                delete [] m_buff;
+        }
+
+        json_stream& begin_object()
+        {
+                separate();
+                *this += '{';
+                m_stack += '{';
+                m_need_comma = false;
+                return *this;
+        }
+
+        json_stream& begin_object(subbuffer name) { return key(name).begin_object(); }
+
+        json_stream& end_object() { return end('}'); }
+
+        json_stream& begin_array()
+        {
+                separate();
+                *this += '[';
+                m_stack += '[';
+                m_need_comma = false;
+                return *this;
+        }
+
+        json_stream& begin_array(subbuffer name) { return key(name).begin_array(); }
+
+        json_stream& end_array() { return end(']'); }
+
+        /**
+         * @brief Write the key of the next key/value pair in the current object.
+         */
+        json_stream& key(subbuffer name)
+        {
+                separate();
+                *this += '\"';
+                json_object::json_friendly::append(*this, name);
+                append("\":", 2);
+                m_need_comma = false;
+                return *this;
+        }
+
+        json_stream& value(subbuffer val, bool quote_it = true)
+        {
+                separate();
+                if (quote_it || val.empty())
+                {
+                        *this += '\"';
+                        json_object::json_friendly::append(*this, val);
+                        *this += '\"';
+                }
+                else
+                        append(val.begin(), val.length());
+                m_need_comma = true;
+                return *this;
+        }
+
+        json_stream& value(const char* val) { return value(subbuffer(val)); }
+
+        json_stream& value(int32_t val) { return value(int64_t(val)); }
+        json_stream& value(uint32_t val) { return value(uint64_t(val)); }
+
+        json_stream& value(int64_t val)
+        {
+                separate();
+                char buff[NTOA_BUFF_SIZE];
+                append(buff, ntoa(val, buff));
+                m_need_comma = true;
+                return *this;
+        }
+
+        json_stream& value(uint64_t val)
+        {
+                separate();
+                char buff[NTOA_BUFF_SIZE];
+                append(buff, ntoa(val, buff));
+                m_need_comma = true;
+                return *this;
+        }
+
+        /**
+         * @brief Write a double value
+         * @param [in] num_desc DTOA_SHORTEST (default) for the shortest text that reads back as the same double,
+         *                      or the number of places after the decimal point to keep (MAX 12)
+         */
+        json_stream& value(double val, int num_desc = DTOA_SHORTEST)
+        {
+                separate();
+                char buff[NTOA_BUFF_SIZE];
+                append(buff, dtoa(val, buff, num_desc));
+                m_need_comma = true;
+                return *this;
+        }
+
+        json_stream& value(bool val)
+        {
+                separate();
+                if (val)
+                        append("true", 4);
+                else
+                        append("false", 5);
+                m_need_comma = true;
+                return *this;
+        }
+
+        json_stream& null_value()
+        {
+                separate();
+                append("null", 4);
+                m_need_comma = true;
+                return *this;
+        }
+
+        json_stream& value(json_object& obj)
+        {
+                separate();
+                obj.to_string(*this);
+                m_need_comma = true;
+                return *this;
+        }
+
+        json_stream& value(json_array& arr)
+        {
+                separate();
+                arr.to_string(*this);
+                m_need_comma = true;
+                return *this;
+        }
+
+        /**
+         * @brief Write anything that has a "write(BUFF&) const" method, e.g. a parsed json::value.
+         */
+        template<typename T> json_stream& write(const T& val)
+        {
+                separate();
+                val.write(*this);
+                m_need_comma = true;
+                return *this;
+        }
+
+        // The same add() calls as json_object and json_array
+
+        json_stream& add(subbuffer name, subbuffer val, bool quote_it = true) { return key(name).value(val, quote_it); }
+        json_stream& add(subbuffer name, const char* val) { return key(name).value(val); }
+        json_stream& add(subbuffer name, int32_t val) { return key(name).value(val); }
+        json_stream& add(subbuffer name, uint32_t val) { return key(name).value(val); }
+        json_stream& add(subbuffer name, int64_t val) { return key(name).value(val); }
+        json_stream& add(subbuffer name, uint64_t val) { return key(name).value(val); }
+        json_stream& add(subbuffer name, double val, int num_desc = DTOA_SHORTEST) { return key(name).value(val, num_desc); }
+        json_stream& add(subbuffer name, bool val) { return key(name).value(val); }
+        json_stream& add(subbuffer name, json_object& obj) { return key(name).value(obj); }
+        json_stream& add(subbuffer name, json_array& arr) { return key(name).value(arr); }
+
+        json_stream& add(subbuffer val) { return value(val); }
+        json_stream& add(const char* val) { return value(val); }
+        json_stream& add(int32_t val) { return value(val); }
+        json_stream& add(uint32_t val) { return value(val); }
+        json_stream& add(int64_t val) { return value(val); }
+        json_stream& add(uint64_t val) { return value(val); }
+        json_stream& add(double val, int num_desc = DTOA_SHORTEST) { return value(val, num_desc); }
+        json_stream& add(bool val) { return value(val); }
+        json_stream& add(json_object& obj) { return value(obj); }
+        json_stream& add(json_array& arr) { return value(arr); }
+
+        /**
+         * @brief Raw output, no separators or escaping. Flushes as needed.
+         */
+        json_stream& append(const char* p, size_t len)
+        {
+                if (len <= m_size - m_used)
+                {
+                        memcpy(m_buff + m_used, p, len);
+                        m_used += len;
+                        return *this;
+                }
+
+                // fill the buffer, flush it, repeat
+                while (len)
+                {
+                        size_t chunk = std::min(len, m_size - m_used);
+                        memcpy(m_buff + m_used, p, chunk);
+                        m_used += chunk;
+                        p += chunk;
+                        len -= chunk;
+                        if (m_used == m_size) flush();
+                }
+                return *this;
+        }
+
+        json_stream& operator+=(char c)
+        {
+                if (m_used == m_size) flush();
+                m_buff[m_used++] = c;
+                return *this;
+        }
+
+        /**
+         * @brief Send everything in the buffer to the destination.
+         * @returns false if this or any earlier flush failed.
+         */
+        bool flush()
+        {
+                if (!m_used) return m_good;
+                if (m_good)
+                {
+                        switch (m_sink)
+                        {
+                        case FD_SINK:
+                                m_good = write_fd(m_buff, m_used);
+                                break;
+                        case FILE_SINK:
+                                m_good = (fwrite(m_buff, 1, m_used, m_fp) == m_used);
+                                break;
+                        case FUNC_SINK:
+                                m_good = m_func(m_buff, m_used, m_ctx);
+                                break;
+                        }
+                }
+                if (m_good) m_flushed += m_used;
+                m_used = 0;
+                return m_good;
+        }
+
+        /**
+         * @brief false once writing to the destination has failed, all output after that is dropped.
+         */
+        bool good() const { return m_good; }
+
+        /**
+         * @brief Number of bytes produced so far (flushed or still buffered).
+         */
+        size_t length() const { return m_flushed + m_used; }
+
+        /**
+         * @brief Number of objects/arrays that have been begun but not ended.
+         */
+        size_t depth() const { return m_stack.length(); }
+
+private:
+        json_stream(const json_stream&);
+        json_stream& operator=(const json_stream&);
+
+        enum sink_t { FD_SINK, FILE_SINK, FUNC_SINK };
+
+        void separate()
+        {
+                if (m_need_comma) *this += ',';
+        }
+
+        json_stream& end(char close)
+        {
+                if (!m_stack.empty()) m_stack.resize(m_stack.length() - 1);
+                *this += close;
+                m_need_comma = true;
+                return *this;
+        }
+
+        bool write_fd(const char* p, size_t len)
+        {
+                while (len)
+                {
+                        ssize_t wrote = ::write(m_fd, p, len);
+                        if (wrote < 0)
+                        {
+                                if (errno == EINTR) continue;
+                                return false;
+                        }
+                        p += wrote;
+                        len -= wrote;
+                }
+                return true;
+        }
+
+        char* m_buff;
+        size_t m_size;
+        size_t m_used;
+        sink_t m_sink;
+        int m_fd;
+        FILE* m_fp;
+        flush_func m_func;
+        void* m_ctx;
+        bool m_good;
+        size_t m_flushed;
+        std::string m_stack;     //!< One '{' or '[' per open object/array
+        bool m_need_comma;
+};
+
+#endif
@@ -0,0 +1,120 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    mapped_file.h
+//: \details: A read only memory mapping of a whole file.
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include "subbuffer.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+  @brief Maps a file read only, the contents stay valid until close() or destruction.
+
+  @code
+        mapped_file f;
+        if (f.open("big.json", MADV_SEQUENTIAL))
+                json::root root(f.contents());
+  @endcode
+ */
+class mapped_file
+{
+public:
+        mapped_file() :m_data(NULL), m_size(0), m_stat() {}
+        ~mapped_file() { close(); }
+
+        /**
+          @param [in] advice Passed to madvise for the whole mapping, e.g. MADV_SEQUENTIAL.
+          @returns false (with errno set) if the file can not be opened or mapped.
+         */
+        bool open(const char* path, int advice = MADV_NORMAL)
+        {
+                close();
+                int fd = ::open(path, O_RDONLY);
+                if (fd < 0) return false;
+                if (::fstat(fd, &m_stat) != 0)
+                {
+                        ::close(fd);
+                        return false;
+                }
+                m_size = m_stat.st_size;
+                if (m_size)
+                {
+                        void* p = ::mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                        if (p == MAP_FAILED)
+                        {
+                                ::close(fd);
+                                m_size = 0;
+                                return false;
+                        }
+                        m_data = static_cast<const char*>(p);
+                        if (advice != MADV_NORMAL) ::madvise(p, m_size, advice);
+                }
+                else
+                        m_data = "";    // an empty file is open but has nothing to map
+                // the mapping keeps the file alive on its own
+                ::close(fd);
+                return true;
+        }
+
+        void close()
+        {
+                if (m_data && m_size) ::munmap(const_cast<char*>(m_data), m_size);
+                m_data = NULL;
+                m_size = 0;
+        }
+
+        /**
+          @brief Change the access hint for part of the mapping, e.g. MADV_DONTNEED once it has been read.
+         */
+        bool advise(int advice, size_t offset = 0, size_t len = subbuffer::npos)
+        {
+                if (!m_size || offset >= m_size) return false;
+                // madvise wants a page aligned start
+                size_t page = ::sysconf(_SC_PAGESIZE);
+                size_t start = offset & ~(page - 1);
+                if (len > m_size - offset) len = m_size - offset;
+                return ::madvise(const_cast<char*>(m_data) + start, len + (offset - start), advice) == 0;
+        }
+
+        bool is_open() const { return m_data != NULL; }
+        const char* data() const { return m_data; }
+        size_t size() const { return m_size; }
+        subbuffer contents() const { return subbuffer(m_data, m_size); }
+
+        /**
+          @brief The stat of the file when it was opened.
+         */
+        const struct stat& file_stat() const { return m_stat; }
+
+private:
+        mapped_file(const mapped_file&);
+        mapped_file& operator=(const mapped_file&);
+
+        const char* m_data;
+        size_t m_size;
+        struct stat m_stat;
+};
+
+#endif
@@ -0,0 +1,448 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    ntoa.h
+//: \details: Number to alphanumeric conversions, the reverse of aton
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#ifndef NTOA_H
+#define NTOA_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+  @brief Number to text conversions that write straight into the caller's buffer.
+
+  ntoa() formats integers two digits at a time from a digit pair table.
+  dtoa() produces the shortest text that converts back to exactly the same double
+  (Grisu2, Florian Loitsch, "Printing Floating-Point Numbers Quickly and Accurately
+  with Integers"), or uses a fixed number of decimals when asked to.
+
+  Neither function NULL terminates, both return the number of chars written.
+
+  @code
+        char buff[NTOA_BUFF_SIZE];
+        size_t len = ntoa(int64_t(-1234), buff);     // "-1234"
+        len = dtoa(0.1, buff);                        // "0.1"
+        len = dtoa(0.1, buff, 3);                     // "0.100"
+  @endcode
+ */
+
+/// Large enough for any int64_t, uint64_t or shortest double.
+#define NTOA_BUFF_SIZE 32
+
+/// Pass as num_desc to get the shortest round trip representation of a double.
+static const int DTOA_SHORTEST = -1;
+
+static const char s_ntoa_digit_pairs[201] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+static inline size_t ntoa_count_digits(uint64_t val)
+{
+        size_t digits = 1;
+        for (;;)
+        {
+                if (val < 10) return digits;
+                if (val < 100) return digits + 1;
+                if (val < 1000) return digits + 2;
+                if (val < 10000) return digits + 3;
+                val /= 10000;
+                digits += 4;
+        }
+}
+
+/**
+  @brief Write val into dest (at least 20 chars).
+  @returns The number of chars written.
+ */
+static inline size_t ntoa(uint64_t val, char* dest)
+{
+        const size_t len = ntoa_count_digits(val);
+        char* p = dest + len;
+        while (val >= 100)
+        {
+                const size_t pair = size_t(val % 100) * 2;
+                val /= 100;
+                p -= 2;
+                p[0] = s_ntoa_digit_pairs[pair];
+                p[1] = s_ntoa_digit_pairs[pair + 1];
+        }
+        if (val >= 10)
+        {
+                p -= 2;
+                p[0] = s_ntoa_digit_pairs[val * 2];
+                p[1] = s_ntoa_digit_pairs[val * 2 + 1];
+        }
+        else
+                *--p = char('0' + val);
+        return len;
+}
+
+/**
+  @brief Write val into dest (at least 20 chars).
+  @returns The number of chars written.
+ */
+static inline size_t ntoa(int64_t val, char* dest)
+{
+        if (val >= 0) return ntoa(uint64_t(val), dest);
+        *dest = '-';
+        // negate as unsigned so INT64_MIN works
+        return 1 + ntoa(uint64_t(0) - uint64_t(val), dest + 1);
+}
+
+static inline size_t ntoa(uint32_t val, char* dest) { return ntoa(uint64_t(val), dest); }
+static inline size_t ntoa(int32_t val, char* dest) { return ntoa(int64_t(val), dest); }
+
+// Grisu2 internals. You should be looking at dtoa() below.
+namespace ntoa_internal
+{
+        static const uint64_t DP_SIGNIFICAND_MASK = 0x000FFFFFFFFFFFFFULL;
+        static const uint64_t DP_EXPONENT_MASK = 0x7FF0000000000000ULL;
+        static const uint64_t DP_HIDDEN_BIT = 0x0010000000000000ULL;
+        static const int DP_SIGNIFICAND_SIZE = 52;
+        static const int DP_EXPONENT_BIAS = 0x3FF + DP_SIGNIFICAND_SIZE;
+        static const int DP_MIN_EXPONENT = -DP_EXPONENT_BIAS;
+        static const int DIY_SIGNIFICAND_SIZE = 64;
+
+        /**
+          @brief "Do it yourself" floating point, f * 2^e
+         */
+        struct diy_fp
+        {
+                diy_fp() : f(0), e(0) {}
+                diy_fp(uint64_t fp, int exp) : f(fp), e(exp) {}
+
+                explicit diy_fp(double d) : f(0), e(0)
+                {
+                        uint64_t bits;
+                        memcpy(&bits, &d, sizeof(bits));
+                        int biased_e = int((bits & DP_EXPONENT_MASK) >> DP_SIGNIFICAND_SIZE);
+                        uint64_t significand = bits & DP_SIGNIFICAND_MASK;
+                        if (biased_e)
+                        {
+                                f = significand + DP_HIDDEN_BIT;
+                                e = biased_e - DP_EXPONENT_BIAS;
+                        }
+                        else
+                        {
+                                f = significand;
+                                e = DP_MIN_EXPONENT + 1;
+                        }
+                }
+
+                diy_fp operator-(const diy_fp& rhs) const { return diy_fp(f - rhs.f, e); }
+
+                diy_fp operator*(const diy_fp& rhs) const
+                {
+                        unsigned __int128 p = (unsigned __int128)f * rhs.f;
+                        uint64_t h = uint64_t(p >> 64);
+                        uint64_t l = uint64_t(p);
+                        if (l & (uint64_t(1) << 63)) h++; // round
+                        return diy_fp(h, e + rhs.e + 64);
+                }
+
+                diy_fp normalize() const
+                {
+                        int s = __builtin_clzll(f);
+                        return diy_fp(f << s, e - s);
+                }
+
+                diy_fp normalize_boundary() const
+                {
+                        diy_fp res = *this;
+                        while (!(res.f & (DP_HIDDEN_BIT << 1)))
+                        {
+                                res.f <<= 1;
+                                res.e--;
+                        }
+                        res.f <<= (DIY_SIGNIFICAND_SIZE - DP_SIGNIFICAND_SIZE - 2);
+                        res.e = res.e - (DIY_SIGNIFICAND_SIZE - DP_SIGNIFICAND_SIZE - 2);
+                        return res;
+                }
+
+                /**
+                  @brief The boundaries m- and m+ half way to the neighbouring doubles.
+                 */
+                void normalized_boundaries(diy_fp* minus, diy_fp* plus) const
+                {
+                        diy_fp pl = diy_fp((f << 1) + 1, e - 1).normalize_boundary();
+                        diy_fp mi = (f == DP_HIDDEN_BIT) ? diy_fp((f << 2) - 1, e - 2) : diy_fp((f << 1) - 1, e - 1);
+                        mi.f <<= mi.e - pl.e;
+                        mi.e = pl.e;
+                        *plus = pl;
+                        *minus = mi;
+                }
+
+                uint64_t f;
+                int e;
+        };
+
+        /// 10^-348, 10^-340, ..., 10^340 normalized to 64 bit significands
+        static const uint64_t s_cached_powers_f[] = {
+        0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+        0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+        0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+        0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+        0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+        0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+        0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+        0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+        0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+        0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+        0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+        0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+        0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+        0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+        0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+        0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+        0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+        0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+        0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+        0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+        0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+        0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+        0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+        0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+        0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+        0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+        0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+        0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+        0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+        };
+
+        static const int16_t s_cached_powers_e[] = {
+        -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007,  -980,
+         -954,  -927,  -901,  -874,  -847,  -821,  -794,  -768,  -741,  -715,
+         -688,  -661,  -635,  -608,  -582,  -555,  -529,  -502,  -475,  -449,
+         -422,  -396,  -369,  -343,  -316,  -289,  -263,  -236,  -210,  -183,
+         -157,  -130,  -103,   -77,   -50,   -24,     3,    30,    56,    83,
+          109,   136,   162,   189,   216,   242,   269,   295,   322,   348,
+          375,   402,   428,   455,   481,   508,   534,   561,   588,   614,
+          641,   667,   694,   720,   747,   774,   800,   827,   853,   880,
+          907,   933,   960,   986,  1013,  1039,  1066
+        };
+
+        static const uint32_t s_pow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+
+        /**
+          @brief Find a cached power of ten c_k so that e + c_k.e lands in [-60, -32]
+          @param [out] K The decimal exponent of the returned power (negated).
+         */
+        static inline diy_fp get_cached_power(int e, int* K)
+        {
+                double dk = (-61 - e) * 0.30102999566398114 + 347; // dk must be positive, so can do ceiling in positive
+                int k = int(dk);
+                if (dk - k > 0.0) k++;
+
+                unsigned index = unsigned((k >> 3) + 1);
+                *K = -(-348 + int(index << 3)); // decimal exponent no need lookup table
+                return diy_fp(s_cached_powers_f[index], s_cached_powers_e[index]);
+        }
+
+        static inline size_t count_digits32(uint32_t n)
+        {
+                size_t digits = 1;
+                while (digits < 10 && n >= s_pow10[digits]) digits++;
+                return digits;
+        }
+
+        static inline void grisu_round(char* buffer, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w)
+        {
+                while (rest < wp_w && delta - rest >= ten_kappa &&
+                       (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w))
+                {
+                        buffer[len - 1]--;
+                        rest += ten_kappa;
+                }
+        }
+
+        static inline void digit_gen(const diy_fp& W, const diy_fp& Mp, uint64_t delta, char* buffer, int* len, int* K)
+        {
+                const diy_fp one(uint64_t(1) << -Mp.e, Mp.e);
+                const diy_fp wp_w = Mp - W;
+                uint32_t p1 = uint32_t(Mp.f >> -one.e);
+                uint64_t p2 = Mp.f & (one.f - 1);
+                int kappa = int(count_digits32(p1));
+                *len = 0;
+
+                while (kappa > 0)
+                {
+                        uint32_t d = p1 / s_pow10[kappa - 1];
+                        p1 %= s_pow10[kappa - 1];
+                        if (d || *len) buffer[(*len)++] = char('0' + d);
+                        kappa--;
+                        uint64_t tmp = (uint64_t(p1) << -one.e) + p2;
+                        if (tmp <= delta)
+                        {
+                                *K += kappa;
+                                grisu_round(buffer, *len, delta, tmp, uint64_t(s_pow10[kappa]) << -one.e, wp_w.f);
+                                return;
+                        }
+                }
+
+                // kappa == 0
+                for (;;)
+                {
+                        p2 *= 10;
+                        delta *= 10;
+                        char d = char(p2 >> -one.e);
+                        if (d || *len) buffer[(*len)++] = char('0' + d);
+                        p2 &= one.f - 1;
+                        kappa--;
+                        if (p2 < delta)
+                        {
+                                *K += kappa;
+                                int index = -kappa;
+                                grisu_round(buffer, *len, delta, p2, one.f, wp_w.f * (index < 10 ? s_pow10[index] : 0));
+                                return;
+                        }
+                }
+        }
+
+        /**
+          @brief Shortest digits of value (> 0) such that value == digits * 10^K
+         */
+        static inline void grisu2(double value, char* buffer, int* length, int* K)
+        {
+                const diy_fp v(value);
+                diy_fp w_m, w_p;
+                v.normalized_boundaries(&w_m, &w_p);
+
+                const diy_fp c_mk = get_cached_power(w_p.e, K);
+                const diy_fp W = v.normalize() * c_mk;
+                diy_fp Wp = w_p * c_mk;
+                diy_fp Wm = w_m * c_mk;
+                Wm.f++;
+                Wp.f--;
+                digit_gen(W, Wp, Wp.f - Wm.f, buffer, length, K);
+        }
+
+        static inline size_t write_exponent(int K, char* buffer)
+        {
+                char* p = buffer;
+                if (K < 0)
+                {
+                        *p++ = '-';
+                        K = -K;
+                }
+                else
+                        *p++ = '+';
+                return (p - buffer) + ntoa(uint32_t(K), p);
+        }
+
+        /**
+          @brief Place the decimal point (and exponent if needed) in the digits produced by grisu2.
+          Uses plain decimal notation for 1e-6 <= value < 1e21, exponents otherwise.
+         */
+        static inline size_t prettify(char* buffer, int length, int k)
+        {
+                const int kk = length + k; // 10^(kk-1) <= v < 10^kk
+
+                if (0 <= k && kk <= 21)
+                {
+                        // 1234e7 -> 12340000000
+                        for (int i = length; i < kk; i++)
+                                buffer[i] = '0';
+                        return size_t(kk);
+                }
+                else if (0 < kk && kk <= 21)
+                {
+                        // 1234e-2 -> 12.34
+                        memmove(&buffer[kk + 1], &buffer[kk], size_t(length - kk));
+                        buffer[kk] = '.';
+                        return size_t(length + 1);
+                }
+                else if (-6 < kk && kk <= 0)
+                {
+                        // 1234e-6 -> 0.001234
+                        const int offset = 2 - kk;
+                        memmove(&buffer[offset], &buffer[0], size_t(length));
+                        buffer[0] = '0';
+                        buffer[1] = '.';
+                        for (int i = 2; i < offset; i++)
+                                buffer[i] = '0';
+                        return size_t(length + offset);
+                }
+                else if (length == 1)
+                {
+                        // 1e30
+                        buffer[1] = 'e';
+                        return 2 + write_exponent(kk - 1, &buffer[2]);
+                }
+
+                // 1234e30 -> 1.234e33
+                memmove(&buffer[2], &buffer[1], size_t(length - 1));
+                buffer[1] = '.';
+                buffer[length + 1] = 'e';
+                return size_t(length + 2) + write_exponent(kk - 1, &buffer[length + 2]);
+        }
+}
+
+/**
+  @brief Write val into dest (at least NTOA_BUFF_SIZE chars, or enough for the fixed format).
+  @param [in] num_desc DTOA_SHORTEST (default) for the shortest text that reads back as exactly val,
+                       otherwise the number of places after the decimal point to keep, as printf("%.*f").
+                       Values too large to print that way in NTOA_BUFF_SIZE chars use the shortest form.
+  @returns The number of chars written.
+  @note NaN and infinity have no JSON representation and are written as null.
+ */
+static inline size_t dtoa(double val, char* dest, int num_desc = DTOA_SHORTEST)
+{
+        if (val != val || val - val != 0.0)
+        {
+                memcpy(dest, "null", 4);
+                return 4;
+        }
+
+        if (num_desc >= 0)
+        {
+                int len = snprintf(dest, NTOA_BUFF_SIZE, "%.*f", num_desc, val);
+                if (len < NTOA_BUFF_SIZE) return size_t(len);
+                // too big for fixed notation in NTOA_BUFF_SIZE, fall back to shortest
+        }
+
+        char* p = dest;
+        if (signbit(val))
+        {
+                *p++ = '-';
+                val = -val;
+        }
+        if (val == 0.0)
+        {
+                *p++ = '0';
+                return p - dest;
+        }
+
+        int length = 0;
+        int K = 0;
+        ntoa_internal::grisu2(val, p, &length, &K);
+        return (p - dest) + ntoa_internal::prettify(p, length, K);
+}
+
+#endif
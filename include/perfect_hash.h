@@ -0,0 +1,222 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    perfect_hash.h
+//: \details: A perfect hash over a set of keys that is known at compile time.
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#ifndef _PERFECT_HASH_H_
+#define _PERFECT_HASH_H_
+
+#if __cplusplus < 201402L
+#error "perfect_hash.h needs C++14 (constexpr loops)"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <stdexcept>
+
+/**
+  @brief Maps each of N keys to its index, with no collisions and no empty slots, built at compile time.
+
+  Hash and displace (CHD): one hash of a key picks its bucket, about 4 keys to a bucket, and two
+  numbers f1 and f2. Buckets are placed largest first, each trying displacements (d0, d1) until
+  slot (f1 + d0 * f2 + d1) % N is free for every key in it, so the last buckets, one key each,
+  always find a slot. Declared constexpr the search happens while compiling and stays within the
+  compiler's constexpr budget for hundreds of keys; a lookup at run time is one hash, two table
+  reads and one compare.
+
+  @code
+        static constexpr const char* keys[] = { "id", "name", "tags" };
+        static constexpr size_t lens[] = { 2, 4, 4 };
+        static constexpr perfect_hash<3> ph(keys, lens);
+        int idx = ph.find(key.begin(), key.length());  // -1 if key isn't one of them
+  @endcode
+ */
+template<size_t N>
+class perfect_hash
+{
+public:
+        static_assert(N > 0 && N < 32768, "perfect_hash takes 1 to 32767 keys");
+
+        static constexpr size_t SLOTS = N;
+        static constexpr size_t BUCKETS = (N + 3) / 4;
+
+        /**
+          @brief FNV-1a with a final mix, seeded. Usable at compile time and at run time.
+         */
+        static constexpr uint64_t hash(const char* p, size_t len, uint64_t seed)
+        {
+                uint64_t h = 14695981039346656037ull ^ seed;
+                for (size_t i = 0; i < len; i++)
+                {
+                        h ^= uint8_t(p[i]);
+                        h *= 1099511628211ull;
+                }
+                h ^= h >> 33;
+                h *= 0xff51afd7ed558ccdull;
+                return h ^ (h >> 33);
+        }
+
+        constexpr perfect_hash(const char* const (&keys)[N], const size_t (&lens)[N]):
+                m_keys(),
+                m_lens(),
+                m_slots(),
+                m_disp(),
+                m_seed(0)
+        {
+                for (size_t i = 0; i < N; i++)
+                {
+                        m_keys[i] = keys[i];
+                        m_lens[i] = lens[i];
+                }
+                // a seed only fails when two keys get the same bucket, f1 and f2, so few are needed
+                for (uint64_t seed = 1; seed < 64; seed++)
+                {
+                        if (try_seed(seed))
+                        {
+                                m_seed = seed;
+                                return;
+                        }
+                }
+                throw std::logic_error("perfect_hash: no seed found");
+        }
+
+        /**
+          @returns The index of the key or -1 if it isn't one of the keys.
+         */
+        constexpr int find(const char* p, size_t len) const
+        {
+                uint64_t h = hash(p, len, m_seed);
+                const displacement& d = m_disp[bucket(h)];
+                int16_t idx = m_slots[slot(h, d.d0, d.d1)];
+                if (idx < 0 || !same(m_keys[idx], m_lens[idx], p, len)) return -1;
+                return idx;
+        }
+
+        constexpr size_t size() const { return N; }
+        constexpr const char* key(size_t i) const { return m_keys[i]; }
+        constexpr size_t key_length(size_t i) const { return m_lens[i]; }
+
+private:
+        struct displacement
+        {
+                uint16_t d0;
+                uint16_t d1;
+        };
+
+        static constexpr bool same(const char* a, size_t alen, const char* b, size_t blen)
+        {
+                if (alen != blen) return false;
+                for (size_t i = 0; i < alen; i++)
+                        if (a[i] != b[i]) return false;
+                return true;
+        }
+
+        static constexpr size_t bucket(uint64_t h) { return size_t(h >> 40) % BUCKETS; }
+
+        static constexpr size_t slot(uint64_t h, size_t d0, size_t d1)
+        {
+                size_t f1 = size_t(h & 0xfffff) % N;
+                size_t f2 = size_t((h >> 20) & 0xfffff) % N;
+                return (f1 + d0 * f2 + d1) % N;
+        }
+
+        constexpr bool try_seed(uint64_t seed)
+        {
+                // the keys grouped by bucket: those of bucket b are order[start[b]] to order[start[b + 1] - 1]
+                uint64_t hashes[N] = {};
+                size_t start[BUCKETS + 1] = {};
+                size_t order[N] = {};
+                size_t largest = 0;
+                for (size_t i = 0; i < N; i++)
+                {
+                        hashes[i] = hash(m_keys[i], m_lens[i], seed);
+                        start[bucket(hashes[i]) + 1]++;
+                }
+                for (size_t b = 0; b < BUCKETS; b++)
+                {
+                        if (start[b + 1] > largest) largest = start[b + 1];
+                        start[b + 1] += start[b];
+                }
+                size_t fill[BUCKETS] = {};
+                for (size_t i = 0; i < N; i++)
+                {
+                        size_t b = bucket(hashes[i]);
+                        order[start[b] + fill[b]++] = i;
+                }
+
+                for (size_t s = 0; s < N; s++) m_slots[s] = -1;
+                for (size_t b = 0; b < BUCKETS; b++) m_disp[b] = displacement{ 0, 0 };
+                for (size_t n = largest; n > 0; n--)
+                {
+                        for (size_t b = 0; b < BUCKETS; b++)
+                        {
+                                if (start[b + 1] - start[b] == n && !place(hashes, order, start[b], n, m_disp[b]))
+                                        return false;
+                        }
+                }
+                return true;
+        }
+
+        // find d0, d1 that put every key of the bucket in a free slot, and take the slots
+        constexpr bool place(const uint64_t (&hashes)[N], const size_t (&order)[N], size_t first, size_t count, displacement& disp)
+        {
+                const size_t* members = order + first;
+                for (size_t d0 = 0; d0 < N; d0++)
+                {
+                        for (size_t d1 = 0; d1 < N; d1++)
+                        {
+                                size_t k = 0;
+                                for (; k < count; k++)
+                                {
+                                        size_t s = slot(hashes[members[k]], d0, d1);
+                                        if (m_slots[s] >= 0) break;
+                                        m_slots[s] = int16_t(members[k]);
+                                }
+                                if (k == count)
+                                {
+                                        disp.d0 = uint16_t(d0);
+                                        disp.d1 = uint16_t(d1);
+                                        return true;
+                                }
+                                // give back the slots taken so far
+                                for (size_t j = 0; j < k; j++)
+                                        m_slots[slot(hashes[members[j]], d0, d1)] = -1;
+                        }
+                }
+                // the same key twice lands in the same slot whatever the displacement or seed
+                for (size_t i = 0; i < count; i++)
+                        for (size_t j = i + 1; j < count; j++)
+                                if (same(m_keys[members[i]], m_lens[members[i]], m_keys[members[j]], m_lens[members[j]]))
+                                        throw std::logic_error("perfect_hash: the keys are not unique");
+                return false;
+        }
+
+        const char* m_keys[N];
+        size_t m_lens[N];
+        int16_t m_slots[N];
+        displacement m_disp[BUCKETS];
+        uint64_t m_seed;
+};
+
+template<size_t N> constexpr size_t perfect_hash<N>::SLOTS;
+template<size_t N> constexpr size_t perfect_hash<N>::BUCKETS;
+
+#endif
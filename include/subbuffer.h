@@ -439,6 +439,7 @@ public:
          */
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Weffc++"  // ignored because binary_function has non-virtual dtor
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"  // binary_function is deprecated in C++11 and later
         struct caseless_equal_to : std::binary_function <int,int,bool>
         {
 #pragma GCC diagnostic pop                // back to default behaviour
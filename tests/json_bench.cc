@@ -0,0 +1,598 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    json_bench.cc
+//: \details: Parse, lookup, traversal and write throughput over a generated corpus
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+//:   json_bench [--size=BYTES] [--repeat=N] [--shape=NAME] [--parser=json_parser|rapidjson]
+//:
+//:   The corpus comes from a fixed seed so every run (and every machine) measures the same
+//:   text. Each stage is run --repeat times and the fastest run is reported. rapidjson is
+//:   only compared against when cmake found its headers (JSON_BENCH_RAPIDJSON).
+//:
+
+#define JSON_TRACE(fmt, x...) do { } while(0)
+
+#include "json_parser.h"
+
+#ifdef JSON_BENCH_RAPIDJSON
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Weffc++"
+#include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#pragma GCC diagnostic pop
+#endif
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <sys/time.h>
+
+static uint64_t get_microseconds()
+{
+        timeval tv;
+        ::gettimeofday(&tv, 0);
+        return static_cast <uint64_t>((static_cast <uint64_t>(tv.tv_sec) * 1000000)  + tv.tv_usec);
+}
+
+/// xorshift64*, so the corpus doesn't depend on the C library's rand()
+class rng
+{
+public:
+        explicit rng(uint64_t seed) :m_state(seed) {}
+
+        uint64_t next()
+        {
+                m_state ^= m_state >> 12;
+                m_state ^= m_state << 25;
+                m_state ^= m_state >> 27;
+                return m_state * 0x2545F4914F6CDD1Dull;
+        }
+
+        size_t below(size_t n) { return size_t(next() % n); }
+
+private:
+        uint64_t m_state;
+};
+
+static const char* s_words[] = {
+        "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel", "india", "juliet",
+        "kilo", "lima", "mike", "november", "oscar", "papa", "quebec", "romeo", "sierra", "tango"
+};
+
+static void append_words(std::string& out, rng& r, size_t count)
+{
+        for (size_t i = 0; i < count; i++)
+        {
+                if (i) out += ' ';
+                out += s_words[r.below(sizeof(s_words) / sizeof(s_words[0]))];
+        }
+}
+
+/// documents are the lines of text, or all of it when there is only one
+struct corpus
+{
+        corpus() :name(""), text(), docs() {}
+
+        const char* name;
+        std::string text;
+        std::vector<subbuffer> docs;
+
+private:
+        // docs point into text
+        corpus(const corpus&);
+        corpus& operator=(const corpus&);
+};
+
+/// long plain strings
+static void gen_strings(std::string& out, rng& r, size_t size)
+{
+        out += '[';
+        for (size_t i = 0; out.length() < size; i++)
+        {
+                char buff[64];
+                snprintf(buff, sizeof(buff), "%s{\"id\": %zu, \"title\": \"", i ? ",\n" : "", i);
+                out += buff;
+                append_words(out, r, 4);
+                out += "\", \"body\": \"";
+                append_words(out, r, 40);
+                out += "\"}";
+        }
+        out += ']';
+}
+
+/// rows of whole numbers, decimals and exponents
+static void gen_numbers(std::string& out, rng& r, size_t size)
+{
+        out += '[';
+        for (size_t i = 0; out.length() < size; i++)
+        {
+                out += i ? ",\n[" : "[";
+                for (size_t n = 0; n < 32; n++)
+                {
+                        char buff[64];
+                        uint64_t x = r.next();
+                        switch (n % 4)
+                        {
+                        case 0: snprintf(buff, sizeof(buff), "%zu", size_t(x % 100000)); break;
+                        case 1: snprintf(buff, sizeof(buff), "%lld", -(long long)(x % 10000000000ull)); break;
+                        case 2: snprintf(buff, sizeof(buff), "%.6f", double(x % 1000000) / 997); break;
+                        default: snprintf(buff, sizeof(buff), "%.5e", double(x % 1000000) * 1e-9); break;
+                        }
+                        if (n) out += ',';
+                        out += buff;
+                }
+                out += ']';
+        }
+        out += ']';
+}
+
+/// objects and arrays 32 levels deep
+static void gen_nested(std::string& out, rng& r, size_t size)
+{
+        out += '[';
+        for (size_t i = 0; out.length() < size; i++)
+        {
+                if (i) out += ",\n";
+                std::string close;
+                for (size_t d = 0; d < 32; d++)
+                {
+                        if (r.below(3))
+                        {
+                                out += "{\"";
+                                out += s_words[d % 20];
+                                out += "\": ";
+                                close += '}';
+                        }
+                        else
+                        {
+                                out += "[true, ";
+                                close += ']';
+                        }
+                }
+                char buff[32];
+                snprintf(buff, sizeof(buff), "%zu", i);
+                out += buff;
+                out.append(close.rbegin(), close.rend());
+        }
+        out += ']';
+}
+
+/// objects of 100 members, the shape of the old json_parser_test
+static void gen_wide(std::string& out, rng& r, size_t size)
+{
+        out += '[';
+        for (size_t i = 0; out.length() < size; i++)
+        {
+                out += i ? ",\n{" : "{";
+                for (size_t a = 0; a < 100; a++)
+                {
+                        char buff[96];
+                        if (a & 1)
+                                snprintf(buff, sizeof(buff), "%s\"%zu_key_%zu\": %zu", a ? ", " : "", a, i, size_t(r.below(1000000)));
+                        else
+                                snprintf(buff, sizeof(buff), "%s\"%zu_key_%zu\": \"val_%zu_%zu, hello world\"", a ? ", " : "", a, i, a, i);
+                        out += buff;
+                }
+                out += '}';
+        }
+        out += ']';
+}
+
+/// strings where every few characters are an escape
+static void gen_escapes(std::string& out, rng& r, size_t size)
+{
+        static const char* escapes[] = { "\\\"", "\\\\", "\\/", "\\b", "\\f", "\\n", "\\r", "\\t", "\\u00e9", "\\u20ac" };
+        out += '[';
+        for (size_t i = 0; out.length() < size; i++)
+        {
+                out += i ? ",\n\"" : "\"";
+                for (size_t n = 0; n < 40; n++)
+                {
+                        out += s_words[r.below(20)] + r.below(3);
+                        out += escapes[r.below(sizeof(escapes) / sizeof(escapes[0]))];
+                }
+                out += '"';
+        }
+        out += ']';
+}
+
+/// UTF-8 text in several scripts and \u escaped surrogate pairs
+static void gen_unicode(std::string& out, rng& r, size_t size)
+{
+        static const char* text[] = {
+                "\xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82",             // Cyrillic
+                "\xe4\xbd\xa0\xe5\xa5\xbd\xe4\xb8\x96\xe7\x95\x8c",             // CJK
+                "\xce\x9a\xce\xb1\xce\xbb\xce\xb7\xce\xbc\xce\xad\xcf\x81\xce\xb1", // Greek
+                "\xf0\x9f\x98\x80\xf0\x9f\x9a\x80",                             // emoji
+                "\\ud83d\\ude00",                                               // escaped emoji
+                "caf\xc3\xa9"
+        };
+        out += '[';
+        for (size_t i = 0; out.length() < size; i++)
+        {
+                out += i ? ",\n{\"text\": \"" : "{\"text\": \"";
+                for (size_t n = 0; n < 30; n++)
+                {
+                        if (n) out += ' ';
+                        out += text[r.below(sizeof(text) / sizeof(text[0]))];
+                }
+                out += "\"}";
+        }
+        out += ']';
+}
+
+/// a small document per line
+static void gen_small(std::string& out, rng& r, size_t size)
+{
+        for (size_t i = 0; out.length() < size; i++)
+        {
+                char buff[160];
+                snprintf(buff, sizeof(buff), "{\"id\": %zu, \"ok\": %s, \"user\": \"%s\", \"tags\": [\"%s\", \"%s\"], \"score\": %.2f}\n",
+                         i, r.below(2) ? "true" : "false", s_words[r.below(20)], s_words[r.below(20)], s_words[r.below(20)],
+                         double(r.below(10000)) / 100);
+                out += buff;
+        }
+}
+
+static void make_corpus(corpus& c, const char* name, void (*gen)(std::string&, rng&, size_t), size_t size, bool lines)
+{
+        rng r(0x5EED5EED5EED5EEDull);
+        c.name = name;
+        gen(c.text, r, size);
+        c.docs.clear();
+        if (!lines)
+        {
+                c.docs.push_back(subbuffer(c.text));
+                return;
+        }
+        subbuffer rest(c.text);
+        while (!rest.empty())
+        {
+                subbuffer line = rest.before('\n');
+                rest = rest.after('\n');
+                if (!line.empty()) c.docs.push_back(line);
+        }
+}
+
+/// what a traversal saw, to check the parsers agree
+struct tally
+{
+        size_t values;
+        size_t string_bytes;
+        double numbers;
+};
+
+static void report(const corpus& c, const char* parser, const char* stage, uint64_t us)
+{
+        double secs = us ? double(us) / 1e6 : 1e-6;
+        printf("%-8s %-11s %-9s %10.1f MB/s %12.0f docs/s %10lu us\n",
+               c.name, parser, stage, double(c.text.length()) / (1024 * 1024) / secs, double(c.docs.size()) / secs, us);
+}
+
+// ---------------------------------------------------------------------------- json_parser
+
+static void walk(const json::value& v, tally& t)
+{
+        t.values++;
+        if (v.is_object())
+        {
+                const json::object* o = v.to_object();
+                for (json::object::const_iterator iter = o->begin(); iter != o->end(); ++iter)
+                        walk(iter->second, t);
+        }
+        else if (v.is_array())
+        {
+                for (size_t i = 0; i < v.size(); i++)
+                        walk(v[i], t);
+        }
+        else if (v.is_number())
+                t.numbers += v.numb();
+        else if (v.is_string())
+                t.string_bytes += v.str().length();
+}
+
+/// every member of every object, found again by its name
+static size_t lookup(const json::value& v)
+{
+        size_t found = 0;
+        if (v.is_object())
+        {
+                const json::object* o = v.to_object();
+                for (json::object::const_iterator iter = o->begin(); iter != o->end(); ++iter)
+                {
+                        if (o->find(iter->first) == &iter->second) found++;
+                        found += lookup(iter->second);
+                }
+        }
+        else if (v.is_array())
+        {
+                for (size_t i = 0; i < v.size(); i++)
+                        found += lookup(v[i]);
+        }
+        return found;
+}
+
+/// so write() builds every container instead of copying the parsed text
+static void mark_all(json::value& v)
+{
+        if (v.is_object())
+        {
+                v.mark_modified();
+                json::object* o = v.to_object();
+                for (json::object::iterator iter = o->begin(); iter != o->end(); ++iter)
+                        mark_all(iter->second);
+        }
+        else if (v.is_array())
+        {
+                v.mark_modified();
+                for (size_t i = 0; i < v.size(); i++)
+                        mark_all(v[i]);
+        }
+}
+
+static bool bench_json_parser(const corpus& c, size_t repeat, tally& t)
+{
+        uint64_t best = UINT64_MAX;
+        for (size_t pass = 0; pass < repeat; pass++)
+        {
+                uint64_t start = get_microseconds();
+                for (size_t d = 0; d < c.docs.size(); d++)
+                {
+                        json::root r(c.docs[d]);
+                        if (!r.is_valid())
+                        {
+                                fprintf(stderr, "%s: json_parser failed on document %zu\n", c.name, d);
+                                return false;
+                        }
+                }
+                best = std::min(best, get_microseconds() - start);
+        }
+        report(c, "json_parser", "parse", best);
+
+        std::vector<json::root*> roots;
+        for (size_t d = 0; d < c.docs.size(); d++)
+                roots.push_back(new json::root(c.docs[d]));
+
+        size_t found = 0;
+        best = UINT64_MAX;
+        for (size_t pass = 0; pass < repeat; pass++)
+        {
+                found = 0;
+                uint64_t start = get_microseconds();
+                for (size_t d = 0; d < roots.size(); d++)
+                        found += lookup(*roots[d]);
+                best = std::min(best, get_microseconds() - start);
+        }
+        report(c, "json_parser", "lookup", best);
+
+        best = UINT64_MAX;
+        for (size_t pass = 0; pass < repeat; pass++)
+        {
+                t = tally();
+                uint64_t start = get_microseconds();
+                for (size_t d = 0; d < roots.size(); d++)
+                        walk(*roots[d], t);
+                best = std::min(best, get_microseconds() - start);
+        }
+        report(c, "json_parser", "traverse", best);
+
+        for (size_t d = 0; d < roots.size(); d++)
+                mark_all(*roots[d]);
+        std::string out;
+        best = UINT64_MAX;
+        for (size_t pass = 0; pass < repeat; pass++)
+        {
+                uint64_t start = get_microseconds();
+                for (size_t d = 0; d < roots.size(); d++)
+                {
+                        out.clear();
+                        roots[d]->write(out);
+                }
+                best = std::min(best, get_microseconds() - start);
+        }
+        report(c, "json_parser", "write", best);
+
+        for (size_t d = 0; d < roots.size(); d++)
+                delete roots[d];
+        return true;
+}
+
+// ---------------------------------------------------------------------------- rapidjson
+
+#ifdef JSON_BENCH_RAPIDJSON
+static void walk(const rapidjson::Value& v, tally& t)
+{
+        t.values++;
+        if (v.IsObject())
+        {
+                for (rapidjson::Value::ConstMemberIterator iter = v.MemberBegin(); iter != v.MemberEnd(); ++iter)
+                        walk(iter->value, t);
+        }
+        else if (v.IsArray())
+        {
+                for (rapidjson::Value::ConstValueIterator iter = v.Begin(); iter != v.End(); ++iter)
+                        walk(*iter, t);
+        }
+        else if (v.IsNumber())
+                t.numbers += v.GetDouble();
+        else if (v.IsString())
+                t.string_bytes += v.GetStringLength();
+}
+
+static size_t lookup(const rapidjson::Value& v)
+{
+        size_t found = 0;
+        if (v.IsObject())
+        {
+                for (rapidjson::Value::ConstMemberIterator iter = v.MemberBegin(); iter != v.MemberEnd(); ++iter)
+                {
+                        if (v.FindMember(iter->name) == iter) found++;
+                        found += lookup(iter->value);
+                }
+        }
+        else if (v.IsArray())
+        {
+                for (rapidjson::Value::ConstValueIterator iter = v.Begin(); iter != v.End(); ++iter)
+                        found += lookup(*iter);
+        }
+        return found;
+}
+
+static bool bench_rapidjson(const corpus& c, size_t repeat, tally& t)
+{
+        uint64_t best = UINT64_MAX;
+        for (size_t pass = 0; pass < repeat; pass++)
+        {
+                uint64_t start = get_microseconds();
+                for (size_t d = 0; d < c.docs.size(); d++)
+                {
+                        rapidjson::Document doc;
+                        doc.Parse(c.docs[d].begin(), c.docs[d].length());
+                        if (doc.HasParseError())
+                        {
+                                fprintf(stderr, "%s: rapidjson failed on document %zu\n", c.name, d);
+                                return false;
+                        }
+                }
+                best = std::min(best, get_microseconds() - start);
+        }
+        report(c, "rapidjson", "parse", best);
+
+        std::vector<rapidjson::Document*> docs;
+        for (size_t d = 0; d < c.docs.size(); d++)
+        {
+                docs.push_back(new rapidjson::Document);
+                docs.back()->Parse(c.docs[d].begin(), c.docs[d].length());
+        }
+
+        best = UINT64_MAX;
+        for (size_t pass = 0; pass < repeat; pass++)
+        {
+                size_t found = 0;
+                uint64_t start = get_microseconds();
+                for (size_t d = 0; d < docs.size(); d++)
+                        found += lookup(*docs[d]);
+                best = std::min(best, get_microseconds() - start);
+        }
+        report(c, "rapidjson", "lookup", best);
+
+        best = UINT64_MAX;
+        for (size_t pass = 0; pass < repeat; pass++)
+        {
+                t = tally();
+                uint64_t start = get_microseconds();
+                for (size_t d = 0; d < docs.size(); d++)
+                        walk(*docs[d], t);
+                best = std::min(best, get_microseconds() - start);
+        }
+        report(c, "rapidjson", "traverse", best);
+
+        best = UINT64_MAX;
+        for (size_t pass = 0; pass < repeat; pass++)
+        {
+                uint64_t start = get_microseconds();
+                for (size_t d = 0; d < docs.size(); d++)
+                {
+                        rapidjson::StringBuffer sb;
+                        rapidjson::Writer<rapidjson::StringBuffer> w(sb);
+                        docs[d]->Accept(w);
+                }
+                best = std::min(best, get_microseconds() - start);
+        }
+        report(c, "rapidjson", "write", best);
+
+        for (size_t d = 0; d < docs.size(); d++)
+                delete docs[d];
+        return true;
+}
+#endif
+
+int main(int argc, char** argv)
+{
+        size_t size = 4 * 1024 * 1024;
+        size_t repeat = 5;
+        subbuffer shape;
+        subbuffer parser;
+
+        for (int i = 1; i < argc; i++)
+        {
+                subbuffer arg(argv[i]);
+                if (arg.starts_with(CONST_SUBBUF("--size=")))
+                        size = aton<size_t>(arg.after('='));
+                else if (arg.starts_with(CONST_SUBBUF("--repeat=")))
+                        repeat = aton<size_t>(arg.after('='));
+                else if (arg.starts_with(CONST_SUBBUF("--shape=")))
+                        shape = arg.after('=');
+                else if (arg.starts_with(CONST_SUBBUF("--parser=")))
+                        parser = arg.after('=');
+                else
+                {
+                        fprintf(stderr, "usage: %s [--size=BYTES] [--repeat=N] [--shape=NAME] [--parser=json_parser|rapidjson]\n"
+                                "shapes: strings numbers nested wide escapes unicode small\n", argv[0]);
+                        return 1;
+                }
+        }
+        if (!repeat) repeat = 1;
+
+        struct
+        {
+                const char* name;
+                void (*gen)(std::string&, rng&, size_t);
+                bool lines;
+        } shapes[] = {
+                { "strings", gen_strings, false },
+                { "numbers", gen_numbers, false },
+                { "nested", gen_nested, false },
+                { "wide", gen_wide, false },
+                { "escapes", gen_escapes, false },
+                { "unicode", gen_unicode, false },
+                { "small", gen_small, true },
+        };
+
+#ifndef JSON_BENCH_RAPIDJSON
+        if (parser.equals(CONST_SUBBUF("rapidjson")))
+        {
+                fprintf(stderr, "built without rapidjson, rerun cmake with -DRAPIDJSON_INCLUDE_DIR=<dir>\n");
+                return 1;
+        }
+#endif
+
+        bool ok = true;
+        for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++)
+        {
+                if (!shape.empty() && !shape.equals(shapes[s].name)) continue;
+                corpus c;
+                make_corpus(c, shapes[s].name, shapes[s].gen, size, shapes[s].lines);
+                printf("%s: %zu bytes in %zu documents\n", c.name, c.text.length(), c.docs.size());
+
+                tally ours = tally();
+                if (parser.empty() || parser.equals(CONST_SUBBUF("json_parser")))
+                        ok = bench_json_parser(c, repeat, ours) && ok;
+#ifdef JSON_BENCH_RAPIDJSON
+                tally theirs = tally();
+                if (parser.empty() || parser.equals(CONST_SUBBUF("rapidjson")))
+                        ok = bench_rapidjson(c, repeat, theirs) && ok;
+                if (parser.empty() && ours.values != theirs.values)
+                        fprintf(stderr, "%s: json_parser saw %zu values, rapidjson %zu\n", c.name, ours.values, theirs.values);
+#endif
+        }
+        return ok ? 0 : 1;
+}
@@ -0,0 +1,373 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    whitebox_json_bind.cc
+//: \details: Test driver for the JSON to struct binding
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#define JSON_TRACE(fmt, x...) do { } while(0)
+
+#include "json_bind.h"
+#include "json_parser.h"
+#include "wbtest.h"
+
+#include <string>
+#include <vector>
+
+#include <sys/time.h>
+
+struct address
+{
+        address() : city(), zip(0) {}
+
+        std::string city;
+        int32_t zip;
+};
+
+struct person
+{
+        person() : name(), id(0), height(0), active(false), tags(), home(), scores(), nick() {}
+
+        std::string name;
+        int64_t id;
+        double height;
+        bool active;
+        std::vector<std::string> tags;
+        address home;
+        std::vector<address> scores;
+        subbuffer nick;
+};
+
+struct switches
+{
+        switches() : on() {}
+
+        std::vector<bool> on;
+};
+
+JSON_BIND(switches,
+          JSON_FIELD(on, json::REQUIRED))
+
+JSON_BIND(address,
+          JSON_FIELD(city, json::REQUIRED),
+          JSON_FIELD(zip, json::OPTIONAL))
+
+JSON_BIND(person,
+          JSON_FIELD(name, json::REQUIRED),
+          JSON_FIELD_KEY(id, "person_id", json::REQUIRED),
+          JSON_FIELD(height, json::OPTIONAL),
+          JSON_FIELD(active, json::OPTIONAL),
+          JSON_FIELD(tags, json::OPTIONAL),
+          JSON_FIELD(home, json::OPTIONAL),
+          JSON_FIELD_KEY(scores, "others", json::OPTIONAL),
+          JSON_FIELD(nick, json::OPTIONAL))
+
+static uint64_t get_microseconds()
+{
+        timeval tv;
+        ::gettimeofday(&tv, 0);
+        return static_cast <uint64_t>((static_cast <uint64_t>(tv.tv_sec) * 1000000)  + tv.tv_usec);
+}
+
+// k0 to k299, built while compiling, for a hash over a wide schema
+static const size_t WIDE = 300;
+struct wide_names
+{
+        char text[WIDE][8];
+        size_t lens[WIDE];
+        const char* keys[WIDE];
+};
+
+static constexpr wide_names make_wide_names()
+{
+        wide_names n{};
+        for (size_t i = 0; i < WIDE; i++)
+        {
+                char digits[8] = {};
+                size_t len = 0;
+                for (size_t v = i; len == 0 || v; v /= 10) digits[len++] = char('0' + v % 10);
+                n.text[i][0] = 'k';
+                for (size_t j = 0; j < len; j++) n.text[i][1 + j] = digits[len - 1 - j];
+                n.lens[i] = len + 1;
+        }
+        return n;
+}
+
+static constexpr wide_names s_wide_text = make_wide_names();
+
+static constexpr wide_names point_wide_names()
+{
+        wide_names n = s_wide_text;
+        for (size_t i = 0; i < WIDE; i++) n.keys[i] = s_wide_text.text[i];
+        return n;
+}
+
+static constexpr wide_names s_wide = point_wide_names();
+
+static void test_perfect_hash(wbtester& t)
+{
+        static constexpr const char* keys[] = { "id", "name", "tags", "a", "b", "ab", "ba", "height" };
+        static constexpr size_t lens[] = { 2, 4, 4, 1, 1, 2, 2, 6 };
+        static constexpr perfect_hash<8> ph(keys, lens);
+
+        // resolved while compiling
+        static_assert(ph.find("name", 4) == 1, "name");
+        static_assert(ph.find("ba", 2) == 6, "ba");
+        static_assert(ph.find("nam", 3) == -1, "nam");
+
+        for (size_t i = 0; i < 8; i++)
+                t.REQUIRE(ph.find(keys[i], lens[i]) == int(i));
+        t.REQUIRE(ph.find("zz", 2) == -1);
+        t.REQUIRE(ph.find("", 0) == -1);
+
+        // hundreds of keys still fit the compiler's constexpr budget, one slot per key
+        static constexpr perfect_hash<WIDE> wide(s_wide.keys, s_wide.lens);
+        static_assert(wide.find("k299", 4) == 299, "k299");
+        static_assert(perfect_hash<WIDE>::SLOTS == WIDE, "minimal");
+        for (size_t i = 0; i < WIDE; i++)
+                t.REQUIRE(wide.find(s_wide.keys[i], s_wide.lens[i]) == int(i));
+        t.REQUIRE(wide.find("k300", 4) == -1);
+        t.REQUIRE(wide.find("k", 1) == -1);
+}
+
+static void test_bind(wbtester& t)
+{
+        subbuffer text("{\"name\": \"Hal \\\"the\\\" \\u00e9\", \"unknown\": {\"a\": [1, {\"}\": \"]\"}], \"b\": \"\\\\\"}, "
+                       "\"person_id\": 12345678901, \"height\": 1.85e0, \"active\": true, \"tags\": [\"x\", \"y\"],"
+                       "\"home\": {\"city\": \"Akron\", \"zip\": 44301, \"extra\": null}, "
+                       "\"others\": [{\"city\": \"Kent\"}, {\"city\": \"Stow\", \"zip\": -1}], \"nick\": \"h\\\\al\", \"z\": [[]]}");
+        person p;
+        json::bind_result res;
+        t.REQUIRE(json::from_json(text, p, &res));
+        t.REQUIRE(res.error.empty());
+        t.REQUIRE(p.name == "Hal \"the\" \xc3\xa9");
+        t.REQUIRE(p.id == 12345678901LL);
+        t.REQUIRE(p.height == 1.85);
+        t.REQUIRE(p.active);
+        t.REQUIRE(p.tags.size() == 2 && p.tags[1] == "y");
+        t.REQUIRE(p.home.city == "Akron" && p.home.zip == 44301);
+        t.REQUIRE(p.scores.size() == 2 && p.scores[1].city == "Stow" && p.scores[1].zip == -1);
+        t.REQUIRE(p.nick.equals("h\\\\al"));
+
+        // null leaves the member alone
+        person q;
+        q.height = 2.5;
+        t.REQUIRE(json::from_json("{\"name\": \"q\", \"person_id\": 1, \"height\": null, \"tags\": []}", q));
+        t.REQUIRE(q.height == 2.5);
+        t.REQUIRE(q.tags.empty());
+}
+
+static void test_bind_errors(wbtester& t)
+{
+        person p;
+        json::bind_result res;
+        t.REQUIRE(!json::from_json("{\"name\": \"x\", \"home\": {\"zip\": 1}, \"others\": [{}]}", p, &res));
+        t.REQUIRE(res.missing.size() == 3);
+        if (res.missing.size() == 3)
+        {
+                t.REQUIRE(res.missing[0] == "home.city");
+                t.REQUIRE(res.missing[1] == "others.city");
+                t.REQUIRE(res.missing[2] == "person_id");
+        }
+
+        res = json::bind_result();
+        t.REQUIRE(!json::from_json("{\"name\": 5, \"person_id\": 1}", p, &res));
+        t.REQUIRE(res.error == "expected a string");
+        t.REQUIRE(res.offset == 9);
+
+        res = json::bind_result();
+        t.REQUIRE(!json::from_json("{\"name\": \"x\", \"person_id\": 1.5}", p, &res));
+        t.REQUIRE(res.error == "expected an integer");
+
+        res = json::bind_result();
+        t.REQUIRE(!json::from_json("{\"name\": \"x\", \"person_id\": 1} x", p, &res));
+        t.REQUIRE(res.error == "unexpected text after the value");
+
+        t.REQUIRE(!json::from_json("{\"name\": \"x\", \"person_id\": 1, \"skip\": [1, 2}", p));
+        t.REQUIRE(!json::from_json("{\"name\": \"x\" \"person_id\": 1}", p));
+        t.REQUIRE(!json::from_json("", p));
+}
+
+static void test_to_json(wbtester& t)
+{
+        person p;
+        p.name = "Hal \"the\"\n";
+        p.id = -12345678901LL;
+        p.height = 1.85;
+        p.active = true;
+        p.tags.push_back("x");
+        p.tags.push_back("y");
+        p.home.city = "Akron";
+        p.home.zip = 44301;
+        p.scores.resize(1);
+        p.scores[0].city = "Kent";
+        p.nick = subbuffer("h\\\\al");
+
+        std::string out;
+        json::to_json(p, out);
+        t.REQUIRE(out == "{\"name\":\"Hal \\\"the\\\"\\n\",\"person_id\":-12345678901,\"height\":1.85,\"active\":true,"
+                         "\"tags\":[\"x\",\"y\"],\"home\":{\"city\":\"Akron\",\"zip\":44301},"
+                         "\"others\":[{\"city\":\"Kent\",\"zip\":0}],\"nick\":\"h\\\\al\"}");
+
+        // and back again
+        person q;
+        t.REQUIRE(json::from_json(out, q));
+        t.REQUIRE(q.name == p.name && q.id == p.id && q.height == p.height && q.tags == p.tags);
+        t.REQUIRE(q.home.city == "Akron" && q.scores.size() == 1 && q.nick.equals(p.nick));
+
+        // any BUFF works, including a vector at the top
+        std::vector<address> addrs(2);
+        addrs[0].city = "a";
+        addrs[1].city = "b";
+        json_fixed_buffer<64> fixed;
+        json::to_json(addrs, fixed);
+        t.REQUIRE(!fixed.overflowed());
+        t.REQUIRE(subbuffer(fixed.data(), fixed.length()).equals("[{\"city\":\"a\",\"zip\":0},{\"city\":\"b\",\"zip\":0}]"));
+
+        // vector<bool> keeps bits, not bools
+        switches sw;
+        sw.on.push_back(true);
+        sw.on.push_back(false);
+        sw.on.push_back(true);
+        out.clear();
+        json::to_json(sw, out);
+        t.REQUIRE(out == "{\"on\":[true,false,true]}");
+        switches sw2;
+        t.REQUIRE(json::from_json(out, sw2));
+        t.REQUIRE(sw2.on == sw.on);
+        t.REQUIRE(!json::from_json("{\"on\": [true, 1]}", sw2));
+}
+
+static void run_perf_test(uint64_t perf_size)
+{
+        std::string text;
+        json_builder<std::string> jb(text);
+        jb.open_array();
+        for (uint64_t i = 0; i < perf_size; i++)
+        {
+                jb.open_object();
+                jb.add("name", "somebody with a name");
+                jb.add("person_id", i);
+                jb.add("height", 1.5 + i);
+                jb.add("active", (i & 1) == 0);
+                jb.open_array("tags").add("one").add("two").close();
+                jb.open_object("home").add("city", "Akron").add("zip", 44301).close();
+                jb.add("ignored", "something nobody reads");
+                jb.close();
+        }
+        jb.close();
+
+        uint64_t start = get_microseconds();
+        std::vector<person> people;
+        json::from_json(text, people);
+        uint64_t end = get_microseconds();
+        fprintf(stderr, "perf_test, from_json %zu bytes, %zu structs, mic secs: %lu\n", text.length(), people.size(), end - start);
+
+        start = get_microseconds();
+        json::root root(text);
+        std::vector<person> people2(root.size());
+        for (size_t i = 0; i < root.size(); i++)
+        {
+                json::value& v = root[i];
+                person& p = people2[i];
+                v["name"].unescape(p.name);
+                p.id = int64_t(v["person_id"].numb());
+                p.height = v["height"].numb();
+                p.active = v["active"].bval();
+                json::value& tags = v["tags"];
+                p.tags.resize(tags.size());
+                for (size_t t = 0; t < tags.size(); t++)
+                        tags[t].unescape(p.tags[t]);
+                v["home"]["city"].unescape(p.home.city);
+                p.home.zip = int32_t(v["home"]["zip"].numb());
+        }
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, json::root + copy %zu bytes, %zu structs, mic secs: %lu\n", text.length(), people2.size(), end - start);
+
+        std::string out;
+        json::to_json(people, out);
+        out.clear();
+        start = get_microseconds();
+        json::to_json(people, out);
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, to_json %zu structs, %zu bytes, mic secs: %lu\n", people.size(), out.length(), end - start);
+
+        std::string out2;
+        start = get_microseconds();
+        json_array arr;
+        json_object obj;
+        json_array tags;
+        json_object home;
+        for (size_t i = 0; i < people.size(); i++)
+        {
+                const person& p = people[i];
+                obj.clear();
+                obj.add("name", p.name);
+                obj.add("person_id", p.id);
+                obj.add("height", p.height);
+                obj.add("active", p.active);
+                tags.clear();
+                for (size_t t = 0; t < p.tags.size(); t++)
+                        tags.add(p.tags[t]);
+                obj.add("tags", tags);
+                home.clear();
+                home.add("city", p.home.city);
+                home.add("zip", p.home.zip);
+                obj.add("home", home);
+                arr.add(obj);
+        }
+        arr.to_string(out2);
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, json_object chains %zu structs, %zu bytes, mic secs: %lu\n", people.size(), out2.length(), end - start);
+
+        std::string copy(out);
+        copy.clear();
+        start = get_microseconds();
+        copy.append(out.data(), out.length());
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, memcpy %zu bytes, mic secs: %lu\n", copy.length(), end - start);
+}
+
+int main(int argc, char** argv)
+{
+        bool do_perf = false;
+        uint64_t perf_size = 100000;
+
+        for (int i = 1; i < argc; i++)
+        {
+                subbuffer arg(argv[i]);
+                if (arg.equals(CONST_SUBBUF("--perf")))
+                        do_perf = true;
+                else if (arg.starts_with(CONST_SUBBUF("--perf-size=")))
+                        perf_size = aton<uint64_t>(arg.after('='));
+        }
+
+        if (do_perf)
+        {
+                run_perf_test(perf_size);
+                return 0;
+        }
+
+        wbtester t;
+
+        t.ADD_TEST(test_perfect_hash);
+        t.ADD_TEST(test_bind);
+        t.ADD_TEST(test_bind_errors);
+        t.ADD_TEST(test_to_json);
+
+        return t.run();
+}
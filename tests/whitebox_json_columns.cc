@@ -0,0 +1,250 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    whitebox_json_columns.cc
+//: \details: Test driver for NDJSON column extraction
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#define JSON_TRACE(fmt, x...) do { } while(0)
+
+#include "json_columns.h"
+#include "wbtest.h"
+
+#include <string>
+#include <vector>
+
+#include <sys/time.h>
+
+static uint64_t get_microseconds()
+{
+        timeval tv;
+        ::gettimeofday(&tv, 0);
+        return static_cast <uint64_t>((static_cast <uint64_t>(tv.tv_sec) * 1000000)  + tv.tv_usec);
+}
+
+/// rows records, every 7th has no price and every 11th a string id
+static std::string make_records(size_t rows)
+{
+        std::string text;
+        for (size_t i = 0; i < rows; i++)
+        {
+                char buf[256];
+                if (i % 11 == 0)
+                        snprintf(buf, sizeof(buf), "{\"id\": \"%zu\", \"user\": {\"name\": \"u%zu\", \"tags\": [\"a\", \"b%zu\"]}, \"ok\": %s, \"price\": %zu.25}\n",
+                                 i, i % 100, i, (i & 1) ? "true" : "false", i);
+                else if (i % 7 == 0)
+                        snprintf(buf, sizeof(buf), "{\"id\": %zu, \"user\": {\"name\": \"u%zu\", \"tags\": [\"a\", \"b%zu\"]}, \"ok\": %s}\n",
+                                 i, i % 100, i, (i & 1) ? "true" : "false");
+                else
+                        snprintf(buf, sizeof(buf), "{\"id\": %zu, \"user\": {\"name\": \"u%zu\", \"tags\": [\"a\", \"b%zu\"]}, \"ok\": %s, \"price\": %zu.25}\n",
+                                 i, i % 100, i, (i & 1) ? "true" : "false", i);
+                text += buf;
+        }
+        return text;
+}
+
+static void test_types(wbtester& t)
+{
+        const char* text =
+                "{\"a\": 1.5, \"b\": 7, \"c\": \"x\", \"d\": true, \"e\": {\"f\": [10, 20]}}\n"
+                "\n"
+                "  {\"a\": \"no\", \"b\": 7.5, \"c\": 3, \"d\": null, \"e\": {\"f\": [10]}}\r\n"
+                "{\"e\": {\"f\": [1, 2]}, \"d\": false, \"c\": \"y\\tz\", \"b\": 1e3, \"a\": -2}\n"
+                "{\"a\": 1, \"a\": 2, \"skip\": {\"deep\": [[{}], \"]\"]}, \"b\": -9}";
+
+        json::ndjson_columns cols;
+        size_t a = cols.add_column("$.a", json::COLUMN_DOUBLE);
+        size_t b = cols.add_column("$.b", json::COLUMN_INT64);
+        size_t c = cols.add_column("$['c']", json::COLUMN_STRING);
+        size_t d = cols.add_column("$.d", json::COLUMN_BOOL);
+        size_t f = cols.add_column("$.e.f[1]", json::COLUMN_INT64);
+        t.REQUIRE(cols.columns() == 5);
+        t.REQUIRE(cols.extract(text, 1) == 4);
+        t.REQUIRE(cols.rows() == 4);
+        t.REQUIRE(cols.errors() == 0);
+        t.REQUIRE(cols[a].name() == "$.a");
+        t.REQUIRE(cols[a].size() == 4);
+
+        t.REQUIRE(!cols[a].is_null(0) && cols[a].doubles()[0] == 1.5);
+        t.REQUIRE(cols[a].is_null(1) && cols[a].doubles()[1] == 0);
+        t.REQUIRE(!cols[a].is_null(2) && cols[a].doubles()[2] == -2);
+        t.REQUIRE(cols[a].doubles()[3] == 1);
+
+        t.REQUIRE(cols[b].ints()[0] == 7);
+        t.REQUIRE(cols[b].is_null(1));
+        t.REQUIRE(!cols[b].is_null(2) && cols[b].ints()[2] == 1000);
+        t.REQUIRE(cols[b].ints()[3] == -9);
+
+        t.REQUIRE(cols[c].strings()[0].equals(CONST_SUBBUF("x")));
+        t.REQUIRE(cols[c].is_null(1));
+        t.REQUIRE(cols[c].strings()[2].equals(CONST_SUBBUF("y\\tz")));
+        t.REQUIRE(cols[c].is_null(3));
+
+        t.REQUIRE(!cols[d].is_null(0) && cols[d].bools()[0] == 1);
+        t.REQUIRE(cols[d].is_null(1));
+        t.REQUIRE(!cols[d].is_null(2) && cols[d].bools()[2] == 0);
+
+        t.REQUIRE(cols[f].ints()[0] == 20);
+        t.REQUIRE(cols[f].is_null(1));
+        t.REQUIRE(cols[f].ints()[2] == 2);
+        t.REQUIRE(cols[f].is_null(3));
+
+        // more rows add to the end, clear drops them
+        t.REQUIRE(cols.extract("{\"a\": 3}", 1) == 1);
+        t.REQUIRE(cols.rows() == 5 && cols[a].doubles()[4] == 3 && cols[b].is_null(4));
+        cols.clear();
+        t.REQUIRE(cols.rows() == 0 && cols[a].size() == 0);
+}
+
+static void test_errors(wbtester& t)
+{
+        json::ndjson_columns cols;
+        t.REQUIRE(cols.add_column("$..a", json::COLUMN_DOUBLE) == json::ndjson_columns::npos);
+        t.REQUIRE(!cols.error().empty());
+        t.REQUIRE(cols.add_column("$.a[*]", json::COLUMN_DOUBLE) == json::ndjson_columns::npos);
+        t.REQUIRE(cols.add_column("$.a[-1]", json::COLUMN_DOUBLE) == json::ndjson_columns::npos);
+        t.REQUIRE(cols.add_column("$", json::COLUMN_DOUBLE) == json::ndjson_columns::npos);
+        t.REQUIRE(cols.add_column("a", json::COLUMN_DOUBLE) == json::ndjson_columns::npos);
+
+        size_t a = cols.add_column("$.a", json::COLUMN_DOUBLE);
+        size_t b = cols.add_column("$.b", json::COLUMN_DOUBLE);
+        const char* text =
+                "{\"a\": 1, \"b\": 2}\n"
+                "{\"a\": 1, \"b\" 2}\n"
+                "{\"a\": 1, \"b\": [1, 2\n"
+                "{\"x\": 1} junk\n"
+                "{\"a\": 5, \"b\": 6} ignored once both are found\n"
+                "[1, 2]\n"
+                "7\n";
+        t.REQUIRE(cols.extract(text, 1) == 7);
+        t.REQUIRE(cols.errors() == 3);
+        t.REQUIRE(cols[a].doubles()[0] == 1 && cols[b].doubles()[0] == 2);
+        t.REQUIRE(cols[a].is_null(1) && cols[b].is_null(1));
+        t.REQUIRE(cols[a].is_null(2) && cols[b].is_null(2));
+        t.REQUIRE(cols[a].is_null(3));
+        t.REQUIRE(cols[a].doubles()[4] == 5 && cols[b].doubles()[4] == 6);
+        t.REQUIRE(cols[a].is_null(5) && cols[a].is_null(6));
+
+        // a column added later is null for the rows before it
+        size_t c = cols.add_column("$.c", json::COLUMN_STRING);
+        t.REQUIRE(cols[c].size() == 7 && cols[c].is_null(6));
+
+        // no columns, still counts the records
+        json::ndjson_columns none;
+        t.REQUIRE(none.extract("{}\n{}\n", 1) == 2);
+}
+
+static void test_threads(wbtester& t)
+{
+        // enough text for several threads, the joined columns must match one thread's
+        std::string text = make_records(20000);
+        const char* paths[] = { "$.id", "$.user.name", "$.ok", "$.price", "$.user.tags[1]" };
+        json::column_type types[] = { json::COLUMN_INT64, json::COLUMN_STRING, json::COLUMN_BOOL, json::COLUMN_DOUBLE, json::COLUMN_STRING };
+
+        json::ndjson_columns one;
+        json::ndjson_columns many;
+        for (size_t i = 0; i < 5; i++)
+        {
+                one.add_column(paths[i], types[i]);
+                many.add_column(paths[i], types[i]);
+        }
+        t.REQUIRE(one.extract(text, 1) == 20000);
+        t.REQUIRE(many.extract(text, 4) == 20000);
+        t.REQUIRE(many.errors() == 0);
+
+        for (size_t c = 0; c < 5; c++)
+        {
+                t.REQUIRE(one[c].null_bitmap() == many[c].null_bitmap());
+                t.REQUIRE(one[c].doubles() == many[c].doubles());
+                t.REQUIRE(one[c].ints() == many[c].ints());
+                t.REQUIRE(one[c].bools() == many[c].bools());
+                bool same = one[c].strings().size() == many[c].strings().size();
+                for (size_t i = 0; same && i < one[c].strings().size(); i++)
+                        same = one[c].strings()[i].begin() == many[c].strings()[i].begin();
+                t.REQUIRE(same);
+        }
+
+        size_t nulls = 0;
+        for (size_t row = 0; row < many.rows(); row++)
+        {
+                if (many[0].is_null(row)) nulls++;
+                if (row == 12345) t.REQUIRE(many[0].ints()[row] == 12345 && many[3].doubles()[row] == 12345.25);
+        }
+        t.REQUIRE(nulls == (20000 + 10) / 11);
+        t.REQUIRE(many[3].is_null(7) && !many[3].is_null(77));
+        t.REQUIRE(many[4].strings()[19999].equals(CONST_SUBBUF("b19999")));
+}
+
+static void run_perf_test(uint64_t perf_size)
+{
+        std::string text = make_records(perf_size);
+
+        for (unsigned threads = 1; threads <= 8; threads *= 2)
+        {
+                json::ndjson_columns cols;
+                cols.add_column("$.id", json::COLUMN_INT64);
+                cols.add_column("$.price", json::COLUMN_DOUBLE);
+                cols.add_column("$.user.name", json::COLUMN_STRING);
+                uint64_t start = get_microseconds();
+                size_t rows = cols.extract(text, threads);
+                uint64_t end = get_microseconds();
+                fprintf(stderr, "perf_test, %zu rows from %zu bytes, %u threads, mic secs: %lu\n", rows, text.length(), threads, end - start);
+        }
+
+        // a root per record for comparison
+        std::vector<double> prices;
+        uint64_t start = get_microseconds();
+        subbuffer rest(text);
+        while (!rest.empty())
+        {
+                subbuffer line = rest.before('\n');
+                rest = rest.after('\n');
+                json::root r(line);
+                prices.push_back(r["price"].numb());
+        }
+        uint64_t end = get_microseconds();
+        fprintf(stderr, "perf_test, json::root per record, %zu rows, mic secs: %lu\n", prices.size(), end - start);
+}
+
+int main(int argc, char** argv)
+{
+        bool do_perf = false;
+        uint64_t perf_size = 1000000;
+
+        for (int i = 1; i < argc; i++)
+        {
+                subbuffer arg(argv[i]);
+                if (arg.equals(CONST_SUBBUF("--perf")))
+                        do_perf = true;
+                else if (arg.starts_with(CONST_SUBBUF("--perf-size=")))
+                        perf_size = aton<uint64_t>(arg.after('='));
+        }
+
+        if (do_perf)
+        {
+                run_perf_test(perf_size);
+                return 0;
+        }
+
+        wbtester t;
+
+        t.ADD_TEST(test_types);
+        t.ADD_TEST(test_errors);
+        t.ADD_TEST(test_threads);
+
+        return t.run();
+}
@@ -0,0 +1,140 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    whitebox_json_keyset.cc
+//: \details: Test driver for compile time key sets
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#define JSON_TRACE(fmt, x...) do { } while(0)
+
+#include "json_keyset.h"
+#include "wbtest.h"
+
+#include <string>
+
+#include <sys/time.h>
+
+static uint64_t get_microseconds()
+{
+        timeval tv;
+        ::gettimeofday(&tv, 0);
+        return static_cast <uint64_t>((static_cast <uint64_t>(tv.tv_sec) * 1000000)  + tv.tv_usec);
+}
+
+typedef json::keyset<"id", "ts", "user", "tags", "a\\tb"> event_keys;
+
+// ids are fixed at compile time
+static_assert(event_keys::size() == 5);
+static_assert(event_keys::id<"id">() != event_keys::id<"ts">());
+static_assert(event_keys::id<"tags">() < event_keys::size());
+
+static void test_fetch(wbtester& t)
+{
+        json::root r("{\"user\": {\"name\": \"x\"}, \"other\": 1, \"id\": 42, \"tags\": [1, 2], \"a\\tb\": true}");
+        t.REQUIRE(r.is_valid());
+
+        event_keys::values v;
+        t.REQUIRE(event_keys::fetch(r, v) == 4);
+        t.REQUIRE(v[event_keys::id<"id">()] && v[event_keys::id<"id">()]->numb() == 42);
+        t.REQUIRE(v[event_keys::id<"ts">()] == NULL);
+        t.REQUIRE(v[event_keys::id<"user">()] == &r["user"]);
+        t.REQUIRE((*v[event_keys::id<"tags">()])[1].numb() == 2);
+        // keys match as written in the document, escapes and all
+        t.REQUIRE(v[event_keys::id<"a\\tb">()]->bval());
+
+        t.REQUIRE(event_keys::find("user") == int(event_keys::id<"user">()));
+        t.REQUIRE(event_keys::find("other") == -1);
+        t.REQUIRE(event_keys::find("") == -1);
+        t.REQUIRE(subbuffer(event_keys::key(event_keys::id<"ts">())).equals(CONST_SUBBUF("ts")));
+
+        // not an object, nothing found
+        json::root a("[1, 2]");
+        v = event_keys::fetch(a);
+        t.REQUIRE(v[0] == NULL && v[4] == NULL);
+        t.REQUIRE(event_keys::fetch(r["id"], v) == 0);
+
+        // every key present
+        json::root all("{\"tags\": [], \"ts\": 1, \"user\": null, \"a\\tb\": 0, \"id\": \"x\"}");
+        t.REQUIRE(event_keys::fetch(all, v) == 5);
+        for (size_t i = 0; i < event_keys::size(); i++) t.REQUIRE(v[i] != NULL);
+
+        // a single key works too
+        typedef json::keyset<"only"> one;
+        json::root o("{\"only\": 7}");
+        t.REQUIRE(one::fetch(o)[one::id<"only">()]->numb() == 7);
+}
+
+static void run_perf_test(uint64_t perf_size)
+{
+        typedef json::keyset<"id", "ts", "user", "host", "level", "msg"> log_keys;
+        std::string text = "{\"host\": \"h1\", \"id\": 17, \"extra\": [1, 2, 3], \"level\": \"info\", "
+                           "\"msg\": \"hello\", \"pid\": 5, \"ts\": 1423000000, \"user\": \"u\", \"zone\": 3}";
+        json::root r(text);
+        const char* names[] = { "id", "ts", "user", "host", "level", "msg" };
+
+        size_t sum = 0;
+        uint64_t start = get_microseconds();
+        for (uint64_t i = 0; i < perf_size; i++)
+        {
+                log_keys::values v;
+                sum += log_keys::fetch(r, v);
+        }
+        uint64_t end = get_microseconds();
+        fprintf(stderr, "perf_test, keyset fetch of 6 keys, %lu objects, found %zu, mic secs: %lu\n", perf_size, sum, end - start);
+
+        const json::object& o = *r.to_object();
+        sum = 0;
+        start = get_microseconds();
+        for (uint64_t i = 0; i < perf_size; i++)
+        {
+                const json::value* v[6];
+                for (size_t k = 0; k < 6; k++)
+                {
+                        v[k] = o.find(names[k]);
+                        if (v[k]) sum++;
+                }
+        }
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, 6 x find, %lu objects, found %zu, mic secs: %lu\n", perf_size, sum, end - start);
+}
+
+int main(int argc, char** argv)
+{
+        bool do_perf = false;
+        uint64_t perf_size = 1000000;
+
+        for (int i = 1; i < argc; i++)
+        {
+                subbuffer arg(argv[i]);
+                if (arg.equals(CONST_SUBBUF("--perf")))
+                        do_perf = true;
+                else if (arg.starts_with(CONST_SUBBUF("--perf-size=")))
+                        perf_size = aton<uint64_t>(arg.after('='));
+        }
+
+        if (do_perf)
+        {
+                run_perf_test(perf_size);
+                return 0;
+        }
+
+        wbtester t;
+
+        t.ADD_TEST(test_fetch);
+
+        return t.run();
+}
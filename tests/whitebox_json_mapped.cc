@@ -0,0 +1,158 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    whitebox_json_mapped.cc
+//: \details: Test driver for parsing from a memory mapped file
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#define JSON_TRACE(fmt, x...) do { } while(0)
+#define JSON_WARNING(fmt, x...) do { } while(0)
+
+#include "json_mapped.h"
+#include "wbtest.h"
+
+#include <string>
+
+#include <sys/time.h>
+
+static uint64_t get_microseconds()
+{
+        timeval tv;
+        ::gettimeofday(&tv, 0);
+        return static_cast <uint64_t>((static_cast <uint64_t>(tv.tv_sec) * 1000000)  + tv.tv_usec);
+}
+
+static bool write_file(const char* path, const std::string& text)
+{
+        FILE* f = fopen(path, "wb");
+        if (!f) return false;
+        bool ok = fwrite(text.data(), 1, text.length(), f) == text.length();
+        return (fclose(f) == 0) && ok;
+}
+
+static void test_mapped_root(wbtester& t)
+{
+        const char* path = "/tmp/whitebox_json_mapped.json";
+        std::string text("{\"a\": [1, 2, {\"b\": \"see\"}], \"c\": true}");
+        t.REQUIRE(write_file(path, text));
+
+        {
+                json::mapped_root root(path);
+                t.REQUIRE(root.is_open());
+                t.REQUIRE(root.is_valid());
+                t.REQUIRE(root["a"][2]["b"].str().equals("see"));
+                t.REQUIRE(root["c"].bval());
+
+                // the values point into the mapping, not into a copy
+                subbuffer see = root["a"][2]["b"].str();
+                t.REQUIRE(see.begin() >= root.text().begin() && see.begin() < root.text().begin() + root.text().length());
+
+                // and it can be modified and written like any root
+                root["a"].push_back(3);
+                std::string out;
+                root.write(out);
+                t.REQUIRE(out == "{\"a\":[1,2,{\"b\": \"see\"},3],\"c\":true}");
+        }
+
+        t.REQUIRE(write_file(path, ""));
+        json::mapped_root empty(path);
+        t.REQUIRE(empty.is_open());
+        t.REQUIRE(!empty.is_valid());
+
+        json::mapped_root missing("/tmp/whitebox_json_mapped.missing");
+        t.REQUIRE(!missing.is_open());
+        t.REQUIRE(!missing.is_valid());
+        unlink(path);
+}
+
+static void run_perf_test(uint64_t perf_size)
+{
+        // long strings keep the DOM small next to the text, so a multi-GB file fits in memory
+        const char* path = "/tmp/whitebox_json_mapped_perf.json";
+        {
+                std::string filler(1000, 'x');
+                std::string chunk;
+                FILE* f = fopen(path, "wb");
+                if (!f) return;
+                fputc('[', f);
+                for (uint64_t i = 0, len = 1; len < perf_size; i++)
+                {
+                        chunk.clear();
+                        json_builder<std::string> jb(chunk);
+                        if (i) chunk += ',';
+                        jb.open_object().add("id", i).add("text", filler).open_array("n").add(1).add(2).close().close();
+                        fwrite(chunk.data(), 1, chunk.length(), f);
+                        len += chunk.length();
+                }
+                fputc(']', f);
+                fclose(f);
+        }
+
+        uint64_t start = get_microseconds();
+        size_t count = 0;
+        size_t length = 0;
+        {
+                std::string text;
+                FILE* f = fopen(path, "rb");
+                fseek(f, 0, SEEK_END);
+                text.resize(ftell(f));
+                fseek(f, 0, SEEK_SET);
+                if (fread(&text[0], 1, text.length(), f) != text.length()) text.clear();
+                fclose(f);
+                json::root root(text);
+                count = root.size();
+                length = text.length();
+        }
+        uint64_t end = get_microseconds();
+        fprintf(stderr, "perf_test, read + parse %zu bytes, %zu items, mic secs: %lu\n", length, count, end - start);
+
+        start = get_microseconds();
+        {
+                json::mapped_root root(path);
+                count = root.size();
+        }
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, mmap + parse %zu bytes, %zu items, mic secs: %lu\n", length, count, end - start);
+        unlink(path);
+}
+
+int main(int argc, char** argv)
+{
+        bool do_perf = false;
+        uint64_t perf_size = 2ull * 1024 * 1024 * 1024;
+
+        for (int i = 1; i < argc; i++)
+        {
+                subbuffer arg(argv[i]);
+                if (arg.equals(CONST_SUBBUF("--perf")))
+                        do_perf = true;
+                else if (arg.starts_with(CONST_SUBBUF("--perf-size=")))
+                        perf_size = aton<uint64_t>(arg.after('='));
+        }
+
+        if (do_perf)
+        {
+                run_perf_test(perf_size);
+                return 0;
+        }
+
+        wbtester t;
+
+        t.ADD_TEST(test_mapped_root);
+
+        return t.run();
+}
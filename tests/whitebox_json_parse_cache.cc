@@ -0,0 +1,205 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    whitebox_json_parse_cache.cc
+//: \details: Test driver for the parse cache
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#define JSON_TRACE(fmt, x...) do { } while(0)
+#define JSON_WARNING(fmt, x...) do { } while(0)
+
+#include "json_parse_cache.h"
+#include "wbtest.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/time.h>
+
+static uint64_t get_microseconds()
+{
+        timeval tv;
+        ::gettimeofday(&tv, 0);
+        return static_cast <uint64_t>((static_cast <uint64_t>(tv.tv_sec) * 1000000)  + tv.tv_usec);
+}
+
+static std::string make_body(size_t id, size_t items)
+{
+        std::string text;
+        json_builder<std::string> jb(text);
+        jb.open_object().add("id", id).open_array("items");
+        for (size_t i = 0; i < items; i++)
+                jb.open_object().add("n", i).add("name", "an item with a name").close();
+        jb.close_all();
+        return text;
+}
+
+static void test_cache(wbtester& t)
+{
+        json::parse_cache cache(1024 * 1024);
+        std::string a = make_body(1, 10);
+        std::string b = make_body(2, 10);
+
+        json::parse_cache::document da = cache.get(a);
+        t.REQUIRE(da->is_valid());
+        t.REQUIRE(da->root()["id"].numb() == 1);
+        t.REQUIRE(da->text().equals(a));
+        t.REQUIRE(da->text().begin() != a.data());
+
+        // a hit is the same document, even from a different buffer
+        std::string a2(a);
+        t.REQUIRE(cache.get(a2) == da);
+        json::parse_cache::document db = cache.get(b);
+        t.REQUIRE(db != da);
+        t.REQUIRE(db->root()["id"].numb() == 2);
+
+        json::parse_cache::counters c = cache.get_counters();
+        t.REQUIRE(c.hits == 1 && c.misses == 2 && c.evictions == 0 && c.entries == 2);
+        t.REQUIRE(c.bytes == da->bytes() + db->bytes());
+        t.REQUIRE(da->bytes() > a.length());
+
+        // invalid text is cached too
+        json::parse_cache::document bad = cache.get("{\"a\": ");
+        t.REQUIRE(!bad->is_valid());
+        t.REQUIRE(cache.get("{\"a\": ") == bad);
+
+        cache.clear();
+        c = cache.get_counters();
+        t.REQUIRE(c.entries == 0 && c.bytes == 0 && c.hits == 2);
+        t.REQUIRE(cache.get(a) != da);
+        t.REQUIRE(da->root()["id"].numb() == 1);
+}
+
+static void test_cache_eviction(wbtester& t)
+{
+        std::vector<std::string> bodies;
+        for (size_t i = 0; i < 4; i++)
+                bodies.push_back(make_body(i, 50));
+
+        size_t one = json::parse_cache(1 << 30).get(bodies[0])->bytes();
+        // room for two documents
+        json::parse_cache cache(one * 2 + one / 2);
+        json::parse_cache::document d0 = cache.get(bodies[0]);
+        cache.get(bodies[1]);
+        cache.get(bodies[0]);                   // 0 is now the most recently used
+        cache.get(bodies[2]);                   // so 1 goes
+        json::parse_cache::counters c = cache.get_counters();
+        t.REQUIRE(c.evictions == 1 && c.entries == 2);
+        t.REQUIRE(cache.get(bodies[0]) == d0);
+        cache.get(bodies[1]);
+        c = cache.get_counters();
+        t.REQUIRE(c.misses == 4 && c.hits == 2 && c.evictions == 2);
+        t.REQUIRE(c.bytes <= one * 2 + one / 2);
+
+        // too big to keep at all
+        json::parse_cache tiny(16);
+        json::parse_cache::document d = tiny.get(bodies[3]);
+        t.REQUIRE(d->is_valid());
+        t.REQUIRE(tiny.get_counters().entries == 0);
+}
+
+static void test_cache_threads(wbtester& t)
+{
+        std::vector<std::string> bodies;
+        for (size_t i = 0; i < 8; i++)
+                bodies.push_back(make_body(i, 20));
+
+        json::parse_cache cache(64 * 1024 * 1024);
+        const size_t threads = 4;
+        const size_t gets = 2000;
+        std::vector<size_t> wrong(threads, 0);
+        std::vector<std::thread> pool;
+        for (size_t n = 0; n < threads; n++)
+        {
+                pool.push_back(std::thread([&cache, &bodies, &wrong, n, gets]() {
+                        for (size_t i = 0; i < gets; i++)
+                        {
+                                size_t b = (i * 7 + n) % bodies.size();
+                                json::parse_cache::document d = cache.get(bodies[b]);
+                                if (!d->is_valid() || d->root()["id"].numb() != double(b) ||
+                                    d->root()["items"].size() != 20)
+                                        wrong[n]++;
+                        }
+                }));
+        }
+        for (size_t n = 0; n < threads; n++)
+                pool[n].join();
+
+        for (size_t n = 0; n < threads; n++)
+                t.REQUIRE(wrong[n] == 0);
+        json::parse_cache::counters c = cache.get_counters();
+        t.REQUIRE(c.hits + c.misses == threads * gets);
+        t.REQUIRE(c.entries == bodies.size());
+        t.REQUIRE(c.misses >= bodies.size());
+}
+
+static void run_perf_test(uint64_t perf_size)
+{
+        std::vector<std::string> bodies;
+        for (size_t i = 0; i < 16; i++)
+                bodies.push_back(make_body(i, 100));
+
+        uint64_t start = get_microseconds();
+        double sum = 0;
+        for (uint64_t i = 0; i < perf_size; i++)
+        {
+                json::root root(bodies[i % bodies.size()]);
+                sum += root["id"].numb();
+        }
+        uint64_t end = get_microseconds();
+        fprintf(stderr, "perf_test, parse %lu bodies of %zu bytes, mic secs: %lu (%g)\n", perf_size, bodies[0].length(), end - start, sum);
+
+        json::parse_cache cache(64 * 1024 * 1024);
+        sum = 0;
+        start = get_microseconds();
+        for (uint64_t i = 0; i < perf_size; i++)
+                sum += cache.get(bodies[i % bodies.size()])->root()["id"].numb();
+        end = get_microseconds();
+        json::parse_cache::counters c = cache.get_counters();
+        fprintf(stderr, "perf_test, parse_cache %lu bodies, mic secs: %lu (%g), hits: %lu, misses: %lu, bytes: %lu\n",
+                perf_size, end - start, sum, c.hits, c.misses, c.bytes);
+}
+
+int main(int argc, char** argv)
+{
+        bool do_perf = false;
+        uint64_t perf_size = 100000;
+
+        for (int i = 1; i < argc; i++)
+        {
+                subbuffer arg(argv[i]);
+                if (arg.equals(CONST_SUBBUF("--perf")))
+                        do_perf = true;
+                else if (arg.starts_with(CONST_SUBBUF("--perf-size=")))
+                        perf_size = aton<uint64_t>(arg.after('='));
+        }
+
+        if (do_perf)
+        {
+                run_perf_test(perf_size);
+                return 0;
+        }
+
+        wbtester t;
+
+        t.ADD_TEST(test_cache);
+        t.ADD_TEST(test_cache_eviction);
+        t.ADD_TEST(test_cache_threads);
+
+        return t.run();
+}
@@ -30,7 +30,10 @@
 #include "wbtest.h"
 
 #include <sys/time.h>
+#include <map>
 #include <string>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
 bool check_subbuffer(json::value& val, subbuffer exp)
@@ -155,7 +158,7 @@ static void test_escaped(wbtester& t)
 
         json::root root(json_text);
         json::value& desc = root["desc"];
-        t.REQUIRE(desc.str().equals("bob is \\\"tall\\\"\\\n\\\"thin\\\"\\\n\\\"bald\\\""));
+        t.REQUIRE(desc.str().equals("bob is \\\"tall\\\"\\n\\\"thin\\\"\\n\\\"bald\\\""));
 
         json_array arr;
         arr.add(1);
@@ -167,7 +170,7 @@ static void test_escaped(wbtester& t)
         json::root aroot(json_text);
         std::string dest;
         t.REQUIRE(aroot[0].numb() == 1);
-        t.REQUIRE(aroot[1].str().equals("bob is \\\"tall\\\"\\\n\\\"thin\\\"\\\n\\\"bald\\\""));
+        t.REQUIRE(aroot[1].str().equals("bob is \\\"tall\\\"\\n\\\"thin\\\"\\n\\\"bald\\\""));
         t.REQUIRE(aroot[1].unescape(dest).equals("bob is \"tall\"\n\"thin\"\n\"bald\""));
         t.REQUIRE(aroot[2].str().equals("hello"));
 
@@ -175,6 +178,572 @@ static void test_escaped(wbtester& t)
         json::root broot("[\"this is a\\? regex\"]");
         t.REQUIRE(broot[0].str().equals("this is a\\? regex"));
         t.REQUIRE(broot[0].unescape(dest).equals("this is a\? regex"));
+
+        // the full set of escapes
+        json::root croot("[\"\\b\\f\\n\\r\\t\\/\\\\\\\"\", \"\\u0041\\u00e9\\u20ac\\ud83d\\ude00\"]");
+        t.REQUIRE(croot.is_valid());
+        t.REQUIRE(croot[0].unescape(dest).equals("\b\f\n\r\t/\\\""));
+        t.REQUIRE(croot[1].unescape(dest).equals("A\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80"));
+
+        // everything that needs escaping is escaped once, the rest is copied
+        std::string raw("plain \\ back\"slash\x01\x1f\t tab \xc3\xa9 and a long clean run to cross the vector width\n");
+        json_text.clear();
+        json_object::json_friendly::append(json_text, raw);
+        t.REQUIRE(json_text == "plain \\\\ back\\\"slash\\u0001\\u001f\\t tab \xc3\xa9 and a long clean run to cross the vector width\\n");
+
+        // an escape at every offset of a block
+        for (size_t i = 0; i < 70; i++)
+        {
+                std::string in(70, 'x');
+                in[i] = '"';
+                std::string out;
+                json_object::json_friendly::append(out, in);
+                std::string exp(70, 'x');
+                exp.replace(i, 1, "\\\"");
+                if (out != exp) t.REQUIRE(out == exp);
+        }
+
+        // round trip through the builder, parser and unescape
+        json_object robj;
+        robj.add("k", raw);
+        json_text.clear();
+        robj.to_string(json_text);
+        json::root rroot(json_text);
+        t.REQUIRE(rroot.is_valid());
+        t.REQUIRE(rroot["k"].unescape(dest).equals(raw));
+}
+
+static void test_mutate(wbtester& t)
+{
+        std::string json_text("{\"a\": {\"x\": [1, 2, 3], \"y\": \"why\"}, \"b\": {\"keep\": [true,  false]}, \"c\": 5}");
+        json::root root(json_text);
+        t.REQUIRE(root.is_valid());
+
+        // new strings and numbers go in the root's storage, escaped
+        t.REQUIRE(root["a"].set("y", "say \"hi\"").is_string());
+        t.REQUIRE(root["a"]["y"].str().equals("say \\\"hi\\\""));
+        t.REQUIRE(root["a"].set("z", 2.5).numb() == 2.5);
+        t.REQUIRE(root["a"]["x"].push_back(4).numb() == 4);
+        t.REQUIRE(root["a"]["x"].insert(0, int64_t(-1)).numb() == -1);
+        t.REQUIRE(root["a"]["x"].erase(size_t(2)));
+        t.REQUIRE(root["a"]["x"].set(size_t(0), false).is_bool());
+        t.REQUIRE(root.erase("c"));
+        t.REQUIRE(!root.erase("c"));
+        t.REQUIRE(root.get_storage().bytes() > 0);
+
+        // keys needing escapes are given unescaped to set, exists and erase alike
+        root.set("q\"k", "v");
+        root.set("b\\s", 1);
+        t.REQUIRE(root.exists("q\"k"));
+        t.REQUIRE(root.exists("q\\\"k"));
+        t.REQUIRE(root.exists("b\\s"));
+        t.REQUIRE(root.erase("q\"k"));
+        t.REQUIRE(!root.exists("q\"k"));
+        t.REQUIRE(root.erase("b\\s"));
+        t.REQUIRE(!root.erase("b\\s"));
+
+        // a new empty container, then fill it
+        json::value& list = root.set("list", json::ARRAY);
+        t.REQUIRE(list.is_array());
+        list.push_back("one");
+        list.push_back(json::OBJECT).set("k\n", json::UNSET);
+
+        // wrong type or out of range does nothing
+        t.REQUIRE(root["a"]["y"].push_back(1).is_unset());
+        t.REQUIRE(list.set(size_t(10), 1).is_unset());
+        t.REQUIRE(root.set(size_t(0), 1).is_unset());
+
+        std::string out;
+        root.write(out);
+        // "b" was not touched, it is still the original text
+        t.REQUIRE(out == "{\"a\":{\"x\":[false,1,3,4],\"y\":\"say \\\"hi\\\"\",\"z\":2.5},\"b\":{\"keep\": [true,  false]},"
+                         "\"list\":[\"one\",{\"k\\n\":null}]}");
+        json::root reparsed(out);
+        t.REQUIRE(reparsed.is_valid());
+        t.REQUIRE(reparsed["list"].size() == 2);
+
+        // values from another document are deep copied, the source can go away
+        {
+                std::string other_text("{\"nested\": {\"deep\": [1, {\"s\": \"str\"}]}}");
+                json::root other(other_text);
+                other["nested"]["deep"].push_back(7);
+                t.REQUIRE(root.set("copy", other["nested"]).is_object());
+                // adding a member may move the others, like push_back on an array
+                root.set("copy2", other["nested"]["deep"][1]);
+                other_text.assign(other_text.length(), 'X');
+        }
+        t.REQUIRE(root["copy"].is_object());
+        out.clear();
+        root["copy"].write(out);
+        t.REQUIRE(out == "{\"deep\":[1,{\"s\": \"str\"},7]}");
+        out.clear();
+        root["copy2"].write(out);
+        t.REQUIRE(out == "{\"s\": \"str\"}");
+
+        // replaced by one of its own descendants
+        json::root self("{\"data\": {\"inner\": {\"x\": [1, 2]}, \"other\": 3}, \"list\": [[4, {\"y\": 5}]]}");
+        self["data"]["inner"]["x"].push_back(6);
+        self.set("data", self["data"]["inner"]);
+        self["list"].set(size_t(0), self["list"][size_t(0)][size_t(1)]);
+        out.clear();
+        self.write(out);
+        t.REQUIRE(out == "{\"data\":{\"x\":[1,2,6]},\"list\":[{\"y\": 5}]}");
+
+        // a sibling copied into new keys, while adding them moves the members
+        json::root sib("{\"a\": {\"v\": [1]}}");
+        sib["a"]["v"].push_back(2);
+        for (size_t i = 0; i < 40; i++)
+        {
+                char key[16];
+                snprintf(key, sizeof(key), "k%zu", i);
+                sib.set(key, sib["a"]);
+        }
+        out.clear();
+        sib["k39"].write(out);
+        t.REQUIRE(out == "{\"v\":[1,2]}");
+        t.REQUIRE(sib.to_object()->size() == 41);
+}
+
+static void test_content_hash(wbtester& t)
+{
+        json::parse_options opts;
+        opts.content_hashes = true;
+
+        // formatting, member order, escaping and number spelling don't matter
+        json::root a("{\"a\": [1, 2.5, \"x\"], \"b\": {\"c\": true, \"d\": null}, \"e\": \"\\u00e9\"}", opts);
+        json::root b("{ \"e\":\"\xc3\xa9\", \"b\":{\"d\":null,\"c\":true},\"a\":[1.0,25e-1,\"x\"] }");
+        t.REQUIRE(a.is_valid() && b.is_valid());
+        t.REQUIRE(a.content_hash() == b.content_hash());
+        t.REQUIRE(a.equals(b) && b.equals(a));
+        t.REQUIRE(a["b"].content_hash() == b["b"].content_hash());
+
+        // but order in arrays, types and values do
+        json::root c("{\"a\": [2.5, 1, \"x\"], \"b\": {\"c\": true, \"d\": null}, \"e\": \"\\u00e9\"}");
+        t.REQUIRE(a.content_hash() != c.content_hash());
+        t.REQUIRE(!a.equals(c));
+        json::root d("[1, \"1\", true, null, {}, []]");
+        for (size_t i = 0; i < d.size(); i++)
+                for (size_t j = i + 1; j < d.size(); j++)
+                        t.REQUIRE(d[i].content_hash() != d[j].content_hash() && !d[i].equals(d[j]));
+        json::root z("[0, -0.0]");
+        t.REQUIRE(z[0].content_hash() == z[1].content_hash() && z[0].equals(z[1]));
+
+        // a modification drops the kept hashes on the way up, changing it back gives the old hash again
+        uint64_t before = a.content_hash();
+        uint64_t inner = a["b"].content_hash();
+        a["b"].set("c", false);
+        t.REQUIRE(a["b"].content_hash() != inner);
+        t.REQUIRE(a.content_hash() != before);
+        t.REQUIRE(!a.equals(b));
+        a["b"].set("c", true);
+        t.REQUIRE(a["b"].content_hash() == inner);
+        t.REQUIRE(a.content_hash() == before);
+        t.REQUIRE(a.equals(b));
+}
+
+static void test_packed(wbtester& t)
+{
+        json::parse_options opts;
+        opts.packed_numbers = true;
+        const char* text = "{\"ints\": [1, -2, 3, 400000000000000], \"dbls\": [1.5, 2, -3e2], \"mixed\": [1, \"2\"], "
+                           "\"big\": [1234567890123456], \"empty\": [], \"nested\": [[1, 2], [3.5]]}";
+        json::root r(text, opts);
+        json::root plain(text);
+        t.REQUIRE(r.is_valid());
+        const json::value& cr = r;
+
+        json::span<const int64_t> ints = cr["ints"].as_span<int64_t>();
+        t.REQUIRE(ints.size() == 4 && ints[1] == -2 && ints[3] == 400000000000000ll);
+        t.REQUIRE(cr["ints"].as_span<double>().empty());
+        json::span<const double> dbls = cr["dbls"].as_span<double>();
+        t.REQUIRE(dbls.size() == 3 && dbls[0] == 1.5 && dbls[2] == -300);
+        double sum = 0;
+        for (const double* iter = dbls.begin(); iter != dbls.end(); ++iter)
+                sum += *iter;
+        t.REQUIRE(sum == -296.5);
+        t.REQUIRE(cr["mixed"].as_span<int64_t>().empty() && cr["mixed"].as_span<double>().empty());
+        t.REQUIRE(cr["big"].as_span<double>().size() == 1);
+        t.REQUIRE(cr["empty"].as_span<double>().empty() && cr["empty"].size() == 0);
+        t.REQUIRE(cr["nested"][1].as_span<double>()[0] == 3.5);
+        t.REQUIRE(cr["nested"].as_span<double>().empty());
+        t.REQUIRE(plain["ints"].as_span<int64_t>().empty());
+
+        // the packed arrays are smaller, and look the same from outside
+        t.REQUIRE(r.footprint() < plain.footprint());
+        t.REQUIRE(cr["ints"].size() == 4);
+        t.REQUIRE(r.equals(plain) && plain.equals(r));
+        t.REQUIRE(r.content_hash() == plain.content_hash());
+        std::string a, b;
+        r.write(a);
+        plain.write(b);
+        t.REQUIRE(a == b);
+
+        // elements are parsed from the text when asked for, the packed buffer stays
+        t.REQUIRE(cr["dbls"][2].numb() == -300);
+        t.REQUIRE(cr["dbls"][2].raw_subbuffer().equals(CONST_SUBBUF("-3e2")));
+        t.REQUIRE(cr["dbls"][3].is_unset());
+        t.REQUIRE(cr["dbls"].as_span<double>().size() == 3);
+        t.REQUIRE(r["ints"][0].numb() == 1);
+        t.REQUIRE(r["ints"].as_span<int64_t>().size() == 4);
+
+        // changing one unpacks it
+        r["ints"].push_back(5);
+        t.REQUIRE(r["ints"].as_span<int64_t>().empty());
+        t.REQUIRE(r["ints"].size() == 5 && r["ints"][4].numb() == 5 && r["ints"][1].numb() == -2);
+        a.clear();
+        r.write(a);
+        json::root check(a);
+        t.REQUIRE(check["ints"].size() == 5 && check["ints"][3].numb() == 4e14);
+
+        r["dbls"].erase(0);
+        t.REQUIRE(r["dbls"].size() == 2 && r["dbls"][0].numb() == 2);
+
+        // many threads asking for the elements of the same packed array
+        std::string big("[");
+        for (size_t i = 0; i < 10000; i++)
+                big += (i ? "," : "") + std::to_string(i);
+        big += "]";
+        const json::root shared(big, opts);
+        std::vector<std::thread> pool;
+        std::vector<size_t> wrong(4, 0);
+        for (size_t n = 0; n < 4; n++)
+        {
+                pool.push_back(std::thread([&shared, &wrong, n]() {
+                        for (size_t i = 0; i < shared.size(); i++)
+                                if (shared[i].numb() != double(i) || shared.as_span<int64_t>()[i] != int64_t(i)) wrong[n]++;
+                }));
+        }
+        for (size_t n = 0; n < 4; n++)
+                pool[n].join();
+        for (size_t n = 0; n < 4; n++)
+                t.REQUIRE(wrong[n] == 0);
+}
+
+static void test_unset(wbtester& t)
+{
+        json::root root("{\"a\": [1, 2], \"b\": \"bee\"}");
+        const json::value& croot = root;
+
+        // no vtable, a 32 bit text length
+        static_assert(sizeof(json::value) == 24, "json::value layout");
+
+        // const lookups hand out the one const sentinel
+        static_assert(std::is_same<decltype(croot["x"]), const json::value&>::value, "const lookup");
+        static_assert(std::is_same<decltype(croot[size_t(0)]), const json::value&>::value, "const lookup");
+        t.REQUIRE(&croot["x"] == &json::unset_value());
+        t.REQUIRE(&croot["a"][size_t(5)] == &json::unset_value());
+        t.REQUIRE(&croot["b"]["x"] == &json::unset_value());
+        t.REQUIRE(croot["a"][1].numb() == 2);
+
+        // writing through a non-const miss doesn't stick
+        json::value& miss = root["x"];
+        miss = root["b"];
+        t.REQUIRE(root["y"].is_unset());
+        t.REQUIRE(root["a"][size_t(7)].is_unset());
+        t.REQUIRE(croot["x"].is_unset());
+        t.REQUIRE(root.set(size_t(0), 1).is_unset());
+}
+
+static void test_concurrent_reads(wbtester& t)
+{
+        std::string text("[");
+        for (size_t i = 0; i < 1000; i++)
+        {
+                char buff[64];
+                snprintf(buff, sizeof(buff), "%s{\"id\": %zu, \"name\": \"n%zu\"}", i ? "," : "", i, i);
+                text += buff;
+        }
+        text += "]";
+        json::parse_options opts;
+        opts.content_hashes = true;
+        const json::root root(text, opts);
+
+        const json::key id("id");
+        const json::key missing("missing");
+        const size_t threads = 4;
+        std::vector<size_t> wrong(threads, 0);
+        std::vector<std::thread> pool;
+        for (size_t n = 0; n < threads; n++)
+        {
+                pool.push_back(std::thread([&root, &wrong, &id, &missing, n]() {
+                        for (size_t pass = 0; pass < 50; pass++)
+                        {
+                                for (size_t i = 0; i < root.size(); i++)
+                                {
+                                        const json::value& v = root[i];
+                                        if (v["id"].numb() != double(i) || !v["missing"].is_unset() || !v["name"].is_string())
+                                                wrong[n]++;
+                                        // the first of these builds the object's key index, racing the other readers
+                                        if (v[id].numb() != double(i) || !v[missing].is_unset())
+                                                wrong[n]++;
+                                }
+                                if (root[size_t(1000)].is_unset() != true) wrong[n]++;
+                        }
+                }));
+        }
+        for (size_t n = 0; n < threads; n++)
+                pool[n].join();
+        for (size_t n = 0; n < threads; n++)
+                t.REQUIRE(wrong[n] == 0);
+}
+
+static void test_key(wbtester& t)
+{
+        json::root root("{\"b\": 2, \"a\": 1, \"tab\\tkey\": 3, \"ab\": {\"a\": 4}}");
+        const json::key a("a");
+        const json::key ab("ab");
+        const json::key tab("tab\\tkey");
+        const json::key missing("c");
+        const json::key empty("");
+
+        t.REQUIRE(root[a].numb() == 1);
+        t.REQUIRE(root[tab].numb() == 3);
+        t.REQUIRE(root[ab][a].numb() == 4);
+        t.REQUIRE(root[missing].is_unset());
+        t.REQUIRE(root[empty].is_unset());
+        t.REQUIRE(root.to_object()->find(a) == root.to_object()->find("a"));
+        t.REQUIRE(a.length() == 1 && a.name().equals(CONST_SUBBUF("a")) && a.hash() != missing.hash());
+
+        // not an object
+        t.REQUIRE(root[a][a].is_unset());
+        t.REQUIRE(const_cast<const json::root&>(root)[ab][a].numb() == 4);
+
+        // the index follows the members as they change
+        root.set("c", 5);
+        t.REQUIRE(root[missing].numb() == 5);
+        root.erase("a");
+        t.REQUIRE(root[a].is_unset());
+        t.REQUIRE(root[ab][a].numb() == 4);
+        root.set("a", "again");
+        t.REQUIRE(root[a].str().equals(CONST_SUBBUF("again")));
+
+        // enough members that the index has to grow and probe
+        std::string text("{");
+        for (size_t i = 0; i < 500; i++)
+        {
+                char buff[64];
+                snprintf(buff, sizeof(buff), "%s\"%zu_key\": %zu", i ? "," : "", i, i);
+                text += buff;
+        }
+        text += "}";
+        json::root wide(text);
+        size_t wrong = 0;
+        for (size_t i = 0; i < 600; i++)
+        {
+                char buff[64];
+                snprintf(buff, sizeof(buff), "%zu_key", i);
+                const json::value& v = wide[json::key(buff)];
+                if (i < 500 ? v.numb() != double(i) : !v.is_unset()) wrong++;
+        }
+        t.REQUIRE(wrong == 0);
+}
+
+static std::string member_keys(const json::value& v)
+{
+        std::string res;
+        const json::object* o = v.to_object();
+        for (json::object::const_iterator iter = o->begin(); iter != o->end(); ++iter)
+                res.append(iter->first.begin(), iter->first.length());
+        return res;
+}
+
+static void test_member_order(wbtester& t)
+{
+        json::root root("{\"z\": 1, \"b\": 2, \"y\": 3, \"b\": 4, \"a\": {\"k\": 1, \"c\": 2}}");
+        t.REQUIRE(root.is_valid());
+        t.REQUIRE(member_keys(root) == "zbya");
+        t.REQUIRE(member_keys(root["a"]) == "kc");
+        // a repeated key keeps its first position and takes the last value
+        t.REQUIRE(root.to_object()->size() == 4 && root["b"].numb() == 4);
+
+        root.set("m", 5);
+        root.erase("z");
+        t.REQUIRE(member_keys(root) == "byam");
+        std::string out;
+        root.write(out);
+        t.REQUIRE(out == "{\"b\":4,\"y\":3,\"a\":{\"k\": 1, \"c\": 2},\"m\":5}");
+
+        // past SCAN_LIMIT members lookups and repeats go through the index
+        std::string text("{");
+        for (size_t i = 0; i < 100; i++)
+        {
+                char buff[64];
+                snprintf(buff, sizeof(buff), "%s\"k%zu\": %zu", i ? "," : "", 99 - i % 50, i);
+                text += buff;
+        }
+        text += "}";
+        json::root wide(text);
+        t.REQUIRE(wide.to_object()->size() == 50);
+        size_t wrong = 0;
+        size_t i = 0;
+        for (json::object::const_iterator iter = wide.to_object()->begin(); iter != wide.to_object()->end(); ++iter, ++i)
+        {
+                char buff[64];
+                snprintf(buff, sizeof(buff), "k%zu", 99 - i);
+                if (!iter->first.equals(subbuffer(buff)) || iter->second.numb() != double(i + 50)) wrong++;
+                if (wide[subbuffer(buff)].numb() != double(i + 50)) wrong++;
+        }
+        t.REQUIRE(wrong == 0);
+        t.REQUIRE(!wide.exists("k49") && wide.exists("k50"));
+        wide.erase("k60");
+        wide.set("k0", 0);
+        t.REQUIRE(wide.to_object()->size() == 50 && !wide.exists("k60") && wide["k0"].numb() == 0 && wide["k61"].numb() == 88);
+
+        // equal whatever the order
+        json::root a("{\"x\": 1, \"y\": [2]}");
+        json::root b("{\"y\": [2], \"x\": 1}");
+        t.REQUIRE(a.equals(b));
+}
+
+static void test_duplicates(wbtester& t)
+{
+        const char* text = "{\"a\": 1, \"b\": {\"x\": [1]}, \"a\": [2, {\"y\": 3}], \"c\": true, \"a\": \"three\"}";
+        json::parse_options opts;
+
+        json::root last(text, opts);
+        t.REQUIRE(last.is_valid());
+        t.REQUIRE(member_keys(last) == "abc");
+        t.REQUIRE(last["a"].str().equals(CONST_SUBBUF("three")));
+
+        opts.duplicates = json::DUPLICATES_FIRST;
+        json::root first(text, opts);
+        t.REQUIRE(first.is_valid());
+        t.REQUIRE(member_keys(first) == "abc");
+        t.REQUIRE(first["a"].numb() == 1);
+        t.REQUIRE(first["c"].bval());
+        // the skipped values are still checked for where they end
+        t.REQUIRE(!json::root("{\"a\": 1, \"a\": [1, 2}", opts).is_valid());
+        t.REQUIRE(!json::root("{\"a\": 1, \"a\": 2 3}", opts).is_valid());
+
+        opts.duplicates = json::DUPLICATES_REJECT;
+        t.REQUIRE(!json::root(text, opts).is_valid());
+        t.REQUIRE(json::root("{\"a\": {\"a\": 1}, \"b\": [{\"a\": 2}, {\"a\": 3}]}", opts).is_valid());
+        t.REQUIRE(!json::root("[{\"a\": 2}, {\"b\": 1, \"b\": 1}]", opts).is_valid());
+
+        opts.duplicates = json::DUPLICATES_KEEP;
+        json::root keep(text, opts);
+        t.REQUIRE(keep.is_valid());
+        t.REQUIRE(member_keys(keep) == "abac" "a");
+        t.REQUIRE(keep["a"].numb() == 1);
+        std::vector<const json::value*> all;
+        t.REQUIRE(keep.to_object()->find_all("a", all) == 3);
+        t.REQUIRE(all[0]->numb() == 1 && (*all[1])[size_t(1)]["y"].numb() == 3 && all[2]->str().equals(CONST_SUBBUF("three")));
+        std::string out;
+        keep["b"].mark_modified();
+        keep.write(out);
+        t.REQUIRE(out == "{\"a\":1,\"b\":{\"x\":[1]},\"a\":[2, {\"y\": 3}],\"c\":true,\"a\":\"three\"}");
+
+        // past SCAN_LIMIT members the repeats are found through the index
+        std::string wide("{");
+        for (size_t i = 0; i < 40; i++)
+        {
+                char buff[64];
+                snprintf(buff, sizeof(buff), "%s\"k%zu\": %zu", i ? "," : "", i % 20, i);
+                wide += buff;
+        }
+        wide += "}";
+        for (int policy = json::DUPLICATES_LAST; policy <= json::DUPLICATES_KEEP; policy++)
+        {
+                opts.duplicates = json::duplicate_keys(policy);
+                json::root r(wide, opts);
+                if (opts.duplicates == json::DUPLICATES_REJECT)
+                {
+                        t.REQUIRE(!r.is_valid());
+                        continue;
+                }
+                t.REQUIRE(r.is_valid());
+                t.REQUIRE(r.to_object()->size() == (opts.duplicates == json::DUPLICATES_KEEP ? 40 : 20));
+                t.REQUIRE(r["k7"].numb() == (opts.duplicates == json::DUPLICATES_LAST ? 27 : 7));
+                all.clear();
+                t.REQUIRE(r.to_object()->find_all("k19", all) == (opts.duplicates == json::DUPLICATES_KEEP ? 2u : 1u));
+        }
+}
+
+static void test_builder(wbtester& t)
+{
+        std::string out;
+        json_builder<std::string> jb(out);
+        jb.open_object();
+        jb.add("name", "Hal");
+        jb.add("age", 23);
+        jb.open_array("aliases").add("Bob").add("Joe").close();
+        jb.open_object("wife").add("name", "wi\"fey").open_array("kids").close().close();
+        jb.open_array("deep").open_array().open_object().add("x", 1.5).add_null("n").close().add(true).close().close();
+        json_array arr;
+        arr.add(1).add(2);
+        jb.add("arr", arr);
+        jb.open_object("empty").close();
+        t.REQUIRE(jb.depth() == 1);
+        jb.close();
+        t.REQUIRE(jb.depth() == 0);
+
+        t.REQUIRE(out == "{\"name\":\"Hal\",\"age\":23,\"aliases\":[\"Bob\",\"Joe\"],\"wife\":{\"name\":\"wi\\\"fey\",\"kids\":[]},"
+                         "\"deep\":[[{\"x\":1.5,\"n\":null},true]],\"arr\":[1,2],\"empty\":{}}");
+        json::root root(out);
+        t.REQUIRE(root.is_valid());
+        t.REQUIRE(root["deep"][0][0]["x"].numb() == 1.5);
+
+        // a parsed document can be added as is
+        std::string out2;
+        json_builder<std::string> jb2(out2);
+        jb2.open_array().write(root["wife"]).add(3).close_all();
+        t.REQUIRE(out2 == "[{\"name\":\"wi\\\"fey\",\"kids\":[]},3]");
+
+        // fixed capacity buffer on the stack
+        json_fixed_buffer<32> fixed;
+        json_builder<json_fixed_buffer<32> > fb(fixed);
+        fb.open_object().add("a", 1).open_array("b").add("c").close().close();
+        t.REQUIRE(!fixed.overflowed());
+        t.REQUIRE(subbuffer(fixed.data(), fixed.length()).equals("{\"a\":1,\"b\":[\"c\"]}"));
+
+        fixed.clear();
+        json_builder<json_fixed_buffer<32> > fb2(fixed);
+        fb2.open_array().add("this string is longer than thirty two bytes").close();
+        t.REQUIRE(fixed.overflowed());
+        t.REQUIRE(fixed.length() == 32);
+}
+
+static void test_write(wbtester& t)
+{
+        subbuffer json_text("{\"b\": 1.50, \"a\": {\"y\": \"why\\\"\", \"x\": [1, 2, {\"z\" : true}]}, \"c\": [null, false]}");
+        json::root root(json_text);
+        t.REQUIRE(root.is_valid());
+        t.REQUIRE(!root.is_modified());
+
+        // nothing modified, the output is the original text
+        std::string out;
+        root.write(out);
+        t.REQUIRE(subbuffer(out).equals(json_text));
+
+        json_iovec iov;
+        root.write(iov);
+        t.REQUIRE(iov.iov_count() == 1);
+        t.REQUIRE(iov.iov()[0].iov_base == json_text.begin());
+        t.REQUIRE(iov.length() == json_text.length());
+
+        // only the modified object and the containers above it are rebuilt
+        root["a"].mark_modified();
+        t.REQUIRE(root.is_modified());
+        t.REQUIRE(root["a"].is_modified());
+        t.REQUIRE(!root["a"]["x"].is_modified());
+        t.REQUIRE(!root["c"].is_modified());
+
+        out.clear();
+        root.write(out);
+        // members stay in document order
+        t.REQUIRE(subbuffer(out).equals("{\"b\":1.50,\"a\":{\"y\":\"why\\\"\",\"x\":[1, 2, {\"z\" : true}]},\"c\":[null, false]}"));
+
+        iov.clear();
+        root.write(iov);
+        std::string flat;
+        iov.to_string(flat);
+        t.REQUIRE(flat == out);
+        // the unmodified array is referenced, not copied
+        bool referenced = false;
+        subbuffer x = root["a"]["x"].raw_subbuffer();
+        for (size_t i = 0; i < iov.iov_count(); i++)
+                referenced |= (iov.iov()[i].iov_base == x.begin() && iov.iov()[i].iov_len == x.length());
+        t.REQUIRE(referenced);
 }
 
 inline uint64_t get_microseconds()
@@ -210,7 +779,29 @@ void run_perf_test(uint64_t perf_size)
         std::string json_text;
         arr.to_string(json_text);
 
+        // the same document through json_builder, one buffer for every level
         uint64_t start = get_microseconds();
+        std::string built;
+        json_builder<std::string> jb(built);
+        jb.open_array();
+        for (uint64_t i = 0; i < perf_size; i++)
+        {
+                jb.open_object();
+                sprintf(buff, "srv%lu", i);
+                jb.add(CONST_SUBBUF("host"), buff);
+                jb.add(CONST_SUBBUF("index"), i);
+                sprintf(buff, "A description for srv%lu", i);
+                jb.add(CONST_SUBBUF("desc"), buff);
+                jb.open_array(CONST_SUBBUF("numbs"));
+                for (int a = 0; a < 100; a++)
+                        jb.add(a);
+                jb.close().close();
+        }
+        jb.close();
+        fprintf(stderr, "perf_test, json_builder %zu bytes mic secs: %lu%s\n", built.length(), get_microseconds() - start,
+                built == json_text ? "" : " (MISMATCH)");
+
+        start = get_microseconds();
 
         json::root root(json_text);
 
@@ -235,6 +826,232 @@ void run_perf_test(uint64_t perf_size)
         uint64_t check_ms = end - parsed;
 
         fprintf(stderr, "perf_test, perf_size: %lu, parse mic secs: %lu, check mic secs: %lu\n", perf_size, pars_ms, check_ms);
+
+        // every member of wide objects by name, a subbuffer each time vs a json::key made once
+        {
+                std::string text("[");
+                for (size_t o = 0; o < 2000; o++)
+                {
+                        text += o ? ",{" : "{";
+                        for (size_t a = 0; a < 50; a++)
+                        {
+                                sprintf(buff, "%s\"%zu_key_%zu\": %zu", a ? "," : "", a, o % 10, a);
+                                text += buff;
+                        }
+                        text += "}";
+                }
+                text += "]";
+                const json::root wide(text);
+                std::vector<std::string> names;
+                std::vector<json::key> keys;
+                for (size_t a = 0; a < 50; a++)
+                {
+                        sprintf(buff, "%zu_key_%zu", a, size_t(3));
+                        names.push_back(buff);
+                }
+                for (size_t a = 0; a < 50; a++)
+                        keys.push_back(json::key(names[a]));
+
+                // only every 10th object has these keys, the rest are misses
+                for (size_t pass = 0; pass < 2; pass++)
+                {
+                        double sum = 0;
+                        start = get_microseconds();
+                        for (size_t o = 0; o < wide.size(); o++)
+                                for (size_t a = 0; a < 50; a++)
+                                        sum += wide[o][subbuffer(names[a])].numb();
+                        end = get_microseconds();
+                        fprintf(stderr, "perf_test, %zu lookups by subbuffer (%.0f) mic secs: %lu\n", wide.size() * 50, sum, end - start);
+
+                        sum = 0;
+                        start = get_microseconds();
+                        for (size_t o = 0; o < wide.size(); o++)
+                                for (size_t a = 0; a < 50; a++)
+                                        sum += wide[o][keys[a]].numb();
+                        end = get_microseconds();
+                        fprintf(stderr, "perf_test, %zu lookups by json::key (%.0f) mic secs: %lu%s\n", wide.size() * 50, sum, end - start,
+                                pass ? "" : " (builds the indexes)");
+                }
+        }
+
+        // one wide object: parse, then walk its members in document order vs the same members in a std::map
+        {
+                std::string text("{");
+                for (size_t i = 0; i < 200000; i++)
+                {
+                        sprintf(buff, "%s\"member_%zu\": %zu", i ? "," : "", (i * 7919) % 200000, i);
+                        text += buff;
+                }
+                text += "}";
+                start = get_microseconds();
+                const json::root wide(text);
+                end = get_microseconds();
+                fprintf(stderr, "perf_test, parse one object of %zu members mic secs: %lu\n", wide.to_object()->size(), end - start);
+
+                double sum = 0;
+                start = get_microseconds();
+                for (size_t pass = 0; pass < 10; pass++)
+                        for (json::object::const_iterator iter = wide.to_object()->begin(); iter != wide.to_object()->end(); ++iter)
+                                sum += iter->second.numb();
+                end = get_microseconds();
+                fprintf(stderr, "perf_test, iterate members x10 (%.0f) mic secs: %lu\n", sum, end - start);
+
+                std::map<subbuffer, json::value> sorted(wide.to_object()->begin(), wide.to_object()->end());
+                sum = 0;
+                start = get_microseconds();
+                for (size_t pass = 0; pass < 10; pass++)
+                        for (std::map<subbuffer, json::value>::const_iterator iter = sorted.begin(); iter != sorted.end(); ++iter)
+                                sum += iter->second.numb();
+                end = get_microseconds();
+                fprintf(stderr, "perf_test, iterate a std::map of them x10 (%.0f) mic secs: %lu\n", sum, end - start);
+        }
+
+        // one key repeated many times, each policy vs the same number of distinct keys
+        {
+                std::string repeated("{");
+                std::string distinct("{");
+                for (size_t i = 0; i < 100000; i++)
+                {
+                        const char* sep = i ? "," : "";
+                        sprintf(buff, "%s\"key\": {\"v\": [%zu, %zu, \"x\"]}", sep, i, i + 1);
+                        repeated += buff;
+                        sprintf(buff, "%s\"key%zu\": {\"v\": [%zu, %zu, \"x\"]}", sep, i, i, i + 1);
+                        distinct += buff;
+                }
+                repeated += "}";
+                distinct += "}";
+                const char* names[] = { "last wins", "first wins", "reject", "keep all" };
+                json::parse_options opts;
+                for (int policy = json::DUPLICATES_LAST; policy <= json::DUPLICATES_KEEP; policy++)
+                {
+                        opts.duplicates = json::duplicate_keys(policy);
+                        start = get_microseconds();
+                        json::root r(repeated, opts);
+                        end = get_microseconds();
+                        fprintf(stderr, "perf_test, 100000 repeated keys, %s, mic secs: %lu%s\n", names[policy], end - start,
+                                r.is_valid() ? "" : " (rejected)");
+                }
+                opts.duplicates = json::DUPLICATES_LAST;
+                start = get_microseconds();
+                json::root r(distinct, opts);
+                end = get_microseconds();
+                fprintf(stderr, "perf_test, 100000 distinct keys mic secs: %lu\n", end - start);
+        }
+
+        // const lookups from 1, 2, 4 and 8 threads over the same document, each thread does the same work
+        for (size_t threads = 1; threads <= 8; threads *= 2)
+        {
+                const json::value& croot = root;
+                std::vector<double> sums(threads, 0);
+                std::vector<std::thread> pool;
+                start = get_microseconds();
+                for (size_t n = 0; n < threads; n++)
+                {
+                        pool.push_back(std::thread([&croot, &sums, n]() {
+                                double sum = 0;
+                                for (size_t pass = 0; pass < 4; pass++)
+                                        for (size_t i = 0; i < croot.size(); i++)
+                                                sum += croot[i][CONST_SUBBUF("index")].numb() + croot[i][CONST_SUBBUF("numbs")][size_t(50)].numb();
+                                sums[n] = sum;
+                        }));
+                }
+                for (size_t n = 0; n < threads; n++)
+                        pool[n].join();
+                end = get_microseconds();
+                fprintf(stderr, "perf_test, %zu reader threads, %zu lookups each, mic secs: %lu (%u cpus)\n",
+                        threads, root.size() * 8, end - start, std::thread::hardware_concurrency());
+        }
+
+        // the same parse computing every container's content hash on the way
+        json::parse_options opts;
+        opts.content_hashes = true;
+        start = get_microseconds();
+        json::root hashed(json_text, opts);
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, parse with content hashes mic secs: %lu\n", end - start);
+
+        // numbers arrays packed, then summed straight from the buffers
+        json::parse_options packed_opts;
+        packed_opts.packed_numbers = true;
+        start = get_microseconds();
+        const json::root packed(json_text, packed_opts);
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, parse with packed numbers mic secs: %lu, footprint %zu bytes (%zu unpacked)\n",
+                end - start, packed.footprint(), hashed.footprint());
+        double total = 0;
+        start = get_microseconds();
+        for (size_t s = 0; s < packed.size(); s++)
+        {
+                json::span<const int64_t> numbs = packed[s][CONST_SUBBUF("numbs")].as_span<int64_t>();
+                for (size_t i = 0; i < numbs.size(); i++)
+                        total += numbs[i];
+        }
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, sum of numbs from the packed buffers (%.0f) mic secs: %lu\n", total, end - start);
+        total = 0;
+        start = get_microseconds();
+        for (size_t s = 0; s < hashed.size(); s++)
+        {
+                const json::value& numbs = static_cast<const json::value&>(hashed)[s][CONST_SUBBUF("numbs")];
+                for (size_t i = 0; i < numbs.size(); i++)
+                        total += numbs[i].numb();
+        }
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, sum of numbs from the values (%.0f) mic secs: %lu\n", total, end - start);
+
+        // "did it change": compare against a copy with one number changed near the end
+        std::string changed(json_text);
+        changed[changed.rfind("99]") + 1] = '8';
+        json::root other(changed, opts);
+        start = get_microseconds();
+        bool same = hashed.equals(other);
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, equals with content hashes (%s) mic secs: %lu\n", same ? "same" : "different", end - start);
+
+        start = get_microseconds();
+        std::string w1, w2;
+        hashed.to_json(w1);
+        other.to_json(w2);
+        same = (w1 == w2);
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, serialize and compare (%s) mic secs: %lu\n", same ? "same" : "different", end - start);
+
+        // re-serialize with a handful of modified objects
+        for (size_t s = 0; s < root.size(); s += root.size() / 8 + 1)
+                root[s].mark_modified();
+        std::string out;
+        out.reserve(json_text.length());
+        start = get_microseconds();
+        root.write(out);
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, write %zu bytes mic secs: %lu\n", out.length(), end - start);
+
+        // patch a handful of values in place and write again, nothing is re-parsed
+        start = get_microseconds();
+        for (size_t s = 0; s < root.size(); s += root.size() / 8 + 1)
+        {
+                root[s].set(CONST_SUBBUF("host"), "patched");
+                root[s][CONST_SUBBUF("numbs")].push_back(101);
+        }
+        out.clear();
+        root.write(out);
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, patch and write %zu bytes mic secs: %lu\n", out.length(), end - start);
+
+        // string heavy: mostly clean text with the occasional quote or newline
+        std::string text;
+        for (uint64_t i = 0; text.length() < perf_size * 1000; i++)
+        {
+                text += "A fairly ordinary sentence about srv";
+                text += char('0' + i % 10);
+                text += (i % 7) ? " that needs no escaping at all. " : " with a \"quote\" and a\nnewline. ";
+        }
+        out.clear();
+        start = get_microseconds();
+        json_object::json_friendly::append(out, text);
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, escape %zu bytes mic secs: %lu (%.1f MB/s)\n", text.length(), end - start,
+                double(text.length()) / double(end - start + 1));
 }
 
 void test_reported_error_1(wbtester& t)
@@ -310,6 +1127,16 @@ int main(int argc, char** argv)
         t.ADD_TEST(test_reported_error_1);
         t.ADD_TEST(test_invalid_json);
         t.ADD_TEST(test_recursive_json);
+        t.ADD_TEST(test_write);
+        t.ADD_TEST(test_builder);
+        t.ADD_TEST(test_mutate);
+        t.ADD_TEST(test_content_hash);
+        t.ADD_TEST(test_packed);
+        t.ADD_TEST(test_unset);
+        t.ADD_TEST(test_concurrent_reads);
+        t.ADD_TEST(test_key);
+        t.ADD_TEST(test_member_order);
+        t.ADD_TEST(test_duplicates);
 
         return t.run();
 }
@@ -0,0 +1,253 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    whitebox_json_patch.cc
+//: \details: Test driver for JSON Patch and JSON Merge Patch
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#define JSON_TRACE(fmt, x...) do { } while(0)
+
+#include "json_patch.h"
+#include "wbtest.h"
+
+#include <string>
+#include <vector>
+
+#include <sys/time.h>
+
+static uint64_t get_microseconds()
+{
+        timeval tv;
+        ::gettimeofday(&tv, 0);
+        return static_cast <uint64_t>((static_cast <uint64_t>(tv.tv_sec) * 1000000)  + tv.tv_usec);
+}
+
+/// apply patch to doc and compare the written result with expected (by value, not by text)
+static bool patched(const char* doc, const char* patch, const char* expected)
+{
+        json::root r(doc);
+        if (!json::apply_patch(r, patch)) return false;
+        std::string out;
+        r.write(out);
+        json::root check(out);
+        json::root want(expected);
+        return check.is_valid() && check.equals(want);
+}
+
+static bool merged(const char* doc, const char* patch, const char* expected)
+{
+        json::root r(doc);
+        if (!json::merge_patch(r, patch)) return false;
+        std::string out;
+        r.write(out);
+        json::root check(out);
+        json::root want(expected);
+        return check.is_valid() && check.equals(want);
+}
+
+static bool fails(const char* doc, const char* patch, size_t failed_op = 0)
+{
+        json::root r(doc);
+        json::patch_result res;
+        return !json::apply_patch(r, patch, &res) && res.failed_op == failed_op && !res.error.empty();
+}
+
+static void test_rfc6902(wbtester& t)
+{
+        // the examples from RFC 6902 appendix A
+        t.REQUIRE(patched("{\"foo\": \"bar\"}", "[{\"op\": \"add\", \"path\": \"/baz\", \"value\": \"qux\"}]",
+                          "{\"baz\": \"qux\", \"foo\": \"bar\"}"));
+        t.REQUIRE(patched("{\"foo\": [\"bar\", \"baz\"]}", "[{\"op\": \"add\", \"path\": \"/foo/1\", \"value\": \"qux\"}]",
+                          "{\"foo\": [\"bar\", \"qux\", \"baz\"]}"));
+        t.REQUIRE(patched("{\"baz\": \"qux\", \"foo\": \"bar\"}", "[{\"op\": \"remove\", \"path\": \"/baz\"}]",
+                          "{\"foo\": \"bar\"}"));
+        t.REQUIRE(patched("{\"foo\": [\"bar\", \"qux\", \"baz\"]}", "[{\"op\": \"remove\", \"path\": \"/foo/1\"}]",
+                          "{\"foo\": [\"bar\", \"baz\"]}"));
+        t.REQUIRE(patched("{\"baz\": \"qux\", \"foo\": \"bar\"}", "[{\"op\": \"replace\", \"path\": \"/baz\", \"value\": \"boo\"}]",
+                          "{\"baz\": \"boo\", \"foo\": \"bar\"}"));
+        t.REQUIRE(patched("{\"foo\": {\"bar\": \"baz\", \"waldo\": \"fred\"}, \"qux\": {\"corge\": \"grault\"}}",
+                          "[{\"op\": \"move\", \"from\": \"/foo/waldo\", \"path\": \"/qux/thud\"}]",
+                          "{\"foo\": {\"bar\": \"baz\"}, \"qux\": {\"corge\": \"grault\", \"thud\": \"fred\"}}"));
+        t.REQUIRE(patched("{\"foo\": [\"all\", \"grass\", \"cows\", \"eat\"]}",
+                          "[{\"op\": \"move\", \"from\": \"/foo/1\", \"path\": \"/foo/3\"}]",
+                          "{\"foo\": [\"all\", \"cows\", \"eat\", \"grass\"]}"));
+        t.REQUIRE(patched("{\"baz\": \"qux\", \"foo\": [\"a\", 2, \"c\"]}",
+                          "[{\"op\": \"test\", \"path\": \"/baz\", \"value\": \"qux\"}, {\"op\": \"test\", \"path\": \"/foo/1\", \"value\": 2}]",
+                          "{\"baz\": \"qux\", \"foo\": [\"a\", 2, \"c\"]}"));
+        t.REQUIRE(fails("{\"baz\": \"qux\"}", "[{\"op\": \"test\", \"path\": \"/baz\", \"value\": \"bar\"}]"));
+        t.REQUIRE(patched("{\"foo\": \"bar\"}", "[{\"op\": \"add\", \"path\": \"/child\", \"value\": {\"grandchild\": {}}}]",
+                          "{\"foo\": \"bar\", \"child\": {\"grandchild\": {}}}"));
+        t.REQUIRE(patched("{\"foo\": \"bar\"}", "[{\"op\": \"add\", \"path\": \"/baz\", \"value\": \"qux\", \"xyz\": 123}]",
+                          "{\"foo\": \"bar\", \"baz\": \"qux\"}"));
+        t.REQUIRE(fails("{\"foo\": \"bar\"}", "[{\"op\": \"add\", \"path\": \"/baz/bat\", \"value\": \"qux\"}]"));
+        t.REQUIRE(patched("{\"/\": 9, \"~1\": 10}", "[{\"op\": \"test\", \"path\": \"/~01\", \"value\": 10}]",
+                          "{\"/\": 9, \"~1\": 10}"));
+        t.REQUIRE(fails("{\"/\": 9, \"~1\": 10}", "[{\"op\": \"test\", \"path\": \"/~01\", \"value\": \"10\"}]"));
+        t.REQUIRE(patched("{\"foo\": [\"bar\"]}", "[{\"op\": \"add\", \"path\": \"/foo/-\", \"value\": [\"abc\", \"def\"]}]",
+                          "{\"foo\": [\"bar\", [\"abc\", \"def\"]]}"));
+}
+
+static void test_patch_ops(wbtester& t)
+{
+        // copy, the whole document, escaped keys and deep tests
+        t.REQUIRE(patched("{\"a\": {\"b\": [1, 2]}}", "[{\"op\": \"copy\", \"from\": \"/a\", \"path\": \"/c\"},"
+                          "{\"op\": \"add\", \"path\": \"/c/b/-\", \"value\": 3}]",
+                          "{\"a\": {\"b\": [1, 2]}, \"c\": {\"b\": [1, 2, 3]}}"));
+        t.REQUIRE(patched("{\"a\": 1}", "[{\"op\": \"replace\", \"path\": \"\", \"value\": [true]}]", "[true]"));
+        t.REQUIRE(patched("{\"a\": {\"b\": 1}}", "[{\"op\": \"move\", \"from\": \"/a\", \"path\": \"\"}]", "{\"b\": 1}"));
+        t.REQUIRE(patched("{\"a/b\": {\"c~d\": 1}}", "[{\"op\": \"replace\", \"path\": \"/a~1b/c~0d\", \"value\": null}]",
+                          "{\"a/b\": {\"c~d\": null}}"));
+        t.REQUIRE(patched("{\"k\\tey\": \"\\u00e9\"}", "[{\"op\": \"test\", \"path\": \"/k\\tey\", \"value\": \"\xc3\xa9\"}]",
+                          "{\"k\\tey\": \"\xc3\xa9\"}"));
+        t.REQUIRE(patched("{\"a\": {\"x\": [1, {\"y\": 1.0}], \"z\": false}}",
+                          "[{\"op\": \"test\", \"path\": \"/a\", \"value\": {\"z\": false, \"x\": [1e0, {\"y\": 1}]}}]",
+                          "{\"a\": {\"x\": [1, {\"y\": 1}], \"z\": false}}"));
+        t.REQUIRE(patched("{\"a\": [1]}", "[{\"op\": \"move\", \"from\": \"/a\", \"path\": \"/a\"}]", "{\"a\": [1]}"));
+
+        // errors report the failing operation, the ones before it stay applied
+        json::root r("{\"a\": [1, 2]}");
+        json::patch_result res;
+        t.REQUIRE(!json::apply_patch(r, "[{\"op\": \"remove\", \"path\": \"/a/0\"}, {\"op\": \"remove\", \"path\": \"/a/5\"}]", &res));
+        t.REQUIRE(res.failed_op == 1);
+        t.REQUIRE(r["a"].size() == 1);
+
+        t.REQUIRE(fails("{\"a\": {}}", "[{\"op\": \"move\", \"from\": \"/a\", \"path\": \"/a/b\"}]"));
+        t.REQUIRE(fails("{\"a\": [1]}", "[{\"op\": \"add\", \"path\": \"/a/2\", \"value\": 1}]"));
+        t.REQUIRE(fails("{\"a\": [1]}", "[{\"op\": \"add\", \"path\": \"/a/01\", \"value\": 1}]"));
+        t.REQUIRE(fails("{\"a\": [1]}", "[{\"op\": \"replace\", \"path\": \"/b\", \"value\": 1}]"));
+        t.REQUIRE(fails("{\"a\": [1]}", "[{\"op\": \"remove\", \"path\": \"a\"}]"));
+        t.REQUIRE(fails("{\"a\": [1]}", "[{\"op\": \"add\", \"path\": \"/a/0\"}]"));
+        t.REQUIRE(fails("{\"a\": [1]}", "[{\"op\": \"jump\", \"path\": \"/a\"}]"));
+        t.REQUIRE(fails("{\"a\": [1]}", "[{\"op\": \"test\", \"path\": \"/a\", \"value\": [1]}, {\"op\": \"copy\", \"path\": \"/b\"}]", 1));
+        t.REQUIRE(!json::apply_patch(r, "{\"op\": \"remove\", \"path\": \"/a\"}"));
+        t.REQUIRE(!json::apply_patch(r, "[{\"op\": "));
+
+        // untouched subtrees are copied from the original text
+        json::root doc("{\"keep\": [1,  2,   3], \"change\": {\"x\": 1}}");
+        t.REQUIRE(json::apply_patch(doc, "[{\"op\": \"replace\", \"path\": \"/change/x\", \"value\": \"y\"}]"));
+        t.REQUIRE(!doc["keep"].is_modified());
+        std::string out;
+        doc.write(out);
+        t.REQUIRE(out.find("[1,  2,   3]") != std::string::npos);
+}
+
+static void test_merge_patch(wbtester& t)
+{
+        // the examples from RFC 7396 appendix A
+        t.REQUIRE(merged("{\"a\":\"b\"}", "{\"a\":\"c\"}", "{\"a\":\"c\"}"));
+        t.REQUIRE(merged("{\"a\":\"b\"}", "{\"b\":\"c\"}", "{\"a\":\"b\",\"b\":\"c\"}"));
+        t.REQUIRE(merged("{\"a\":\"b\"}", "{\"a\":null}", "{}"));
+        t.REQUIRE(merged("{\"a\":\"b\",\"b\":\"c\"}", "{\"a\":null}", "{\"b\":\"c\"}"));
+        t.REQUIRE(merged("{\"a\":[\"b\"]}", "{\"a\":\"c\"}", "{\"a\":\"c\"}"));
+        t.REQUIRE(merged("{\"a\":\"c\"}", "{\"a\":[\"b\"]}", "{\"a\":[\"b\"]}"));
+        t.REQUIRE(merged("{\"a\":{\"b\":\"c\"}}", "{\"a\":{\"b\":\"d\",\"c\":null}}", "{\"a\":{\"b\":\"d\"}}"));
+        t.REQUIRE(merged("{\"a\":[{\"b\":\"c\"}]}", "{\"a\":[1]}", "{\"a\":[1]}"));
+        t.REQUIRE(merged("[\"a\",\"b\"]", "[\"c\",\"d\"]", "[\"c\",\"d\"]"));
+        t.REQUIRE(merged("{\"a\":\"b\"}", "[\"c\"]", "[\"c\"]"));
+        t.REQUIRE(merged("{\"e\":null}", "{\"a\":1}", "{\"e\":null,\"a\":1}"));
+        t.REQUIRE(merged("[1,2]", "{\"a\":\"b\",\"c\":null}", "{\"a\":\"b\"}"));
+        t.REQUIRE(merged("{}", "{\"a\":{\"bb\":{\"ccc\":null}}}", "{\"a\":{\"bb\":{}}}"));
+
+        json::root r("{\"a\": 1}");
+        t.REQUIRE(!json::merge_patch(r, "{\"a\": "));
+}
+
+static void run_perf_test(uint64_t perf_size)
+{
+        // about perf_size bytes of objects, each with a few members
+        std::string text;
+        json_builder<std::string> jb(text);
+        jb.open_object();
+        uint64_t count = 0;
+        while (text.length() < perf_size)
+        {
+                char key[32];
+                snprintf(key, sizeof(key), "item%lu", count++);
+                jb.open_object(key);
+                jb.add("name", "a name that takes up some room");
+                jb.add("count", count);
+                jb.open_array("tags").add("one").add("two").add("three").close();
+                jb.close();
+        }
+        jb.close();
+
+        // 1K small, separate patches spread over the document
+        std::vector<std::string> patches;
+        for (size_t i = 0; i < 1000; i++)
+        {
+                char op[160];
+                if (i & 1)
+                        snprintf(op, sizeof(op), "[{\"op\": \"replace\", \"path\": \"/item%lu/count\", \"value\": %zu}]",
+                                 (i * 7919) % count, i);
+                else
+                        snprintf(op, sizeof(op), "[{\"op\": \"add\", \"path\": \"/item%lu/tags/-\", \"value\": \"t%zu\"}]",
+                                 (i * 7919) % count, i);
+                patches.push_back(op);
+        }
+
+        json::root doc(text);
+        uint64_t start = get_microseconds();
+        for (size_t i = 0; i < patches.size(); i++)
+                json::apply_patch(doc, patches[i]);
+        uint64_t end = get_microseconds();
+        fprintf(stderr, "perf_test, %zu patches on %zu bytes, mic secs: %lu\n", patches.size(), text.length(), end - start);
+
+        std::string out;
+        out.reserve(text.length() * 2);
+        start = get_microseconds();
+        doc.write(out);
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, write of the patched document %zu bytes, mic secs: %lu\n", out.length(), end - start);
+
+        // what rebuilding the whole document through json_object costs, paid after every patch without write()
+        std::string rebuilt;
+        start = get_microseconds();
+        json_object obj;
+        doc.to_json(obj, "doc");
+        obj.to_string(rebuilt);
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, one full rebuild %zu bytes, mic secs: %lu\n", rebuilt.length(), end - start);
+}
+
+int main(int argc, char** argv)
+{
+        bool do_perf = false;
+        uint64_t perf_size = 10 * 1024 * 1024;
+
+        for (int i = 1; i < argc; i++)
+        {
+                subbuffer arg(argv[i]);
+                if (arg.equals(CONST_SUBBUF("--perf")))
+                        do_perf = true;
+                else if (arg.starts_with(CONST_SUBBUF("--perf-size=")))
+                        perf_size = aton<uint64_t>(arg.after('='));
+        }
+
+        if (do_perf)
+        {
+                run_perf_test(perf_size);
+                return 0;
+        }
+
+        wbtester t;
+
+        t.ADD_TEST(test_rfc6902);
+        t.ADD_TEST(test_patch_ops);
+        t.ADD_TEST(test_merge_patch);
+
+        return t.run();
+}
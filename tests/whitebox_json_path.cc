@@ -0,0 +1,324 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    whitebox_json_path.cc
+//: \details: Test driver for JSONPath queries
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#define JSON_TRACE(fmt, x...) do { } while(0)
+
+#include "json_path.h"
+#include "wbtest.h"
+
+#include <string>
+#include <vector>
+
+#include <sys/time.h>
+
+static uint64_t get_microseconds()
+{
+        timeval tv;
+        ::gettimeofday(&tv, 0);
+        return static_cast <uint64_t>((static_cast <uint64_t>(tv.tv_sec) * 1000000)  + tv.tv_usec);
+}
+
+static const char* s_store =
+        "{\"store\": {"
+        "  \"book\": ["
+        "    {\"category\": \"reference\", \"author\": \"Nigel Rees\", \"title\": \"Sayings of the Century\", \"price\": 8.95},"
+        "    {\"category\": \"fiction\", \"author\": \"Evelyn Waugh\", \"title\": \"Sword of Honour\", \"price\": 12.99},"
+        "    {\"category\": \"fiction\", \"author\": \"Herman Melville\", \"title\": \"Moby Dick\", \"isbn\": \"0-553-21311-3\", \"price\": 8.99},"
+        "    {\"category\": \"fiction\", \"author\": \"J. R. R. Tolkien\", \"title\": \"The Lord of the Rings\", \"isbn\": \"0-395-19395-8\", \"price\": 22.99}"
+        "  ],"
+        "  \"bicycle\": {\"color\": \"red\", \"price\": 19.95}"
+        "}}";
+
+/// the matches of query, each written out and joined with spaces
+static std::string query(const json::value& root, const char* q)
+{
+        json::path p(q);
+        if (!p.is_valid()) return "invalid";
+        std::vector<const json::value*> out;
+        p.select(root, out);
+        std::string res;
+        for (size_t i = 0; i < out.size(); i++)
+        {
+                if (i) res += ' ';
+                if (out[i]->is_unset())
+                        res += "null";
+                else if (out[i]->is_bool())
+                        res += out[i]->bval() ? "true" : "false";
+                else
+                        res.append(out[i]->raw_subbuffer().begin(), out[i]->raw_subbuffer().length());
+        }
+        return res;
+}
+
+static void test_paths(wbtester& t)
+{
+        json::root r(s_store);
+        t.REQUIRE(r.is_valid());
+
+        t.REQUIRE(query(r, "$.store.bicycle.color") == "red");
+        t.REQUIRE(query(r, "$['store']['bicycle'][\"price\"]") == "19.95");
+        t.REQUIRE(query(r, "$.store.book[0].title") == "Sayings of the Century");
+        t.REQUIRE(query(r, "$.store.book[-1].price") == "22.99");
+        t.REQUIRE(query(r, "$.store.book[4]") == "");
+        t.REQUIRE(query(r, "$.store.book[*].price") == "8.95 12.99 8.99 22.99");
+        t.REQUIRE(query(r, "$.store.book[1:3].price") == "12.99 8.99");
+        t.REQUIRE(query(r, "$.store.book[::2].price") == "8.95 8.99");
+        t.REQUIRE(query(r, "$.store.book[-2:].price") == "8.99 22.99");
+        t.REQUIRE(query(r, "$.store.book[:-3].price") == "8.95");
+        t.REQUIRE(query(r, "$.store.bicycle.*") == "red 19.95");
+        t.REQUIRE(query(r, "$.store.nothing.price") == "");
+        t.REQUIRE(query(r, "$.store.bicycle[0]") == "");
+
+        // recursive descent, members are visited in document order
+        t.REQUIRE(query(r, "$..author") == "Nigel Rees Evelyn Waugh Herman Melville J. R. R. Tolkien");
+        t.REQUIRE(query(r, "$.store..price") == "8.95 12.99 8.99 22.99 19.95");
+        t.REQUIRE(query(r, "$..book[2].title") == "Moby Dick");
+        t.REQUIRE(query(r, "$..*").length() > 0);
+
+        json::path p("$");
+        t.REQUIRE(p.first(r) == &r);
+
+        // names that need escaping in the document
+        json::root esc("{\"a\\tb\": {\"x\": 1}, \"c d\": 2}");
+        t.REQUIRE(query(esc, "$['a\\tb'].x") == "1");
+        t.REQUIRE(query(esc, "$['c d']") == "2");
+}
+
+static void test_filters(wbtester& t)
+{
+        json::root r(s_store);
+
+        t.REQUIRE(query(r, "$.store.book[?(@.price < 10)].title") == "Sayings of the Century Moby Dick");
+        t.REQUIRE(query(r, "$.store.book[?(@.isbn)].price") == "8.99 22.99");
+        t.REQUIRE(query(r, "$.store.book[?(@.category == 'fiction' && @.price >= 12.99)].author") == "Evelyn Waugh J. R. R. Tolkien");
+        t.REQUIRE(query(r, "$.store.book[?(@.category == \"reference\" || @.price > 20)].price") == "8.95 22.99");
+        t.REQUIRE(query(r, "$.store.book[?(@.author != 'Nigel Rees')].price") == "12.99 8.99 22.99");
+        t.REQUIRE(query(r, "$..[?(@.price <= 8.99)].price") == "8.95 8.99");
+        t.REQUIRE(query(r, "$.store[?(@.color == 'red')].price") == "19.95");
+
+        json::root v("{\"a\": [{\"v\": null}, {\"v\": true}, {\"v\": false}, {\"v\": 1}, {\"v\": \"x\\ty\"}, {\"w\": [5, 6]}]}");
+        t.REQUIRE(query(v, "$.a[?(@.v == null)].v") == "null");
+        t.REQUIRE(query(v, "$.a[?(@.v)]").length() > 0);
+        t.REQUIRE(json::path("$.a[?(@.v)]").steps().size() == 2);
+        std::vector<const json::value*> out;
+        t.REQUIRE(json::path("$.a[?(@.v)]").select(v, out) == 5);
+        t.REQUIRE(query(v, "$.a[?(@.v == true)].v") == "true");
+        t.REQUIRE(query(v, "$.a[?(@.v != true)].v") == "null false 1 x\\ty");
+        t.REQUIRE(query(v, "$.a[?(@.v == 'x\\ty')].v") == "x\\ty");
+        t.REQUIRE(query(v, "$.a[?(@.v > 'x')].v") == "x\\ty");
+        t.REQUIRE(query(v, "$.a[?(@.w[1] == 6)].w") == "[5, 6]");
+        t.REQUIRE(query(v, "$.a[?(@.w[-1] == 6)].w[0]") == "5");
+        t.REQUIRE(query(v, "$.a[?(@.v == 1e0)].v") == "1");
+        t.REQUIRE(query(v, "$.a[?(@.v < 'a')]") == "");
+}
+
+/// the matches of query run over the raw text, joined with spaces
+static std::string streamed(const char* text, const char* q)
+{
+        json::path p(q);
+        std::string res;
+        bool first = true;
+        bool ok = p.stream(text, [&](subbuffer match) {
+                if (!first) res += ' ';
+                first = false;
+                res.append(match.begin(), match.length());
+        });
+        return ok ? res : "failed";
+}
+
+static void test_stream(wbtester& t)
+{
+        t.REQUIRE(streamed(s_store, "$.store.bicycle.color") == "\"red\"");
+        t.REQUIRE(streamed(s_store, "$.store.book[0].title") == "\"Sayings of the Century\"");
+        t.REQUIRE(streamed(s_store, "$.store.book[*].price") == "8.95 12.99 8.99 22.99");
+        t.REQUIRE(streamed(s_store, "$.store.book[1:3].price") == "12.99 8.99");
+        t.REQUIRE(streamed(s_store, "$.store.book[::2].price") == "8.95 8.99");
+        t.REQUIRE(streamed(s_store, "$.store.book[4]") == "");
+        t.REQUIRE(streamed(s_store, "$.store.*.price") == "19.95");
+        t.REQUIRE(streamed(s_store, "$.store.bicycle") == "{\"color\": \"red\", \"price\": 19.95}");
+        t.REQUIRE(streamed(s_store, "$.store.book[?(@.price < 10)].title") == "\"Sayings of the Century\" \"Moby Dick\"");
+        t.REQUIRE(streamed(s_store, "$.store.book[?(@.category == 'fiction' && @.isbn)].price") == "8.99 22.99");
+        t.REQUIRE(streamed(s_store, "$.store[?(@.color == 'red')].price") == "19.95");
+
+        const char* v = "{\"a\": [{\"v\": null}, {\"v\": true}, {\"v\": false}, {\"v\": 1}, {\"v\": \"x\\ty\"}, {\"w\": [5, 6]}], \"k\\u0041\": 7}";
+        t.REQUIRE(streamed(v, "$.a[?(@.v == null)].v") == "null");
+        t.REQUIRE(streamed(v, "$.a[?(@.v != true)].v") == "null false 1 \"x\\ty\"");
+        t.REQUIRE(streamed(v, "$.a[?(@.v == 'x\\ty')].v") == "\"x\\ty\"");
+        t.REQUIRE(streamed(v, "$.a[?(@.v > 0)].v") == "1");
+        t.REQUIRE(streamed(v, "$.a[?(@.w[1] == 6)].w[0]") == "5");
+        t.REQUIRE(streamed(v, "$.kA") == "7");
+        json::root rv(v);
+        t.REQUIRE(query(rv, "$.kA") == "7");
+        t.REQUIRE(query(rv, "$['kA']") == "7");
+        const char* items = "{\"items\": [{\"k\\u0041\": 1}, {\"kA\": 2}, {\"kB\": 3}]}";
+        json::root ri(items);
+        t.REQUIRE(query(ri, "$.items[?(@.kA)].kA") == "1 2");
+        t.REQUIRE(streamed(items, "$.items[?(@.kA)].kA") == "1 2");
+
+        // a repeated key matches once, at its first value, like a root parsed with DUPLICATES_FIRST
+        const char* dup = "{\"a\": 1, \"b\": [{\"c\": {\"d\": 2}, \"c\": 1}], \"a\": {\"x\": 3}}";
+        json::parse_options first;
+        first.duplicates = json::DUPLICATES_FIRST;
+        json::root rd(dup, first);
+        t.REQUIRE(streamed(dup, "$.a") == "1");
+        t.REQUIRE(query(rd, "$.a") == "1");
+        t.REQUIRE(streamed(dup, "$.a.x") == "");
+        t.REQUIRE(streamed(dup, "$.b[0].c.d") == "2");
+        t.REQUIRE(query(rd, "$.b[0].c.d") == "2");
+        t.REQUIRE(streamed(dup, "$.b[?(@.c.d == 2)].c") == "{\"d\": 2}");
+        t.REQUIRE(query(rd, "$.b[?(@.c.d == 2)].c") == "{\"d\": 2}");
+        t.REQUIRE(streamed("{\"a\": 1, \"a\": 2}", "$.a") == "1");
+
+        // the same matches as the DOM
+        const char* queries[] = { "$.store.book[*].author", "$.store.book[?(@.price > 9 || @.isbn)]", "$.store.*", "$.store.book[2:]" };
+        json::root r(s_store);
+        for (size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); i++)
+        {
+                json::path p(queries[i]);
+                std::vector<const json::value*> out;
+                size_t n = 0;
+                t.REQUIRE(p.stream(s_store, [&](subbuffer) { n++; }));
+                t.REQUIRE(p.select(r, out) == n);
+        }
+
+        // not streamable, or not well formed
+        t.REQUIRE(!json::path("$..price").streamable());
+        t.REQUIRE(!json::path("$.a[-1]").streamable());
+        t.REQUIRE(!json::path("$.a[-2:]").streamable());
+        t.REQUIRE(!json::path("$.a[?(@.b[-1])]").streamable());
+        t.REQUIRE(json::path("$.a[?(@.b[1])]").streamable());
+        t.REQUIRE(streamed(s_store, "$..price") == "failed");
+        t.REQUIRE(streamed("{\"a\": [1, 2", "$.a[*]") == "failed");
+        t.REQUIRE(streamed("{\"a\": 1} x", "$.a") == "failed");
+        t.REQUIRE(streamed("{\"a\" 1}", "$.a") == "failed");
+        t.REQUIRE(streamed("[]", "$[0]") == "");
+        t.REQUIRE(streamed(" 5 ", "$") == "5");
+}
+
+static void test_invalid(wbtester& t)
+{
+        const char* bad[] = { "", "store", "$.", "$[", "$[1", "$['a]", "$[?(@.a]", "$[?(a)]", "$[?(@.a == )]",
+                              "$[?(@.a == nope)]", "$[::0]", "$[::-1]", "$.a b", "$[]", "$[?(@.)]" };
+        for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+        {
+                json::path p(bad[i]);
+                t.REQUIRE(!p.is_valid());
+                t.REQUIRE(!p.error().empty());
+        }
+
+        json::root r("{\"a\": 1}");
+        json::path p("$.a[");
+        std::vector<const json::value*> out;
+        t.REQUIRE(p.select(r, out) == 0);
+        t.REQUIRE(p.first(r) == NULL);
+
+        // recompiling clears the error
+        t.REQUIRE(p.compile("$.a"));
+        t.REQUIRE(p.first(r) && p.first(r)->numb() == 1);
+}
+
+static void run_perf_test(uint64_t perf_size)
+{
+        std::string text = "{\"items\": [";
+        for (uint64_t i = 0; i < perf_size; i++)
+        {
+                char buf[128];
+                snprintf(buf, sizeof(buf), "%s{\"id\": %lu, \"age\": %lu, \"price\": %lu.5, \"name\": \"item%lu\"}",
+                         i ? "," : "", i, i % 60, i % 1000, i);
+                text += buf;
+        }
+        text += "]}";
+        uint64_t start = get_microseconds();
+        json::root r(text);
+        uint64_t end = get_microseconds();
+        fprintf(stderr, "perf_test, parse of %zu bytes, mic secs: %lu\n", text.length(), end - start);
+
+        json::path p("$.items[?(@.age > 30)].price");
+        std::vector<const json::value*> out;
+        out.reserve(perf_size);
+        start = get_microseconds();
+        for (int pass = 0; pass < 10; pass++)
+        {
+                out.clear();
+                p.select(r, out);
+        }
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, %zu matches in %lu elements, 10 passes, mic secs: %lu\n", out.size(), perf_size, end - start);
+
+        // the same by hand
+        std::vector<const json::value*> hand;
+        hand.reserve(perf_size);
+        start = get_microseconds();
+        for (int pass = 0; pass < 10; pass++)
+        {
+                hand.clear();
+                const json::value& items = r["items"];
+                for (size_t i = 0; i < items.size(); i++)
+                {
+                        const json::value& item = items[i];
+                        if (item["age"].is_number() && item["age"].numb() > 30)
+                                hand.push_back(&item["price"]);
+                }
+        }
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, hand written loop, %zu matches, 10 passes, mic secs: %lu\n", hand.size(), end - start);
+
+        // straight from the text, no document
+        size_t streamed = 0;
+        start = get_microseconds();
+        for (int pass = 0; pass < 10; pass++)
+        {
+                streamed = 0;
+                p.stream(text, [&](subbuffer) { streamed++; });
+        }
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, streamed from the text, %zu matches, 10 passes, mic secs: %lu\n", streamed, end - start);
+}
+
+int main(int argc, char** argv)
+{
+        bool do_perf = false;
+        uint64_t perf_size = 100000;
+
+        for (int i = 1; i < argc; i++)
+        {
+                subbuffer arg(argv[i]);
+                if (arg.equals(CONST_SUBBUF("--perf")))
+                        do_perf = true;
+                else if (arg.starts_with(CONST_SUBBUF("--perf-size=")))
+                        perf_size = aton<uint64_t>(arg.after('='));
+        }
+
+        if (do_perf)
+        {
+                run_perf_test(perf_size);
+                return 0;
+        }
+
+        wbtester t;
+
+        t.ADD_TEST(test_paths);
+        t.ADD_TEST(test_filters);
+        t.ADD_TEST(test_stream);
+        t.ADD_TEST(test_invalid);
+
+        return t.run();
+}
@@ -0,0 +1,207 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    whitebox_json_shared_document.cc
+//: \details: Test driver for the hot swappable shared document
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#define JSON_TRACE(fmt, x...) do { } while(0)
+#define JSON_WARNING(fmt, x...) do { } while(0)
+
+#include "json_shared_document.h"
+#include "wbtest.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/time.h>
+
+static uint64_t get_microseconds()
+{
+        timeval tv;
+        ::gettimeofday(&tv, 0);
+        return static_cast <uint64_t>((static_cast <uint64_t>(tv.tv_sec) * 1000000)  + tv.tv_usec);
+}
+
+static std::string make_version(size_t v)
+{
+        std::string text;
+        json_builder<std::string> jb(text);
+        jb.open_object().add("version", v).open_array("list");
+        for (size_t i = 0; i < 20; i++)
+                jb.add(v);
+        jb.close_all();
+        return text;
+}
+
+static void test_publish(wbtester& t)
+{
+        json::shared_document doc;
+        json::shared_document::reader r1(doc);
+        t.REQUIRE(r1.get() == NULL);
+
+        t.REQUIRE(doc.publish(make_version(1)));
+        const json::cached_document* v1 = r1.get();
+        t.REQUIRE(v1 && v1->root()["version"].numb() == 1);
+        t.REQUIRE(!doc.publish("{\"version\": "));
+        t.REQUIRE(r1.get() == v1);
+
+        // r1 may still be using version 1, so it is kept
+        json::shared_document::reader r2(doc);
+        t.REQUIRE(doc.publish(make_version(2)));
+        t.REQUIRE(r1.get()->root()["version"].numb() == 2);
+        t.REQUIRE(doc.pending() == 1);
+        t.REQUIRE(v1->root()["list"][size_t(19)].numb() == 1);
+
+        // r2 came online before the swap too, so both have to pass a quiescent point
+        r1.quiescent();
+        t.REQUIRE(doc.reclaim() == 1);
+        r2.quiescent();
+        t.REQUIRE(doc.reclaim() == 0);
+
+        // an offline reader doesn't hold anything back
+        r2.offline();
+        t.REQUIRE(doc.publish(make_version(3)));
+        t.REQUIRE(doc.pending() == 1);
+        r1.quiescent();
+        t.REQUIRE(doc.reclaim() == 0);
+        r2.online();
+        t.REQUIRE(r2.get()->root()["version"].numb() == 3);
+
+        // a reader going away counts as quiescent
+        {
+                json::shared_document::reader r3(doc);
+                doc.publish(make_version(4));
+                r1.quiescent();
+                r2.quiescent();
+                t.REQUIRE(doc.pending() == 1);
+        }
+        t.REQUIRE(doc.pending() == 0);
+}
+
+static void test_readers_and_writer(wbtester& t)
+{
+        json::shared_document doc;
+        doc.publish(make_version(0));
+
+        const size_t readers = 3;
+        const size_t versions = 200;
+        std::atomic<bool> done(false);
+        std::vector<size_t> wrong(readers, 0);
+        std::vector<size_t> reads(readers, 0);
+        std::vector<std::thread> pool;
+        for (size_t n = 0; n < readers; n++)
+        {
+                pool.push_back(std::thread([&doc, &done, &wrong, &reads, n]() {
+                        json::shared_document::reader r(doc);
+                        double last = 0;
+                        while (!done.load())
+                        {
+                                const json::value& root = r.get()->root();
+                                double v = root["version"].numb();
+                                // every element matches the version and versions only go forward
+                                for (size_t i = 0; i < root["list"].size(); i++)
+                                        if (root["list"][i].numb() != v) wrong[n]++;
+                                if (v < last) wrong[n]++;
+                                last = v;
+                                reads[n]++;
+                                r.quiescent();
+                        }
+                }));
+        }
+        for (size_t v = 1; v <= versions; v++)
+        {
+                doc.publish(make_version(v));
+                std::this_thread::yield();
+        }
+        done = true;
+        for (size_t n = 0; n < readers; n++)
+                pool[n].join();
+
+        for (size_t n = 0; n < readers; n++)
+        {
+                t.REQUIRE(wrong[n] == 0);
+                t.REQUIRE(reads[n] > 0);
+        }
+        t.REQUIRE(doc.reclaim() == 0);
+}
+
+static void run_perf_test(uint64_t perf_size)
+{
+        json::shared_document doc;
+        doc.publish(make_version(1));
+        json::shared_document::reader r(doc);
+
+        uint64_t start = get_microseconds();
+        double sum = 0;
+        for (uint64_t i = 0; i < perf_size; i++)
+        {
+                sum += r.get()->root()["list"].size();
+                if ((i & 1023) == 0) r.quiescent();
+        }
+        uint64_t end = get_microseconds();
+        fprintf(stderr, "perf_test, shared_document get + lookup x %lu, mic secs: %lu (%g)\n", perf_size, end - start, sum);
+
+        std::shared_ptr<const json::cached_document> sp(new json::cached_document(make_version(1), json::parse_options(), 0));
+        sum = 0;
+        start = get_microseconds();
+        for (uint64_t i = 0; i < perf_size; i++)
+        {
+                std::shared_ptr<const json::cached_document> local = std::atomic_load(&sp);
+                sum += local->root()["list"].size();
+        }
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, atomic_load(shared_ptr) + lookup x %lu, mic secs: %lu (%g)\n", perf_size, end - start, sum);
+
+        const json::cached_document* plain = r.get();
+        sum = 0;
+        start = get_microseconds();
+        for (uint64_t i = 0; i < perf_size; i++)
+                sum += plain->root()["list"].size();
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, plain pointer + lookup x %lu, mic secs: %lu (%g)\n", perf_size, end - start, sum);
+}
+
+int main(int argc, char** argv)
+{
+        bool do_perf = false;
+        uint64_t perf_size = 10000000;
+
+        for (int i = 1; i < argc; i++)
+        {
+                subbuffer arg(argv[i]);
+                if (arg.equals(CONST_SUBBUF("--perf")))
+                        do_perf = true;
+                else if (arg.starts_with(CONST_SUBBUF("--perf-size=")))
+                        perf_size = aton<uint64_t>(arg.after('='));
+        }
+
+        if (do_perf)
+        {
+                run_perf_test(perf_size);
+                return 0;
+        }
+
+        wbtester t;
+
+        t.ADD_TEST(test_publish);
+        t.ADD_TEST(test_readers_and_writer);
+
+        return t.run();
+}
@@ -0,0 +1,283 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    whitebox_json_snapshot.cc
+//: \details: Test driver for the binary snapshot of a parsed document
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#define JSON_TRACE(fmt, x...) do { } while(0)
+
+#include "json_snapshot.h"
+#include "wbtest.h"
+
+#include <string>
+
+#include <sys/time.h>
+
+static uint64_t get_microseconds()
+{
+        timeval tv;
+        ::gettimeofday(&tv, 0);
+        return static_cast <uint64_t>((static_cast <uint64_t>(tv.tv_sec) * 1000000)  + tv.tv_usec);
+}
+
+static bool write_file(const char* path, const std::string& text)
+{
+        FILE* f = fopen(path, "wb");
+        if (!f) return false;
+        bool ok = fwrite(text.data(), 1, text.length(), f) == text.length();
+        return (fclose(f) == 0) && ok;
+}
+
+static const char* s_doc = "{\"name\": \"snap\\\"shot\", \"pi\": 3.25, \"big\": -12345678901, \"on\": true, \"off\": false,"
+                           " \"none\": null, \"list\": [1, \"two\", [3], {\"four\": 4}], \"empty\": {}, \"nil\": [],"
+                           " \"nested\": {\"b\": {\"c\": \"deep\"}, \"a\": 1, \"ab\": 2, \"aa\": 3, \"\\u00e9\": \"e\"}}";
+
+static void test_snapshot(wbtester& t)
+{
+        t.REQUIRE(sizeof(json::snapshot_node) == 24);
+        t.REQUIRE(sizeof(json::snapshot_header) % 8 == 0);
+
+        json::root r(s_doc);
+        std::string image;
+        t.REQUIRE(json::snapshot::build(r, image));
+
+        json::snapshot snap;
+        t.REQUIRE(snap.load(image));
+        t.REQUIRE(snap.verify());
+
+        json::snapshot_value root = snap.root();
+        t.REQUIRE(root.is_object());
+        t.REQUIRE(root.size() == 10);
+        t.REQUIRE(root["name"].str().equals("snap\\\"shot"));
+        std::string s;
+        root["name"].unescape(s);
+        t.REQUIRE(s == "snap\"shot");
+        t.REQUIRE(root["pi"].numb() == 3.25);
+        t.REQUIRE(root["big"].numb() == -12345678901.0);
+        t.REQUIRE(root["on"].bval() && root["on"].is_bool());
+        t.REQUIRE(!root["off"].bval() && root["off"].is_bool());
+        t.REQUIRE(root["none"].is_unset() && root.exists("none"));
+        t.REQUIRE(!root.exists("missing"));
+        t.REQUIRE(root["missing"]["more"][size_t(3)].is_unset());
+
+        json::snapshot_value list = root["list"];
+        t.REQUIRE(list.is_array() && list.size() == 4);
+        t.REQUIRE(list[size_t(0)].numb() == 1);
+        t.REQUIRE(list[1].str().equals("two"));
+        t.REQUIRE(list[2][size_t(0)].numb() == 3);
+        t.REQUIRE(list[3]["four"].numb() == 4);
+        t.REQUIRE(list[4].is_unset());
+        t.REQUIRE(root["empty"].is_object() && root["empty"].size() == 0);
+        t.REQUIRE(root["nil"].is_array() && root["nil"].size() == 0);
+
+        // members are sorted, keys stay escaped like in json::root
+        json::snapshot_value nested = root["nested"];
+        t.REQUIRE(nested.size() == 5);
+        t.REQUIRE(nested[size_t(0)].key().equals("\\u00e9"));
+        t.REQUIRE(nested[1].key().equals("a") && nested[2].key().equals("aa") && nested[3].key().equals("ab"));
+        t.REQUIRE(nested["b"]["c"].str().equals("deep"));
+        t.REQUIRE(nested["\\u00e9"].str().equals("e"));
+        t.REQUIRE(nested["ab"].numb() == 2 && nested["aa"].numb() == 3);
+
+        // a top level value that isn't a container
+        json::root scalar("\"alone\"");
+        t.REQUIRE(json::snapshot::build(scalar, image));
+        t.REQUIRE(snap.load(image));
+        t.REQUIRE(snap.root().str().equals("alone"));
+}
+
+static void test_snapshot_damage(wbtester& t)
+{
+        json::root r(s_doc);
+        std::string image;
+        t.REQUIRE(json::snapshot::build(r, image));
+
+        json::snapshot snap;
+        std::string bad(image);
+        bad[bad.length() - 3] ^= 1;
+        t.REQUIRE(snap.load(bad));
+        t.REQUIRE(!snap.verify());
+
+        t.REQUIRE(!snap.load(std::string(image, 0, image.length() - 1)));
+        t.REQUIRE(!snap.is_loaded());
+        t.REQUIRE(snap.root().is_unset());
+        t.REQUIRE(!snap.load(subbuffer("not a snapshot at all, not even close to one, no", 49)));
+        bad = image;
+        bad[0] = 'X';
+        t.REQUIRE(!snap.load(bad));
+
+        // offsets in the body pointing outside the image read as nothing
+        bad = image;
+        json::snapshot_node* nodes = reinterpret_cast<json::snapshot_node*>(&bad[sizeof(json::snapshot_header)]);
+        nodes[0].u.offset = 0xFFFFFFFFFFull;
+        t.REQUIRE(snap.load(bad));
+        t.REQUIRE(!snap.verify());
+        t.REQUIRE(snap.root().size() == 0);
+        t.REQUIRE(snap.root()[size_t(0)].is_unset());
+        t.REQUIRE(snap.root()["nested"].is_unset());
+
+        bad = image;
+        nodes = reinterpret_cast<json::snapshot_node*>(&bad[sizeof(json::snapshot_header)]);
+        nodes[0].count = 0xFFFFFFFFu;
+        t.REQUIRE(snap.load(bad));
+        t.REQUIRE(snap.root().size() == 0);
+        t.REQUIRE(snap.root()[size_t(100)].is_unset());
+
+        // the root's first members start at node 1
+        bad = image;
+        nodes = reinterpret_cast<json::snapshot_node*>(&bad[sizeof(json::snapshot_header)]);
+        for (size_t n = 1; n < 4; n++)
+        {
+                nodes[n].key_offset = 0xFFFFFFF0u;
+                nodes[n].u.offset = 0xFFFFFFFFFFull;
+                nodes[n].count = 0x7FFFFFFFu;
+        }
+        t.REQUIRE(snap.load(bad));
+        for (size_t n = 0; n < 3; n++)
+        {
+                json::snapshot_value m = snap.root()[n];
+                t.REQUIRE(m.key().empty());
+                t.REQUIRE(m.str().empty());
+                t.REQUIRE(m.size() == 0);
+                t.REQUIRE(m[size_t(0)].is_unset() && m["a"].is_unset());
+        }
+        snap.root()["nested"];
+        snap.root()["zzz"];
+}
+
+static void test_snapshot_file(wbtester& t)
+{
+        const char* src = "/tmp/whitebox_json_snapshot.json";
+        const char* path = "/tmp/whitebox_json_snapshot.snap";
+        t.REQUIRE(write_file(src, s_doc));
+
+        mapped_file f;
+        t.REQUIRE(f.open(src, MADV_SEQUENTIAL));
+        t.REQUIRE(f.contents().equals(s_doc));
+        json::root r(f.contents());
+        t.REQUIRE(json::snapshot::save(r, path, src));
+
+        json::snapshot_file snap;
+        t.REQUIRE(snap.open(path, src));
+        t.REQUIRE(snap.verify());
+        t.REQUIRE(snap.root()["nested"]["b"]["c"].str().equals("deep"));
+
+        // a changed source makes the snapshot stale
+        timespec times[2];
+        times[0].tv_sec = times[1].tv_sec = 1000000;
+        times[0].tv_nsec = times[1].tv_nsec = 0;
+        t.REQUIRE(utimensat(AT_FDCWD, src, times, 0) == 0);
+        t.REQUIRE(!snap.is_current(src));
+        json::snapshot_file stale;
+        t.REQUIRE(!stale.open(path, src));
+        t.REQUIRE(stale.open(path));
+
+        t.REQUIRE(!stale.open("/tmp/whitebox_json_snapshot.missing"));
+        t.REQUIRE(!f.open("/tmp/whitebox_json_snapshot.missing"));
+        unlink(src);
+        unlink(path);
+}
+
+static void run_perf_test(uint64_t perf_size)
+{
+        std::string text;
+        json_builder<std::string> jb(text);
+        jb.open_array();
+        for (uint64_t i = 0; text.length() < perf_size; i++)
+        {
+                jb.open_object();
+                jb.add("name", "somebody with a name");
+                jb.add("id", i);
+                jb.add("price", 1.5 + i);
+                jb.open_array("tags").add("one").add("two").close();
+                jb.close();
+        }
+        jb.close();
+
+        const char* src = "/tmp/whitebox_json_snapshot_perf.json";
+        const char* path = "/tmp/whitebox_json_snapshot_perf.snap";
+        write_file(src, text);
+
+        uint64_t start = get_microseconds();
+        size_t count = 0;
+        {
+                mapped_file f;
+                f.open(src, MADV_SEQUENTIAL);
+                json::root r(f.contents());
+                count = r.size();
+                json::snapshot::save(r, path, src);
+        }
+        uint64_t end = get_microseconds();
+        fprintf(stderr, "perf_test, parse + save snapshot %zu bytes, %zu items, mic secs: %lu\n", text.length(), count, end - start);
+
+        start = get_microseconds();
+        {
+                mapped_file f;
+                f.open(src, MADV_SEQUENTIAL);
+                json::root r(f.contents());
+                count = r.size();
+        }
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, parse %zu bytes, mic secs: %lu\n", text.length(), end - start);
+
+        start = get_microseconds();
+        json::snapshot_file snap;
+        snap.open(path, src);
+        count = snap.root().size();
+        double d = snap.root()[count / 2]["price"].numb();
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, open snapshot %lu bytes + one lookup (%g), mic secs: %lu\n",
+                snap.header()->file_length, d, end - start);
+
+        start = get_microseconds();
+        bool ok = snap.verify();
+        end = get_microseconds();
+        fprintf(stderr, "perf_test, verify snapshot (%s), mic secs: %lu\n", ok ? "ok" : "bad", end - start);
+
+        unlink(src);
+        unlink(path);
+}
+
+int main(int argc, char** argv)
+{
+        bool do_perf = false;
+        uint64_t perf_size = 50 * 1024 * 1024;
+
+        for (int i = 1; i < argc; i++)
+        {
+                subbuffer arg(argv[i]);
+                if (arg.equals(CONST_SUBBUF("--perf")))
+                        do_perf = true;
+                else if (arg.starts_with(CONST_SUBBUF("--perf-size=")))
+                        perf_size = aton<uint64_t>(arg.after('='));
+        }
+
+        if (do_perf)
+        {
+                run_perf_test(perf_size);
+                return 0;
+        }
+
+        wbtester t;
+
+        t.ADD_TEST(test_snapshot);
+        t.ADD_TEST(test_snapshot_damage);
+        t.ADD_TEST(test_snapshot_file);
+
+        return t.run();
+}
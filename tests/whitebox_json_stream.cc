@@ -0,0 +1,169 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    whitebox_json_stream.cc
+//: \details: Test driver to exercise the json_stream logic
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#define JSON_TRACE(fmt, x...) do { } while(0)
+
+#include "json_stream.h"
+#include "json_parser.h"
+#include "wbtest.h"
+
+#include <string>
+
+struct capture
+{
+        capture() : text(), flushes(0), largest(0) {}
+        std::string text;
+        size_t flushes;
+        size_t largest;
+};
+
+static bool capture_func(const char* p, size_t len, void* ctx)
+{
+        capture* cap = (capture*)ctx;
+        cap->text.append(p, len);
+        cap->flushes++;
+        cap->largest = std::max(cap->largest, len);
+        return true;
+}
+
+static bool fail_func(const char*, size_t, void*)
+{
+        return false;
+}
+
+static void test_callback(wbtester& t)
+{
+        capture cap;
+        {
+                // tiny buffer so almost every call flushes
+                json_stream js(capture_func, &cap, 8);
+                js.begin_object();
+                js.add("name", "Hal");
+                js.add("age", 23);
+                js.key("aliases").begin_array().value("Bob").value("Joe").end_array();
+                js.begin_object("wife").add("name", "wifey").end_object();
+                js.add("male", true);
+                js.key("address").null_value();
+                js.begin_array("empty").end_array();
+                js.end_object();
+                t.REQUIRE(js.depth() == 0);
+                t.REQUIRE(js.good());
+        }
+
+        t.REQUIRE(cap.text == "{\"name\":\"Hal\",\"age\":23,\"aliases\":[\"Bob\",\"Joe\"],\"wife\":{\"name\":\"wifey\"},"
+                              "\"male\":true,\"address\":null,\"empty\":[]}");
+        t.REQUIRE(cap.flushes > 1);
+        t.REQUIRE(cap.largest <= 8);
+
+        json::root root(cap.text);
+        t.REQUIRE(root.is_valid());
+        t.REQUIRE(root["wife"]["name"].str().equals("wifey"));
+        t.REQUIRE(root["aliases"].size() == 2);
+}
+
+static void test_mixed(wbtester& t)
+{
+        capture cap;
+        json_stream js(capture_func, &cap, 16);
+
+        json_object obj;
+        obj.add("a", 1);
+        json_array arr;
+        arr.add("x");
+
+        js.begin_array();
+        js.add(obj);
+        js.add(arr);
+        js.add(1.5);
+        js.add("long string value that is bigger than the buffer");
+
+        // a parsed document can be streamed out as well
+        json::root root("{\"k\": [1, 2, 3]}");
+        json_object empty;
+        js.value(empty);
+        js.write(root);
+        js.end_array();
+        js.flush();
+
+        t.REQUIRE(cap.text == "[{\"a\":1},[\"x\"],1.5,\"long string value that is bigger than the buffer\",{},{\"k\": [1, 2, 3]}]");
+        t.REQUIRE(js.length() == cap.text.length());
+        t.REQUIRE(cap.largest <= 16);
+}
+
+static void test_file(wbtester& t)
+{
+        FILE* fp = tmpfile();
+        t.REQUIRE(fp != NULL);
+        if (!fp) return;
+        {
+                json_stream js(fp, 32);
+                js.begin_array();
+                for (int i = 0; i < 1000; i++)
+                        js.value(i);
+                js.end_array();
+        }
+        long len = ftell(fp);
+        rewind(fp);
+        std::string text(len, '\0');
+        t.REQUIRE(fread(&text[0], 1, len, fp) == (size_t)len);
+        fclose(fp);
+
+        json::root root(text);
+        t.REQUIRE(root.size() == 1000);
+        t.REQUIRE(root[999].numb() == 999);
+}
+
+static void test_fd(wbtester& t)
+{
+        int fds[2];
+        t.REQUIRE(0 == pipe(fds));
+        {
+                json_stream js(fds[1], 4);
+                js.begin_object().add("fd", "pipe").end_object();
+                t.REQUIRE(js.flush());
+        }
+        close(fds[1]);
+        char buff[64];
+        ssize_t len = read(fds[0], buff, sizeof(buff));
+        close(fds[0]);
+        t.REQUIRE(len > 0 && subbuffer(buff, len).equals("{\"fd\":\"pipe\"}"));
+}
+
+static void test_failure(wbtester& t)
+{
+        json_stream js(fail_func, NULL, 4);
+        js.begin_array().value("this will not fit").end_array();
+        t.REQUIRE(!js.good());
+        t.REQUIRE(!js.flush());
+}
+
+int main()
+{
+        wbtester t;
+
+        t.ADD_TEST(test_callback);
+        t.ADD_TEST(test_mixed);
+        t.ADD_TEST(test_file);
+        t.ADD_TEST(test_fd);
+        t.ADD_TEST(test_failure);
+
+        return t.run();
+}
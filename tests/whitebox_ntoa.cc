@@ -0,0 +1,266 @@
+//: ----------------------------------------------------------------------------
+//: Copyright (C) 2015 Verizon.  All Rights Reserved.
+//:
+//: \file:    whitebox_ntoa.cc
+//: \details: Test driver for ntoa/dtoa functionality
+//: \author:  Donnevan "Scott" Yeager
+//: \date:    02/03/2015
+//:
+//:   Licensed under the Apache License, Version 2.0 (the "License");
+//:   you may not use this file except in compliance with the License.
+//:   You may obtain a copy of the License at
+//:
+//:       http://www.apache.org/licenses/LICENSE-2.0
+//:
+//:   Unless required by applicable law or agreed to in writing, software
+//:   distributed under the License is distributed on an "AS IS" BASIS,
+//:   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//:   See the License for the specific language governing permissions and
+//:   limitations under the License.
+//:
+
+#define JSON_TRACE(fmt, x...) do { } while(0)
+
+#include "ntoa.h"
+#include "json_parser.h"
+#include "wbtest.h"
+
+#include <stdlib.h>
+#include <float.h>
+#include <limits>
+#include <vector>
+
+#include <sys/time.h>
+
+static uint64_t get_microseconds()
+{
+        timeval tv;
+        ::gettimeofday(&tv, 0);
+        return static_cast <uint64_t>((static_cast <uint64_t>(tv.tv_sec) * 1000000)  + tv.tv_usec);
+}
+
+static uint64_t s_rand_state = 88172645463325252ULL;
+
+static uint64_t next_rand()
+{
+        // xorshift64, deterministic so failures can be reproduced
+        s_rand_state ^= s_rand_state << 13;
+        s_rand_state ^= s_rand_state >> 7;
+        s_rand_state ^= s_rand_state << 17;
+        return s_rand_state;
+}
+
+static bool check_dtoa(double d, const char* exp)
+{
+        char buff[NTOA_BUFF_SIZE];
+        size_t len = dtoa(d, buff);
+        bool ok = subbuffer(buff, len).equals(exp);
+        if (!ok) printf("dtoa(%.17g) = '%.*s', expected '%s'\n", d, int(len), buff, exp);
+        return ok;
+}
+
+static void test_integers(wbtester& t)
+{
+        char buff[NTOA_BUFF_SIZE];
+        char exp[NTOA_BUFF_SIZE];
+
+        t.REQUIRE(subbuffer(buff, ntoa(int64_t(0), buff)).equals("0"));
+        t.REQUIRE(subbuffer(buff, ntoa(int64_t(-1), buff)).equals("-1"));
+        t.REQUIRE(subbuffer(buff, ntoa(std::numeric_limits<int64_t>::min(), buff)).equals("-9223372036854775808"));
+        t.REQUIRE(subbuffer(buff, ntoa(std::numeric_limits<int64_t>::max(), buff)).equals("9223372036854775807"));
+        t.REQUIRE(subbuffer(buff, ntoa(std::numeric_limits<uint64_t>::max(), buff)).equals("18446744073709551615"));
+        t.REQUIRE(subbuffer(buff, ntoa(std::numeric_limits<int32_t>::min(), buff)).equals("-2147483648"));
+        t.REQUIRE(subbuffer(buff, ntoa(std::numeric_limits<uint32_t>::max(), buff)).equals("4294967295"));
+
+        // every power of ten boundary
+        uint64_t failures = 0;
+        for (uint64_t p = 1; p && p <= 10000000000000000000ULL; p *= 10)
+        {
+                uint64_t vals[] = { p - 1, p, p + 1 };
+                for (size_t i = 0; i < 3; i++)
+                {
+                        snprintf(exp, sizeof(exp), "%lu", vals[i]);
+                        if (!subbuffer(buff, ntoa(vals[i], buff)).equals(exp)) failures++;
+                        snprintf(exp, sizeof(exp), "%ld", -int64_t(vals[i]));
+                        if (!subbuffer(buff, ntoa(-int64_t(vals[i]), buff)).equals(exp)) failures++;
+                }
+                if (p > 10000000000000000000ULL / 10) break;
+        }
+        t.REQUIRE(failures == 0);
+
+        failures = 0;
+        for (int i = 0; i < 1000000; i++)
+        {
+                int64_t v = int64_t(next_rand()) >> (next_rand() % 64);
+                snprintf(exp, sizeof(exp), "%ld", v);
+                if (!subbuffer(buff, ntoa(v, buff)).equals(exp)) failures++;
+        }
+        t.REQUIRE(failures == 0);
+}
+
+static void test_doubles(wbtester& t)
+{
+        t.REQUIRE(check_dtoa(0.0, "0"));
+        t.REQUIRE(check_dtoa(-0.0, "-0"));
+        t.REQUIRE(check_dtoa(1.0, "1"));
+        t.REQUIRE(check_dtoa(-1.5, "-1.5"));
+        t.REQUIRE(check_dtoa(0.1, "0.1"));
+        t.REQUIRE(check_dtoa(0.3, "0.3"));
+        t.REQUIRE(check_dtoa(100.0, "100"));
+        t.REQUIRE(check_dtoa(123.456, "123.456"));
+        t.REQUIRE(check_dtoa(2.0 / 3.0, "0.6666666666666666"));
+        t.REQUIRE(check_dtoa(0.000001, "0.000001"));
+        t.REQUIRE(check_dtoa(1e-7, "1e-7"));
+        t.REQUIRE(check_dtoa(1.5e-7, "1.5e-7"));
+        t.REQUIRE(check_dtoa(1e20, "100000000000000000000"));
+        t.REQUIRE(check_dtoa(1e21, "1e+21"));
+        t.REQUIRE(check_dtoa(123456789012345680000.0, "123456789012345680000"));
+        t.REQUIRE(check_dtoa(DBL_MAX, "1.7976931348623157e+308"));
+        t.REQUIRE(check_dtoa(DBL_MIN, "2.2250738585072014e-308"));
+        t.REQUIRE(check_dtoa(4.9406564584124654e-324, "5e-324"));
+        t.REQUIRE(check_dtoa(std::numeric_limits<double>::infinity(), "null"));
+        t.REQUIRE(check_dtoa(std::numeric_limits<double>::quiet_NaN(), "null"));
+
+        // the old fixed format is still available
+        char buff[NTOA_BUFF_SIZE];
+        t.REQUIRE(subbuffer(buff, dtoa(1.5, buff, 2)).equals("1.50"));
+        t.REQUIRE(subbuffer(buff, dtoa(2.0 / 3.0, buff, 4)).equals("0.6667"));
+
+        // round trip random bit patterns through strtod
+        uint64_t failures = 0;
+        for (int i = 0; i < 1000000; i++)
+        {
+                uint64_t bits = next_rand();
+                double d;
+                memcpy(&d, &bits, sizeof(d));
+                if (d != d || d - d != 0.0) continue;
+                size_t len = dtoa(d, buff);
+                buff[len] = '\0';
+                if (strtod(buff, NULL) != d)
+                {
+                        if (failures++ < 10) printf("round trip failed: %.17g -> %s\n", d, buff);
+                }
+        }
+        t.REQUIRE(failures == 0);
+
+        // and through the json parser
+        json_array arr;
+        double vals[] = { 0.1, -2.5, 1e21, 1.5e-7, 3.0, 1234.5678 };
+        for (size_t i = 0; i < sizeof(vals) / sizeof(vals[0]); i++)
+                arr.add(vals[i]);
+        std::string text;
+        arr.to_string(text);
+        t.REQUIRE(text == "[0.1,-2.5,1e+21,1.5e-7,3,1234.5678]");
+        json::root root(text);
+        t.REQUIRE(root.size() == 6);
+        t.REQUIRE(root[1].numb() == -2.5);
+        t.REQUIRE(root[2].numb() == 1e21);
+        t.REQUIRE(root[4].numb() == 3.0);
+
+        // random bit patterns round trip through the parser too, not only strtod
+        std::vector<double> doubles;
+        doubles.push_back(1e23);
+        doubles.push_back(-1.9934908051011655e+189);
+        doubles.push_back(4.9406564584124654e-324);
+        doubles.push_back(DBL_MAX);
+        while (doubles.size() < 100000)
+        {
+                uint64_t bits = next_rand();
+                double d;
+                memcpy(&d, &bits, sizeof(d));
+                if (d == d && d - d == 0.0) doubles.push_back(d);
+        }
+        text = "[";
+        for (size_t i = 0; i < doubles.size(); i++)
+        {
+                if (i) text += ',';
+                text.append(buff, dtoa(doubles[i], buff));
+        }
+        text += ']';
+        json::root many(text);
+        t.REQUIRE(many.size() == doubles.size());
+        failures = 0;
+        for (size_t i = 0; i < doubles.size() && i < many.size(); i++)
+        {
+                double d = 0;
+                subbuffer num(buff, dtoa(doubles[i], buff));
+                if (many[i].numb() != doubles[i] || !json::scan::to_double(num, d) || d != doubles[i])
+                {
+                        if (failures++ < 10) printf("parser round trip failed: %.17g -> %.*s\n", doubles[i], SUBBUF_FORMAT(num));
+                }
+        }
+        t.REQUIRE(failures == 0);
+}
+
+static void test_integer_performance(wbtester&)
+{
+        std::vector<int64_t> nums;
+        for (int64_t i = -1147483640; i < 1147483640; i += 3163)
+                nums.push_back(i * 1000);
+
+        char buff[NTOA_BUFF_SIZE];
+        uint64_t total = 0;
+        uint64_t start = get_microseconds();
+        for (size_t i = 0; i < nums.size(); ++i)
+                total += ntoa(nums[i], buff);
+        uint64_t end = get_microseconds();
+        double each = double(end - start) / nums.size();
+        fprintf(stdout, "%-20s %zu conversions (result %lu) took %.3fus/check => %14.3f checks/sec\n",
+                "ntoa<int64_t>", nums.size(), total, each, 1000000 / each);
+
+        total = 0;
+        start = get_microseconds();
+        for (size_t i = 0; i < nums.size(); ++i)
+                total += snprintf(buff, sizeof(buff), "%ld", nums[i]);
+        end = get_microseconds();
+        each = double(end - start) / nums.size();
+        fprintf(stdout, "%-20s %zu conversions (result %lu) took %.3fus/check => %14.3f checks/sec\n",
+                "snprintf(%ld)", nums.size(), total, each, 1000000 / each);
+}
+
+static void test_double_performance(wbtester&)
+{
+        std::vector<double> nums;
+        for (double d = -25.00001; d < 25.0; d += 0.00007)
+                nums.push_back(d);
+
+        char buff[NTOA_BUFF_SIZE];
+        uint64_t total = 0;
+        uint64_t start = get_microseconds();
+        for (size_t i = 0; i < nums.size(); ++i)
+                total += dtoa(nums[i], buff);
+        uint64_t end = get_microseconds();
+        double each = double(end - start) / nums.size();
+        fprintf(stdout, "%-20s %zu conversions (result %lu) took %.3fus/check => %14.3f checks/sec\n",
+                "dtoa", nums.size(), total, each, 1000000 / each);
+
+        total = 0;
+        start = get_microseconds();
+        for (size_t i = 0; i < nums.size(); ++i)
+                total += dtoa(nums[i], buff, 2);
+        end = get_microseconds();
+        each = double(end - start) / nums.size();
+        fprintf(stdout, "%-20s %zu conversions (result %lu) took %.3fus/check => %14.3f checks/sec\n",
+                "dtoa(fixed 2)", nums.size(), total, each, 1000000 / each);
+
+        total = 0;
+        start = get_microseconds();
+        for (size_t i = 0; i < nums.size(); ++i)
+                total += snprintf(buff, sizeof(buff), "%.17g", nums[i]);
+        end = get_microseconds();
+        each = double(end - start) / nums.size();
+        fprintf(stdout, "%-20s %zu conversions (result %lu) took %.3fus/check => %14.3f checks/sec\n",
+                "snprintf(%.17g)", nums.size(), total, each, 1000000 / each);
+}
+
+int main()
+{
+        wbtester t;
+
+        t.ADD_TEST(test_integers);
+        t.ADD_TEST(test_doubles);
+        t.ADD_TEST(test_integer_performance);
+        t.ADD_TEST(test_double_performance);
+
+        return t.run();
+}